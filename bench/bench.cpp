@@ -0,0 +1,103 @@
+// @note Benchmarks
+// Headless benchmarks and the backend conformance check, built on Linux by the Makefile next to
+// build.bat. The editor core is the same unity build as Codex.exe, with win32_shims.h standing in
+// for the few Win32 calls it makes outside the OS layer. build/bench with no arguments lists what
+// can be run.
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <stdint.h>
+#define internal static
+#define local_persist static
+#define global static
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+typedef s32 b32;
+typedef float f32;
+typedef double f64;
+
+#define WIDTH 1200
+#define HEIGHT 900
+
+template <typename V, typename L, typename H> V clamp(const V &value, const L &min, const H &max) {
+    if (value < min) return V(min);
+    if (value > max) return V(max);
+    return value;
+}
+
+internal void block_zero(void *mem, size_t size) {
+    memset(mem, 0, size);
+}
+
+#include "win32_shims.h"
+#include "xpath.h"
+#include "array.cpp"
+#include "os.cpp"
+#include "codex.cpp"
+
+#include "draw.cpp"
+
+#include "bench_common.cpp"
+#include "bench_backends.cpp"
+#include "bench_keystroke.cpp"
+#include "bench_motion.cpp"
+#include "bench_gap.cpp"
+#include "bench_spread.cpp"
+#include "bench_paste.cpp"
+#include "bench_regex.cpp"
+#include "bench_newlines.cpp"
+#include "bench_search.cpp"
+#include "bench_draw.cpp"
+
+typedef void (*BenchProc)(int argc, char **argv);
+
+struct Benchmark {
+    const char *name;
+    const char *args;
+    const char *description;
+    BenchProc run;
+};
+
+global Benchmark benchmarks[] = {
+    { "conformance", "[ops]", "the same random edits on every backend, compared as they go", conformance_benchmark },
+    { "backends", "[MB] [ops]", "mixed editing on every backend, ops/s and memory", backends_benchmark },
+    { "keystroke", "[keys]", "typing mid-file at growing file sizes on every backend, cost per keystroke", keystroke_benchmark },
+    { "motion", "[MB] [moves]", "goto_file_end then move_char_left over and over", motion_benchmark },
+    { "gap", "[MB] [ops] [paste MB]", "gap buffer inserts and deletes, and a paste typed a byte at a time", gap_benchmark },
+    { "spread", "[MB] [ops]", "edits spread over a large file on every backend", spread_benchmark },
+    { "paste", "", "a 4 KB paste a byte at a time, in a transaction and in one insert", paste_benchmark },
+    { "regex", "[MB]", "literal and regex search over tests/code.txt scaled up, and pathological patterns", regex_benchmark },
+    { "newlines", "[MB]", "newline kernels checked against the scalar loop, and their throughput", newlines_benchmark },
+    { "search", "[MB]", "parallel search with 1 to 16 workers, throughput and first match latency", search_benchmark },
+    { "draw", "[frames]", "drawing a view at the top, middle and end of large files", draw_benchmark },
+};
+
+int main(int argc, char **argv) {
+    application = application_init();
+    for (s32 i = 0; i < (s32)ARRAYCOUNT(benchmarks); i++) {
+        if (argc > 1 && strcmp(argv[1], benchmarks[i].name) == 0) {
+            benchmarks[i].run(argc - 2, argv + 2);
+            return bench_failed ? 1 : 0;
+        }
+    }
+    printf("usage: bench <name> [args]\n");
+    for (s32 i = 0; i < (s32)ARRAYCOUNT(benchmarks); i++) {
+        printf("  %-12s %-22s %s\n", benchmarks[i].name, benchmarks[i].args, benchmarks[i].description);
+    }
+    return argc > 1 ? 1 : 0;
+}
@@ -0,0 +1,213 @@
+// @note Backend benchmarks
+// conformance replays one editing session on a buffer per backend and compares them as it goes,
+// then checks that typing at one cursor undoes as one record. backends times the same session on a large text and reports what each backend holds in memory.
+
+#define CONFORMANCE_SIZE (1024 * 1024)
+#define CONFORMANCE_EVERY 50
+#define CONFORMANCE_SNAPSHOTS 8
+#define CONFORMANCE_TYPED 64
+
+internal u8 *bench_copy(u8 *data, s64 count) {
+    u8 *copy = (u8 *)malloc(count + 1);
+    memcpy(copy, data, count + 1);
+    return copy;
+}
+
+// Compares a buffer against the first one: length, bytes, line count and where sampled lines
+// start. Returns false and says what differs at the first mismatch.
+internal bool conformance_compare(Buffer *expected, Buffer *buffer, const char *name, s64 step, u32 seed) {
+    s64 length = buffer_length(expected);
+    if (buffer_length(buffer) != length) {
+        printf("step %lld: %s has length %lld, gap has %lld\n", (long long)step, name, (long long)buffer_length(buffer), (long long)length);
+        return false;
+    }
+    const s64 chunk = 64 * 1024;
+    u8 *a = (u8 *)malloc(chunk);
+    u8 *b = (u8 *)malloc(chunk);
+    bool same = true;
+    for (s64 pos = 0; pos < length && same; pos += chunk) {
+        s64 end = pos + chunk < length ? pos + chunk : length;
+        text_read(expected->text, pos, end, a);
+        text_read(buffer->text, pos, end, b);
+        if (memcmp(a, b, end - pos) != 0) {
+            s64 at = 0;
+            while (a[at] == b[at]) at++;
+            printf("step %lld: %s differs from gap at byte %lld\n", (long long)step, name, (long long)(pos + at));
+            same = false;
+        }
+    }
+    free(a);
+    free(b);
+    if (!same) return false;
+
+    s64 lines = get_line_count(expected);
+    if (get_line_count(buffer) != lines) {
+        printf("step %lld: %s has %lld lines, gap has %lld\n", (long long)step, name, (long long)get_line_count(buffer), (long long)lines);
+        return false;
+    }
+    for (s32 i = 0; i < 16; i++) {
+        s64 line = bench_random(&seed) % lines;
+        if (get_line_pos(buffer, line) != get_line_pos(expected, line)) {
+            printf("step %lld: %s starts line %lld at %lld, gap at %lld\n", (long long)step, name, (long long)line,
+                   (long long)get_line_pos(buffer, line), (long long)get_line_pos(expected, line));
+            return false;
+        }
+        s64 pos = bench_random(&seed) % (length + 1);
+        if (get_cursor_from_pos(buffer, pos).line != get_cursor_from_pos(expected, pos).line) {
+            printf("step %lld: %s puts byte %lld on another line than gap\n", (long long)step, name, (long long)pos);
+            return false;
+        }
+    }
+    return true;
+}
+
+// a snapshot with a copy of the text it was taken of, to check later edits leave it alone
+struct ConformanceSnapshot {
+    TextSnapshot *snapshot;
+    u8 *expected;
+    s64 length;
+};
+
+internal bool conformance_check_snapshot(ConformanceSnapshot *held, const char *name) {
+    bool same = held->snapshot->length == held->length;
+    if (same) {
+        u8 *data = (u8 *)malloc(held->length + 1);
+        text_snapshot_read(held->snapshot, 0, held->length, data);
+        same = memcmp(data, held->expected, held->length) == 0;
+        free(data);
+    }
+    if (!same) printf("%s snapshot changed after later edits\n", name);
+    return same;
+}
+
+// Types through self_insert the way a run of keystrokes arrives, in one edit group. The keys
+// have to make one record, and undoing it has to give the text back.
+internal bool conformance_check_typing(TextBackend backend) {
+    s64 length = CONFORMANCE_SIZE / 16;
+    u8 *data = bench_generate_log(length, 11);
+    Buffer *buffer = bench_buffer(backend, bench_copy(data, length), length);
+    View *view = view_init();
+    view->buffer = buffer;
+    view->cursor = get_cursor_from_pos(buffer, length / 2);
+    View *active = application->active_view;
+    application->active_view = view;
+
+    History *history = &buffer->history;
+    s64 records = history->current;
+    edit_group++;
+    for (s32 i = 0; i < CONFORMANCE_TYPED; i++) {
+        last_insert_char = (char)('a' + i % 26);
+        self_insert(application);
+    }
+    bool ok = true;
+    if (history->current - records != 1) {
+        printf("%s: %d typed keys made %lld undo records\n", bench_backend_names[backend], CONFORMANCE_TYPED, (long long)(history->current - records));
+        ok = false;
+    }
+    history_undo(history, buffer->text);
+    u8 *now = (u8 *)malloc(length + 1);
+    if (buffer_length(buffer) == length) text_read(buffer->text, 0, length, now);
+    if (buffer_length(buffer) != length || memcmp(now, data, length) != 0) {
+        printf("%s: undoing typed keys did not give the text back\n", bench_backend_names[backend]);
+        ok = false;
+    }
+    free(now);
+    free(data);
+    application->active_view = active;
+    return ok;
+}
+
+internal void conformance_benchmark(int argc, char **argv) {
+    s64 steps = bench_arg(argc, argv, 0, 20000);
+    u8 *data = bench_generate_log(CONFORMANCE_SIZE, 7);
+    Buffer *buffers[3];
+    BenchSession sessions[3];
+    for (s32 b = 0; b < 3; b++) {
+        buffers[b] = bench_buffer((TextBackend)b, bench_copy(data, CONFORMANCE_SIZE), CONFORMANCE_SIZE);
+        sessions[b] = { buffers[b], CONFORMANCE_SIZE / 2 };
+    }
+    free(data);
+
+    ConformanceSnapshot held[3][CONFORMANCE_SNAPSHOTS] = {};
+    s32 held_count = 0;
+    u32 seed = 12345;
+    for (s64 step = 1; step <= steps && !bench_failed; step++) {
+        BenchStep next = bench_next_step(&seed);
+        for (s32 b = 0; b < 3; b++) {
+            bench_step(&sessions[b], next);
+        }
+        if (step % CONFORMANCE_EVERY != 0) continue;
+
+        for (s32 b = 1; b < 3; b++) {
+            if (!conformance_compare(buffers[0], buffers[b], bench_backend_names[b], step, next.seed)) {
+                printf("step %lld was a %s\n", (long long)step, bench_step_names[next.kind]);
+                bench_failed = true;
+            }
+        }
+        // every so often swap the oldest snapshots for new ones, after checking them
+        if (step % (CONFORMANCE_EVERY * 10) == 0) {
+            s32 slot = held_count % CONFORMANCE_SNAPSHOTS;
+            for (s32 b = 0; b < 3; b++) {
+                ConformanceSnapshot *old = &held[b][slot];
+                if (old->snapshot) {
+                    if (!conformance_check_snapshot(old, bench_backend_names[b])) bench_failed = true;
+                    text_snapshot_free(old->snapshot);
+                    free(old->expected);
+                }
+                s64 length = buffer_length(buffers[b]);
+                old->snapshot = text_snapshot(buffers[b]->text);
+                old->length = length;
+                old->expected = (u8 *)malloc(length + 1);
+                text_read(buffers[b]->text, 0, length, old->expected);
+            }
+            held_count++;
+        }
+    }
+    for (s32 b = 0; b < 3; b++) {
+        for (s32 i = 0; i < CONFORMANCE_SNAPSHOTS; i++) {
+            ConformanceSnapshot *old = &held[b][i];
+            if (old->snapshot == nullptr) continue;
+            if (!conformance_check_snapshot(old, bench_backend_names[b])) bench_failed = true;
+            text_snapshot_free(old->snapshot);
+            free(old->expected);
+        }
+    }
+    for (s32 b = 0; b < 3; b++) {
+        if (!conformance_check_typing((TextBackend)b)) bench_failed = true;
+    }
+    printf("conformance: %lld steps on gap, piece and rope, %s\n", (long long)steps, bench_failed ? "FAILED" : "all agree");
+}
+
+struct BackendsRun {
+    TextBackend backend;
+    s64 size;
+    s64 steps;
+};
+
+internal void backends_run(void *data) {
+    BackendsRun *run = (BackendsRun *)data;
+    u8 *text = bench_generate_log(run->size, 7);
+    s64 before = bench_resident();
+    f64 start = os_seconds();
+    Buffer *buffer = bench_buffer(run->backend, text, run->size);
+    f64 loaded = os_seconds();
+    BenchSession session = { buffer, run->size / 2 };
+    u32 seed = 12345;
+    for (s64 step = 0; step < run->steps; step++) {
+        bench_step(&session, bench_next_step(&seed));
+    }
+    f64 end = os_seconds();
+    printf("%-6s load %8.1f ms  %10.0f ops/s  resident %7.1f MB over the text  peak %7.1f MB\n",
+           bench_backend_names[run->backend], (loaded - start) * 1000.0, (f64)run->steps / (end - loaded),
+           (f64)(bench_resident() - before) / (1024.0 * 1024.0), (f64)bench_peak_resident() / (1024.0 * 1024.0));
+}
+
+internal void backends_benchmark(int argc, char **argv) {
+    s64 megabytes = bench_arg(argc, argv, 0, 256);
+    s64 steps = bench_arg(argc, argv, 1, 2000);
+    printf("%lld editing steps on %lld MB of log\n", (long long)steps, (long long)megabytes);
+    for (s32 b = 0; b < 3; b++) {
+        BackendsRun run = { (TextBackend)b, megabytes * 1024 * 1024, steps };
+        bench_apart(backends_run, &run);
+    }
+}
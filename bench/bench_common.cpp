@@ -0,0 +1,244 @@
+// @note Bench helpers
+// Generated texts, buffers on a chosen backend, memory readings and the editing session the
+// backend benchmarks replay.
+
+// set by a check that failed, the exit code says so
+global b32 bench_failed;
+
+global const char *bench_backend_names[] = { "gap", "piece", "rope" };
+
+inline internal u32 bench_random(u32 *seed) {
+    u32 x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+// the i-th argument as a number, or fallback when it is missing
+internal s64 bench_arg(int argc, char **argv, int i, s64 fallback) {
+    return i < argc ? atoll(argv[i]) : fallback;
+}
+
+// size bytes of log lines, with room for the terminator the gap buffer keeps
+internal u8 *bench_generate_log(s64 size, u32 seed) {
+    u8 *text = (u8 *)malloc(size + 1);
+    const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "DEBUG", "WARN" };
+    for (s64 i = 0; i < size; ) {
+        bench_random(&seed);
+        char line[128];
+        const char *level = seed % 4096 == 0 ? "ERROR" : levels[seed % ARRAYCOUNT(levels)];
+        s32 n = snprintf(line, sizeof(line), "12:%02u:%02u %s worker %u served request %u in %ums\n",
+                         seed % 60, (seed >> 6) % 60, level, (seed >> 12) % 64, seed >> 8, (seed >> 20) % 500);
+        if (n > size - i) n = (s32)(size - i);
+        memcpy(text + i, line, n);
+        i += n;
+    }
+    text[size] = '\0';
+    return text;
+}
+
+// Loads data, allocated with a byte to spare, on the given backend whatever its size. Takes
+// ownership of data.
+internal TextBuffer *bench_text(TextBackend backend, u8 *data, s64 count) {
+    TextBuffer *text = (TextBuffer *)malloc(sizeof(TextBuffer));
+    block_zero(text, sizeof(TextBuffer));
+    text->backend = backend;
+    switch (backend) {
+    case PieceBackend:
+        piece_table_init(&text->pieces, shared_bytes_new(data), count);
+        break;
+    case RopeBackend:
+        rope_init(&text->rope, data, count);
+        free(data);
+        break;
+    default:
+        text->contents = data;
+        text->gap_start = 0;
+        text->gap_end = 0;
+        text->end = count;
+        break;
+    }
+    text_rebuild_lines(text);
+    return text;
+}
+
+internal Buffer *bench_buffer(TextBackend backend, u8 *data, s64 count) {
+    return buffer_init(STRZ((char *)"bench"), bench_text(backend, data, count), LineEnding::LF);
+}
+
+// resident bytes of the process right now
+internal s64 bench_resident() {
+    s64 pages = 0;
+    s64 resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%lld %lld", (long long *)&pages, (long long *)&resident) != 2) resident = 0;
+        fclose(statm);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// the most the process has held resident
+internal s64 bench_peak_resident() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (s64)usage.ru_maxrss * 1024;
+}
+
+// Runs proc in a child process, so what it allocates is measured on its own and given back after
+internal void bench_apart(void (*proc)(void *), void *data) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        proc(data);
+        fflush(stdout);
+        _exit(bench_failed ? 1 : 0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) bench_failed = true;
+}
+
+// @note Editing session
+// What a person does to a file, as a stream of steps: mostly typing near the last edit, now and
+// then a paste, a cut, a jump elsewhere, an undo or redo, or edits at several cursors at once.
+// A step only says what kind it is and carries a seed. Where it lands comes from the seed and the
+// buffer's own length, so buffers with the same text take the same steps.
+enum BenchStepKind {
+    BenchType,
+    BenchErase,
+    BenchPaste,
+    BenchCut,
+    BenchJump,
+    BenchUndo,
+    BenchRedo,
+    BenchBatch,
+    BenchReplace,
+};
+
+global const char *bench_step_names[] = { "type", "erase", "paste", "cut", "jump", "undo", "redo", "batch", "replace" };
+
+struct BenchStep {
+    BenchStepKind kind;
+    u32 seed;
+};
+
+struct BenchSession {
+    Buffer *buffer;
+    s64 at; // where the last edit was
+};
+
+internal BenchStep bench_next_step(u32 *seed) {
+    u32 r = bench_random(seed) % 100;
+    BenchStep step;
+    if (r < 55) step.kind = BenchType;
+    else if (r < 70) step.kind = BenchErase;
+    else if (r < 76) step.kind = BenchPaste;
+    else if (r < 82) step.kind = BenchCut;
+    else if (r < 90) step.kind = BenchJump;
+    else if (r < 94) step.kind = BenchUndo;
+    else if (r < 97) step.kind = BenchRedo;
+    else if (r < 99) step.kind = BenchBatch;
+    else step.kind = BenchReplace;
+    step.seed = bench_random(seed) | 1;
+    return step;
+}
+
+// count bytes of lines of up to 80 letters
+internal void bench_fill(u8 *data, s64 count, u32 seed) {
+    for (s64 i = 0; i < count; i++) {
+        u32 r = bench_random(&seed);
+        data[i] = r % 80 == 0 ? '\n' : (u8)('a' + r % 26);
+    }
+}
+
+internal void bench_step(BenchSession *session, BenchStep step) {
+    Buffer *buffer = session->buffer;
+    u32 seed = step.seed;
+    s64 length = buffer_length(buffer);
+    if (session->at > length) session->at = length;
+    edit_group++;
+    switch (step.kind) {
+    case BenchType: {
+        u8 c = bench_random(&seed) % 12 == 0 ? '\n' : (u8)('a' + seed % 26);
+        insert_char(buffer, session->at, c);
+        session->at++;
+        break;
+    }
+    case BenchErase:
+        if (session->at > 0) {
+            delete_range(buffer, session->at - 1, session->at);
+            session->at--;
+        }
+        break;
+    case BenchPaste: {
+        s64 count = 1 + bench_random(&seed) % 8192;
+        u8 *data = (u8 *)malloc(count);
+        bench_fill(data, count, seed);
+        insert_string(buffer, session->at, data, count);
+        free(data);
+        session->at += count;
+        break;
+    }
+    case BenchCut: {
+        s64 start = length > 0 ? bench_random(&seed) % length : 0;
+        delete_range(buffer, start, start + 1 + bench_random(&seed) % 4096);
+        session->at = start;
+        break;
+    }
+    case BenchJump:
+        session->at = bench_random(&seed) % (length + 1);
+        break;
+    case BenchUndo: {
+        s64 pos = history_undo(&buffer->history, buffer->text);
+        if (pos >= 0) session->at = pos;
+        break;
+    }
+    case BenchRedo: {
+        s64 pos = history_redo(&buffer->history, buffer->text);
+        if (pos >= 0) session->at = pos;
+        break;
+    }
+    case BenchBatch: {
+        // the same keystroke at several cursors, from the last one back
+        s64 cursors = 2 + bench_random(&seed) % 30;
+        s64 pos = length;
+        buffer_begin_edit(buffer);
+        for (s64 i = 0; i < cursors && pos > 0; i++) {
+            pos -= 1 + bench_random(&seed) % (length / cursors + 1);
+            if (pos < 0) pos = 0;
+            if (bench_random(&seed) % 2) {
+                insert_char(buffer, pos, 'x');
+            } else if (pos < buffer_length(buffer)) {
+                delete_range(buffer, pos, pos + 1);
+            }
+        }
+        buffer_commit_edit(buffer);
+        session->at = pos;
+        break;
+    }
+    case BenchReplace: {
+        // a word typed over a selection at each cursor
+        CursorEdit edits[16];
+        s64 count = 0;
+        s64 pos = 0;
+        u8 word[] = "replaced";
+        while (count < (s64)ARRAYCOUNT(edits)) {
+            pos += bench_random(&seed) % (length / (s64)ARRAYCOUNT(edits) + 1);
+            s64 end = pos + bench_random(&seed) % 16;
+            if (end > length) break;
+            edits[count++] = { pos, end, word, (s64)(bench_random(&seed) % sizeof(word)) };
+            pos = end + 1;
+        }
+        buffer_replace(buffer, edits, count);
+        if (count > 0) session->at = edits[0].start;
+        break;
+    }
+    }
+    // moving the cursor to the edit looks its line up
+    s64 at = session->at < buffer_length(buffer) ? session->at : buffer_length(buffer);
+    Cursor cursor = get_cursor_from_pos(buffer, at);
+    get_line_pos(buffer, cursor.line);
+}
@@ -0,0 +1,89 @@
+// @note Draw benchmark
+// Draws a view of generated text of growing size at its top, middle and end, and with everything
+// selected, using a stand-in font and no GPU. Reports the time and vertices per frame.
+
+internal void draw_benchmark(int argc, char **argv) {
+    // control characters stay blank, as in the atlas built from the font
+    FontAtlas atlas{};
+    for (s32 c = ' '; c < 128; c++) {
+        FontGlyph *glyph = &atlas.glyphs[c];
+        glyph->ax = 10.0f;
+        glyph->bx = c > ' ' ? 9.0f : 0.0f;
+        glyph->by = 14.0f;
+        glyph->bt = 12.0f;
+    }
+    atlas.width = 1280;
+    atlas.height = 16;
+    atlas.ascend = 14.0f;
+    atlas.glyph_height = 18.0f;
+
+    RenderTarget target{};
+    target.width = WIDTH;
+    target.height = HEIGHT;
+    View *view = view_init();
+    view->rect = {0, 0, WIDTH, HEIGHT - atlas.glyph_height};
+    view->lines = (int)(HEIGHT / atlas.glyph_height) - 1;
+    view->atlas = &atlas;
+    application->active_view = view;
+    highlight_set(application, STRZ((char *)"served"));
+
+    s64 sizes[] = { 1 << 20, 16 << 20, 256 << 20 };
+    const char *places[] = { "top", "middle", "end", "selected" };
+    printf("drawing a %dx%d view of %d lines\n", WIDTH, HEIGHT, view->lines);
+    for (s64 size : sizes) {
+        u8 *data = (u8 *)malloc(size);
+        u32 seed = 0x2545F491;
+        for (s64 i = 0; i < size; ) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            char line[128];
+            s32 n = snprintf(line, sizeof(line), "12:%02u:%02u worker %u served request %u in %ums\n",
+                             seed % 60, (seed >> 6) % 60, (seed >> 12) % 64, seed >> 8, (seed >> 20) % 500);
+            if (n > size - i) n = (s32)(size - i);
+            memcpy(data + i, line, n);
+            i += n;
+            // now and then a line far wider than the view, like minified code
+            if (seed % 64 == 0) {
+                s64 wide = size - i < 20000 ? size - i : 20000;
+                for (s64 k = 0; k < wide; k++) {
+                    data[i + k] = k == wide - 1 ? '\n' : "served "[k % 7];
+                }
+                i += wide;
+            }
+        }
+        TextBuffer *text = text_buffer_init(string{ (char *)data, size });
+        text_finish_indexing(text);
+        view->buffer = buffer_init(STRZ((char *)"bench"), text, LineEnding::LF);
+        s64 line_count = get_line_count(view->buffer);
+        printf("  %4lld MB, %lld lines\n", (long long)(size >> 20), (long long)line_count);
+
+        for (s32 k = 0; k < (s32)ARRAYCOUNT(places); k++) {
+            s64 line = k == 0 ? 0 : (k == 2 ? line_count - view->lines : line_count / 2);
+            view->line_offset = line;
+            view->cursor = get_cursor_from_line(view->buffer, line);
+            // everything selected, from before the view to after it
+            view->select_active = k == 3;
+            view->select_cursor = get_cursor_from_pos(view->buffer, 0);
+            if (view->select_active) view->cursor = get_cursor_from_pos(view->buffer, buffer_length(view->buffer));
+
+            s32 frames = (s32)bench_arg(argc, argv, 0, 200);
+            s64 vertices = 0;
+            f64 start = 0.0;
+            // the first frame searches the view for matches, the rest draw what is kept
+            for (s32 frame = -1; frame < frames; frame++) {
+                if (frame == 0) start = os_seconds();
+                draw_view(&target, view, &atlas);
+                if (frame == frames - 1) {
+                    for (RenderBatch *batch = target.batches; batch; batch = batch->next) {
+                        vertices += batch->vertices.count;
+                    }
+                }
+                free_render_target(&target);
+            }
+            f64 seconds = (os_seconds() - start) / frames;
+            printf("    %-8s %8.1f us/frame  %7lld vertices\n", places[k], seconds * 1000000.0, (long long)vertices);
+        }
+        view->select_active = false;
+    }
+}
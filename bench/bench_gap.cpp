@@ -0,0 +1,53 @@
+// @note Gap buffer benchmark
+// The gap buffer on its own, whatever the file size: single byte inserts and deletes at random
+// positions, which move the gap each time, the same near one spot, and a paste typed in one byte
+// at a time, which has the gap grow over and over.
+
+internal void gap_benchmark(int argc, char **argv) {
+    s64 size = bench_arg(argc, argv, 0, 64) * 1024 * 1024;
+    s64 ops = bench_arg(argc, argv, 1, 2000);
+    s64 paste = bench_arg(argc, argv, 2, 10) * 1024 * 1024;
+    Buffer *buffer = bench_buffer(GapBackend, bench_generate_log(size, 7), size);
+    TextBuffer *text = buffer->text;
+
+    u32 seed = 1;
+    f64 start = os_seconds();
+    for (s64 k = 0; k < ops; k++) {
+        s64 pos = bench_random(&seed) % buffer_length(buffer);
+        if (k & 1) delete_range(buffer, pos, pos + 1);
+        else insert_char(buffer, pos, 'x');
+    }
+    f64 end = os_seconds();
+    printf("%lld MB: %lld random inserts and deletes %.1f ms, %.0f ops/s\n", (long long)(size / (1024 * 1024)),
+           (long long)ops, (end - start) * 1000.0, (f64)ops / (end - start));
+
+    s64 pos = buffer_length(buffer) / 2;
+    start = os_seconds();
+    for (s64 k = 0; k < ops * 100; k++) {
+        pos += (s64)(bench_random(&seed) % 64) - 32;
+        pos = clamp(pos, 0, buffer_length(buffer) - 1);
+        if (k & 1) delete_range(buffer, pos, pos + 1);
+        else insert_char(buffer, pos, 'x');
+    }
+    end = os_seconds();
+    printf("%lld MB: %lld nearby inserts and deletes %.1f ms, %.0f ops/s\n", (long long)(size / (1024 * 1024)),
+           (long long)ops * 100, (end - start) * 1000.0, (f64)(ops * 100) / (end - start));
+
+    // a fresh buffer, so the gap starts out small
+    buffer = bench_buffer(GapBackend, bench_generate_log(size, 7), size);
+    text = buffer->text;
+    pos = buffer_length(buffer) / 3;
+    s64 reallocations = 0;
+    s64 capacity = text->end;
+    start = os_seconds();
+    for (s64 k = 0; k < paste; k++) {
+        insert_char(buffer, pos++, k % 80 == 79 ? '\n' : 'p');
+        if (text->end != capacity) {
+            capacity = text->end;
+            reallocations++;
+        }
+    }
+    end = os_seconds();
+    printf("%lld MB pasted a byte at a time: %.1f ms, the gap grew %lld times\n", (long long)(paste / (1024 * 1024)),
+           (end - start) * 1000.0, (long long)reallocations);
+}
@@ -0,0 +1,44 @@
+// @note Keystroke benchmark
+// Typing in the middle of files of growing size, on each backend in turn. Each keystroke updates
+// the line index and looks up the cursor's line, and neither should cost more on a larger file.
+
+struct KeystrokeRun {
+    TextBackend backend;
+    s64 megabytes;
+    s64 keys;
+};
+
+internal void keystroke_run(void *data) {
+    KeystrokeRun *run = (KeystrokeRun *)data;
+    s64 size = run->megabytes * 1024 * 1024;
+    u8 *text = bench_generate_log(size, 7);
+    f64 start = os_seconds();
+    Buffer *buffer = bench_buffer(run->backend, text, size);
+    f64 opened = os_seconds();
+    // the first keystroke also moves the gap buffer's gap from the end to the middle
+    s64 pos = size / 2;
+    f64 first = 0;
+    for (s64 k = 0; k < run->keys; k++) {
+        edit_group++;
+        insert_char(buffer, pos++, k % 40 == 39 ? '\n' : 'x');
+        Cursor cursor = get_cursor_from_pos(buffer, pos);
+        get_line_pos(buffer, cursor.line);
+        if (k == 0) first = os_seconds();
+    }
+    f64 end = os_seconds();
+    printf("%-6s %5lld MB  load %7.1f ms  first key %7.3f ms  then %7.3f us/keystroke  %lld lines\n",
+           bench_backend_names[run->backend], (long long)run->megabytes, (opened - start) * 1000.0,
+           (first - opened) * 1000.0, (end - first) * 1e6 / (f64)(run->keys - 1), (long long)get_line_count(buffer));
+}
+
+internal void keystroke_benchmark(int argc, char **argv) {
+    s64 keys = bench_arg(argc, argv, 0, 20000);
+    if (keys < 2) keys = 2;
+    s64 sizes[] = { 1, 8, 64, 256 };
+    for (s32 b = 0; b < 3; b++) {
+        for (s32 i = 0; i < (s32)ARRAYCOUNT(sizes); i++) {
+            KeystrokeRun run = { (TextBackend)b, sizes[i], keys };
+            bench_apart(keystroke_run, &run);
+        }
+    }
+}
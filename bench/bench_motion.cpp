@@ -0,0 +1,25 @@
+// @note Motion benchmark
+// goto_file_end and then moves left one character at a time, the way holding h does, on a large
+// buffer. Each move maps a position to its line and column.
+
+internal void motion_benchmark(int argc, char **argv) {
+    s64 size = bench_arg(argc, argv, 0, 1024) * 1024 * 1024;
+    s64 moves = bench_arg(argc, argv, 1, 10000);
+    u8 *text = bench_generate_log(size, 7);
+    View *view = view_init();
+    view->lines = HEIGHT / 16;
+    view->buffer = buffer_init(STRZ((char *)"bench"), string{ (char *)text, size });
+    application->active_view = view;
+
+    f64 start = os_seconds();
+    goto_file_end(application);
+    f64 at_end = os_seconds();
+    for (s64 i = 0; i < moves; i++) {
+        move_char_left(application);
+    }
+    f64 end = os_seconds();
+    printf("%lld MB %s: goto_file_end %.3f ms, %lld move_char_left %.3f ms (%.3f us each), cursor at line %lld col %lld\n",
+           (long long)(size / (1024 * 1024)), bench_backend_names[view->buffer->text->backend], (at_end - start) * 1000.0,
+           (long long)moves, (end - at_end) * 1000.0, (end - at_end) * 1e6 / (f64)moves,
+           (long long)view->cursor.line, (long long)view->cursor.col);
+}
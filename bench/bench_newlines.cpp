@@ -0,0 +1,47 @@
+// @note Newline kernels benchmark
+// Checks every kernel the processor supports against the scalar loop over random lines, and
+// reports how fast each one counts and finds newlines.
+
+internal void newlines_benchmark(int argc, char **argv) {
+    s64 size = bench_arg(argc, argv, 0, 256) * 1024 * 1024;
+    u8 *text = (u8 *)malloc(size);
+    u32 seed = 0x2545F491;
+    for (s64 i = 0; i < size; i++) {
+        bench_random(&seed);
+        // lines of 0 to 127 bytes
+        text[i] = (seed & 127) == 0 ? '\n' : (u8)('a' + seed % 26);
+    }
+    s64 *offsets = (s64 *)malloc(4096 * sizeof(s64));
+
+    s64 expected = newline_count_scalar(text, size);
+    s64 expected_sum = 0;
+    printf("newline kernels over %lld MB, %lld newlines\n", (long long)(size >> 20), (long long)expected);
+    for (s32 k = 0; k < newline_kernels_supported(); k++) {
+        NewlineKernel *kernel = &newline_kernels[k];
+
+        f64 start = os_seconds();
+        s64 counted = kernel->count(text, size);
+        f64 count_seconds = os_seconds() - start;
+
+        start = os_seconds();
+        s64 found = 0;
+        s64 sum = 0;
+        for (s64 pos = 0; pos < size; ) {
+            s64 scanned;
+            s64 n = kernel->find(text + pos, size - pos, offsets, 4096, &scanned);
+            for (s64 i = 0; i < n; i++) sum += pos + offsets[i];
+            found += n;
+            pos += scanned;
+        }
+        f64 find_seconds = os_seconds() - start;
+        if (k == 0) expected_sum = sum;
+
+        bool ok = counted == expected && found == expected && sum == expected_sum;
+        if (!ok) bench_failed = true;
+        f64 gb = (f64)size / (1024.0 * 1024.0 * 1024.0);
+        printf("  %-6s count %6.2f GB/s  find %6.2f GB/s  %s\n", kernel->name, gb / count_seconds, gb / find_seconds,
+               ok ? "ok" : "MISMATCH");
+    }
+    free(offsets);
+    free(text);
+}
@@ -0,0 +1,41 @@
+// @note Paste benchmark
+// A 4 KB paste made three ways: a byte at a time, a byte at a time inside one edit transaction,
+// and as one insert_string. The transaction brings the line index up to date once at the commit.
+
+internal void paste_benchmark(int argc, char **argv) {
+    s64 sizes[] = { 1, 64 };
+    u8 paste[4096];
+    bench_fill(paste, sizeof(paste), 3);
+    for (s32 i = 0; i < (s32)ARRAYCOUNT(sizes); i++) {
+        s64 size = sizes[i] * 1024 * 1024;
+        u8 *text = bench_generate_log(size, 7);
+        Buffer *buffer = buffer_init(STRZ((char *)"bench"), string{ (char *)text, size });
+        s64 pos = size / 2 + 7;
+
+        edit_group++;
+        f64 start = os_seconds();
+        for (s64 k = 0; k < (s64)sizeof(paste); k++) {
+            insert_char(buffer, pos + k, paste[k]);
+        }
+        f64 chars = os_seconds() - start;
+        history_undo(&buffer->history, buffer->text);
+
+        edit_group++;
+        start = os_seconds();
+        buffer_begin_edit(buffer);
+        for (s64 k = 0; k < (s64)sizeof(paste); k++) {
+            insert_char(buffer, pos + k, paste[k]);
+        }
+        buffer_commit_edit(buffer);
+        f64 batched = os_seconds() - start;
+        history_undo(&buffer->history, buffer->text);
+
+        edit_group++;
+        start = os_seconds();
+        insert_string(buffer, pos, paste, sizeof(paste));
+        f64 bulk = os_seconds() - start;
+
+        printf("%3lld MB %-5s 4 KB paste: 4096 insert_char %.3f ms, in one transaction %.3f ms, one insert_string %.3f ms\n",
+               (long long)sizes[i], bench_backend_names[buffer->text->backend], chars * 1000.0, batched * 1000.0, bulk * 1000.0);
+    }
+}
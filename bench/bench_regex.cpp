@@ -0,0 +1,113 @@
+// @note Regex benchmark
+// tests/code.txt repeated up to the given size, searched for literals with the literal searcher
+// and with the regex engine, then for regexes of the kinds people type. Last come patterns that
+// take a backtracking engine exponential time, on inputs built to trigger it.
+
+internal void regex_run(TextSnapshot *snapshot, const char *pattern) {
+    const char *error = nullptr;
+    Regex *regex = regex_compile((u8 *)pattern, (s64)strlen(pattern), &error);
+    if (regex == nullptr) {
+        printf("%-28s bad pattern: %s\n", pattern, error);
+        bench_failed = true;
+        return;
+    }
+    s64 hits = 0;
+    f64 start = os_seconds();
+    StringMatch match;
+    for (s64 pos = 0; (match = regex_find(regex, snapshot, pos, snapshot->length)).pos >= 0; pos = search_next_start(match)) {
+        hits++;
+    }
+    f64 end = os_seconds();
+    printf("%-28s regex   %9lld hits %9.1f ms %7.0f MB/s%s%s\n", pattern, (long long)hits, (end - start) * 1000.0,
+           (f64)snapshot->length / (1024.0 * 1024.0) / (end - start),
+           regex->literal ? " (literal)" : regex->prefix ? " (prefix)" : "", regex->dfa_failed ? " (pike)" : "");
+    regex_free(regex);
+}
+
+internal bool regex_count_hit(void *data, s64 pos) {
+    (*(s64 *)data)++;
+    return true;
+}
+
+// the same needle found first match by first match, then streamed by text_find_all
+internal void regex_run_literal(TextSnapshot *snapshot, const char *needle) {
+    Searcher *searcher = searcher_init((u8 *)needle, (s64)strlen(needle));
+    s64 hits = 0;
+    f64 start = os_seconds();
+    for (s64 pos = 0; (pos = text_find(snapshot, searcher, pos, snapshot->length)) >= 0; pos += searcher->count) {
+        hits++;
+    }
+    f64 end = os_seconds();
+    printf("%-28s literal %9lld hits %9.1f ms %7.0f MB/s\n", needle, (long long)hits, (end - start) * 1000.0,
+           (f64)snapshot->length / (1024.0 * 1024.0) / (end - start));
+
+    s64 streamed = 0;
+    start = os_seconds();
+    text_find_all(snapshot, searcher, 0, snapshot->length, regex_count_hit, &streamed);
+    end = os_seconds();
+    printf("%-28s all     %9lld hits %9.1f ms %7.0f MB/s%s\n", needle, (long long)streamed, (end - start) * 1000.0,
+           (f64)snapshot->length / (1024.0 * 1024.0) / (end - start), streamed == hits ? "" : " (DIFFERS)");
+    if (streamed != hits) bench_failed = true;
+    searcher_free(searcher);
+}
+
+// '?' in the repeated unit stands for a random a or b
+internal void regex_run_pathological(const char *unit, s64 size, const char *pattern) {
+    u8 *data = (u8 *)malloc(size + 1);
+    s64 unit_count = (s64)strlen(unit);
+    u32 seed = 1;
+    for (s64 i = 0; i < size; i++) {
+        u8 c = (u8)unit[i % unit_count];
+        data[i] = c == '?' ? "ab"[bench_random(&seed) % 2] : c;
+    }
+    TextBuffer *text = bench_text(GapBackend, data, size);
+    TextSnapshot *snapshot = text_snapshot(text);
+    const char *error = nullptr;
+    Regex *regex = regex_compile((u8 *)pattern, (s64)strlen(pattern), &error);
+    f64 start = os_seconds();
+    StringMatch match = regex_find(regex, snapshot, 0, size);
+    f64 end = os_seconds();
+    printf("%-28s %5lld KB of %-4s  match at %lld %9.1f ms%s\n", pattern, (long long)(size / 1024), unit,
+           (long long)match.pos, (end - start) * 1000.0, regex->dfa_failed ? " (pike)" : "");
+    regex_free(regex);
+    text_snapshot_free(snapshot);
+}
+
+internal void regex_benchmark(int argc, char **argv) {
+    s64 size = bench_arg(argc, argv, 0, 1024) * 1024 * 1024;
+    string code = read_file(STRZ((char *)"tests/code.txt"));
+    if (code.count == 0) {
+        printf("tests/code.txt not found, run from the repository root\n");
+        bench_failed = true;
+        return;
+    }
+    u8 *data = (u8 *)malloc(size + 1);
+    for (s64 i = 0; i < size; i += code.count) {
+        memcpy(data + i, code.data, i + code.count <= size ? code.count : size - i);
+    }
+    TextBuffer *text = bench_text(PieceBackend, data, size);
+    TextSnapshot *snapshot = text_snapshot(text);
+    printf("%lld MB of tests/code.txt\n", (long long)(size / (1024 * 1024)));
+
+    const char *literals[] = { "Treetop Tree", "buffer_search", "visible(", "zqxj" };
+    for (s32 i = 0; i < (s32)ARRAYCOUNT(literals); i++) {
+        regex_run_literal(snapshot, literals[i]);
+        string quoted = regex_quote(STRZ((char *)literals[i]));
+        regex_run(snapshot, quoted.data);
+        free_string(&quoted);
+    }
+    const char *patterns[] = { "Tree[a-z]+ Tree", "int (count|rows)", "[A-Z][a-z]+ of Code", "zq[0-9]+x",
+                               "\\d{5}\\\\n", "^\\s*for \\(", "[a-q][^u-z]{13}[x-z]", "[A-Z]q[0-9]" };
+    for (s32 i = 0; i < (s32)ARRAYCOUNT(patterns); i++) {
+        regex_run(snapshot, patterns[i]);
+    }
+    text_snapshot_free(snapshot);
+
+    printf("pathological patterns\n");
+    regex_run_pathological("a", 1 << 20, "(a|aa)*c");
+    regex_run_pathological("a", 1 << 22, "(a|aa)*c");
+    regex_run_pathological("x", 1 << 20, "(x+x+)+y");
+    regex_run_pathological("x", 1 << 22, "(x+x+)+y");
+    regex_run_pathological("?", 1 << 20, "[ab]*a[ab]{20}c");
+    regex_run_pathological("?", 1 << 22, "[ab]*a[ab]{20}c");
+}
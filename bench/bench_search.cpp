@@ -0,0 +1,49 @@
+// @note Parallel search benchmark
+// Finds every match in a generated log with 1 to 16 workers, checks each count agrees with the
+// single worker's, and reports throughput and how soon the first match came back.
+
+internal void search_benchmark(int argc, char **argv) {
+    s64 size = bench_arg(argc, argv, 0, 512) * 1024 * 1024;
+    u8 *text = bench_generate_log(size, 0x2545F491);
+    string contents = { (char *)text, size };
+    TextBuffer *buffer = text_buffer_init(contents);
+
+    const char *patterns[] = { "ERROR", "served", "in [0-9]+ms\n", "worker 4[0-9] served" };
+    s32 thread_counts[] = { 1, 2, 4, 8, 16 };
+    printf("parallel search over %lld MB, %d cores\n", (long long)(size >> 20), os_processor_count());
+    for (const char *pattern : patterns) {
+        printf("  ");
+        for (const char *c = pattern; *c; c++) {
+            printf(*c == '\n' ? "\\n" : "%c", *c);
+        }
+        printf("\n");
+        s64 expected = -1;
+        s64 expected_sum = 0;
+        for (s32 threads : thread_counts) {
+            const char *error = nullptr;
+            string p = { (char *)pattern, (s64)strlen(pattern) };
+            f64 start = os_seconds();
+            ParallelSearch *search = parallel_search_start(text_snapshot(buffer), p, 0, threads, false, &error);
+            f64 first = 0;
+            s64 found = 0;
+            s64 sum = 0;
+            StringMatch match;
+            while (parallel_search_next(search, &match)) {
+                if (found == 0) first = os_seconds() - start;
+                found++;
+                sum += match.pos;
+            }
+            f64 seconds = os_seconds() - start;
+            parallel_search_free(search);
+            if (expected < 0) {
+                expected = found;
+                expected_sum = sum;
+            }
+            bool ok = found == expected && sum == expected_sum;
+            if (!ok) bench_failed = true;
+            f64 gb = (f64)size / (1024.0 * 1024.0 * 1024.0);
+            printf("    %2d threads %6.2f GB/s  first after %7.3f ms  %9lld matches  %s\n", threads, gb / seconds, first * 1000.0,
+                   (long long)found, ok ? "ok" : "MISMATCH");
+        }
+    }
+}
@@ -0,0 +1,38 @@
+// @note Spread edits benchmark
+// Single byte edits at positions spread over a large file, each followed by a lookup of the
+// edited line, on each backend in turn.
+
+struct SpreadRun {
+    TextBackend backend;
+    s64 size;
+    s64 ops;
+};
+
+internal void spread_run(void *data) {
+    SpreadRun *run = (SpreadRun *)data;
+    u8 *text = bench_generate_log(run->size, 7);
+    f64 start = os_seconds();
+    Buffer *buffer = bench_buffer(run->backend, text, run->size);
+    f64 loaded = os_seconds();
+    u32 seed = 1;
+    for (s64 k = 0; k < run->ops; k++) {
+        s64 pos = bench_random(&seed) % buffer_length(buffer);
+        edit_group++;
+        if (k & 1) delete_range(buffer, pos, pos + 1);
+        else insert_char(buffer, pos, k % 7 == 0 ? '\n' : 'x');
+        get_line_pos(buffer, get_cursor_from_pos(buffer, pos).line);
+    }
+    f64 end = os_seconds();
+    printf("%-6s load %8.1f ms  %lld spread edits %9.1f ms  %10.0f ops/s\n", bench_backend_names[run->backend],
+           (loaded - start) * 1000.0, (long long)run->ops, (end - loaded) * 1000.0, (f64)run->ops / (end - loaded));
+}
+
+internal void spread_benchmark(int argc, char **argv) {
+    s64 megabytes = bench_arg(argc, argv, 0, 500);
+    s64 ops = bench_arg(argc, argv, 1, 300);
+    printf("%lld MB of log\n", (long long)megabytes);
+    for (s32 b = 0; b < 3; b++) {
+        SpreadRun run = { (TextBackend)b, megabytes * 1024 * 1024, ops };
+        bench_apart(spread_run, &run);
+    }
+}
@@ -0,0 +1,65 @@
+// The few Win32 calls the editor core makes outside the OS layer, over POSIX, so the core builds
+// headless on Linux for the benchmarks. Only what the core uses is here.
+
+typedef void *HANDLE;
+typedef void *HWND;
+typedef unsigned long DWORD;
+typedef unsigned int GLuint;
+
+union LARGE_INTEGER {
+    long long QuadPart;
+};
+typedef LARGE_INTEGER *PLARGE_INTEGER;
+
+struct RECT {
+    long left, top, right, bottom;
+};
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define GENERIC_READ 1
+#define GENERIC_WRITE 2
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define MOVEFILE_REPLACE_EXISTING 1
+
+internal HANDLE CreateFileA(const char *file_name, int access, int, void *, int, int, void *) {
+    int fd = access == GENERIC_READ ? open(file_name, O_RDONLY) : open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return fd < 0 ? INVALID_HANDLE_VALUE : (HANDLE)(intptr_t)fd;
+}
+
+internal int GetFileSizeEx(HANDLE file, PLARGE_INTEGER size) {
+    struct stat st;
+    if (fstat((int)(intptr_t)file, &st) != 0) return 0;
+    size->QuadPart = st.st_size;
+    return 1;
+}
+
+internal int ReadFile(HANDLE file, void *buffer, DWORD count, DWORD *read_count, void *) {
+    ssize_t n = read((int)(intptr_t)file, buffer, count);
+    *read_count = n > 0 ? (DWORD)n : 0;
+    return n >= 0;
+}
+
+internal int WriteFile(HANDLE file, const void *buffer, DWORD count, DWORD *written, void *) {
+    ssize_t n = write((int)(intptr_t)file, buffer, count);
+    *written = n > 0 ? (DWORD)n : 0;
+    return n >= 0;
+}
+
+internal int CloseHandle(HANDLE file) {
+    return close((int)(intptr_t)file) == 0;
+}
+
+// rename replaces the target whatever the flags
+internal int MoveFileExA(const char *from, const char *to, int) {
+    return rename(from, to) == 0;
+}
+
+internal int DeleteFileA(const char *file_name) {
+    return unlink(file_name) == 0;
+}
+
+internal int GetClientRect(HWND, RECT *) {
+    return 0;
+}
@@ -40,6 +40,26 @@ public:
         count++;
     }
 
+    void insert(size_t index, T *elements, size_t n) {
+        assert(index <= count);
+        if (count + n > capacity) {
+            grow(n);
+        }
+        memmove(data + index + n, data + index, (count - index) * sizeof(T));
+        memcpy(data + index, elements, n * sizeof(T));
+        count += n;
+    }
+
+    void insert(size_t index, T element) {
+        insert(index, &element, 1);
+    }
+
+    void remove(size_t index, size_t n) {
+        assert(index + n <= count);
+        memmove(data + index, data + index + n, (count - index - n) * sizeof(T));
+        count -= n;
+    }
+
     T operator[](size_t index) {
         assert(index < count);
         return data[index];
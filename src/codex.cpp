@@ -1,13 +1,28 @@
 #include "codex.h"
 #include <algorithm>
 
-#define GAP_SIZE 1024
+#include "newline.cpp"
+#include "line_index.cpp"
+#include "shared_bytes.cpp"
+#include "piece_table.cpp"
+#include "rope.cpp"
+#include "text_buffer.cpp"
+#include "save.cpp"
+#include "history.cpp"
+#include "search.cpp"
+#include "regex.cpp"
+#include "search_job.cpp"
+#include "parallel_search.cpp"
+#include "match_index.cpp"
+#include "match_count.cpp"
+#include "grep.cpp"
 
 Color theme_background = rgb_to_color(0xFFFFFF);
 Color theme_foreground = rgb_to_color(0);
 Color theme_cursor = rgb_to_color(0);
 Color theme_select = rgb_to_color(0xC0C0C0);
 Color theme_line = rgb_to_color(0xFFFFCD);
+Color theme_match = rgb_to_color(0xFFD27F);
 
 Color theme_commandbuf_fg = rgb_to_color(0);
 Color theme_commandbuf_bg = rgb_to_color(0xF0F0F0);
@@ -28,9 +43,10 @@ global Array<InputEvent> input_events;
 
 global RenderTarget render_target;
 
-internal s32 get_line_length(Buffer *buffer, s64 line);
+internal s64 get_line_length(Buffer *buffer, s64 line);
+internal s64 get_line_count(Buffer *buffer);
 
-internal string string_make(char *str, int count) {
+internal string string_make(char *str, s64 count) {
     string s;
     s.data = str;
     s.count = count;
@@ -40,13 +56,13 @@ internal string string_make(char *str, int count) {
 internal string string_make(char *str) {
     string s{};
     s.data = str;
-    s.count = (int)strlen(str);
+    s.count = (s64)strlen(str);
     return s;
 }
 
 internal Array<string> split(string s) {
     Array<string> splits;
-    for (int i = 0, start = 0; i < s.count; i++) {
+    for (s64 i = 0, start = 0; i < s.count; i++) {
         // found space or end of string
         if (s[i] == ' ') {
             string new_s = string_make(s.data + start, i - start);
@@ -141,7 +157,7 @@ internal string copy(string str) {
     return result;
 }
 
-internal void reserve(string *s, int count) {
+internal void reserve(string *s, s64 count) {
     assert(count > 0);
     s->data = (char *)malloc(count + 1);
     s->count = count;
@@ -167,57 +183,31 @@ internal Color rgb_to_color(u32 rgb) {
     return result;
 }
 
-inline internal s64 buffer_gap_delta(Buffer *buffer) {
-    s64 result = buffer->text->gap_end - buffer->text->gap_start;
-    return result;
-}
-
 inline internal s64 buffer_length(Buffer *buffer) {
-    s64 result = buffer->text->end - buffer_gap_delta(buffer);
-    return result;
-}
-
-inline internal s64 raw_buffer_pos(Buffer *buffer, s64 pos) {
-    s64 result = pos;
-    if (pos >= buffer->text->gap_start) {
-        result += buffer_gap_delta(buffer);
-    }
+    s64 result = text_length(buffer->text);
     return result;
 }
 
 inline internal u8 char_from_pos(Buffer *buffer, s64 pos) {
-    if (pos >= buffer_length(buffer)) {
-        return 0;
-    }
-    s64 raw_pos = raw_buffer_pos(buffer, pos);
-    return buffer->text->contents[raw_pos];
-}
-
-inline internal u8 *string_from_pos(Buffer *buffer, s64 pos) {
-    u8 *result = buffer->text->contents;
-    s64 raw_pos = raw_buffer_pos(buffer, pos);
-    result = buffer->text->contents + raw_pos;
-    return result;
+    return text_char(buffer->text, pos);
 }
 
 internal Cursor get_cursor_from_pos(Buffer *buffer, s64 pos) {
     Cursor result{};
     result.pos = pos;
-    for (s64 p = 0; p < pos; p++) {
-        result.col++;
-        if (char_from_pos(buffer, p) == '\n') {
-            result.line++;
-            result.col = 0;
-        }
+    if (pos > 0) {
+        LineLocation loc = text_locate_pos(buffer->text, pos);
+        result.line = loc.line;
+        result.col = pos - loc.start;
     }
     return result;
 }
 
-internal Cursor get_cursor_from_line(Buffer *buffer, s32 line) {
-    assert(line <= buffer->text->line_bases.count - 1);
+internal Cursor get_cursor_from_line(Buffer *buffer, s64 line) {
+    assert(line <= get_line_count(buffer) - 1);
     Cursor result = {};
     result.line = line;
-    result.pos = buffer->text->line_bases[line];
+    result.pos = text_locate_line(buffer->text, line).start;
     result.col = 0;
     return result;
 }
@@ -226,11 +216,11 @@ internal u8 view_char(View *view) {
     return char_from_pos(view->buffer, view->cursor.pos);
 }
 
-internal string get_line_string(Buffer *buffer, s32 line) {
-    int len = get_line_length(buffer, line);
+internal string get_line_string(Buffer *buffer, s64 line) {
+    s64 len = get_line_length(buffer, line);
     char *buf = (char *)malloc(len + 1);
     buf[len] = 0;
-    for (size_t i = 0, pos = get_cursor_from_line(buffer, line).pos; i < len; i++, pos++) {
+    for (s64 i = 0, pos = get_cursor_from_line(buffer, line).pos; i < len; i++, pos++) {
         u8 c = char_from_pos(buffer, pos);
         buf[i] = (char)c;
     }
@@ -239,7 +229,7 @@ internal string get_line_string(Buffer *buffer, s32 line) {
 
 internal f32 get_string_width(string s, FontAtlas *atlas) {
     f32 width = 0.0f;
-    for (int i = 0; i < s.count; i++) {
+    for (s64 i = 0; i < s.count; i++) {
         char c = s.data[i];
         FontGlyph glyph = atlas->glyphs[c];
         width += glyph.ax;
@@ -250,10 +240,7 @@ internal f32 get_string_width(string s, FontAtlas *atlas) {
 internal void write_file(string file_name, string file_data) {
     HANDLE file_handle = CreateFileA((char *)file_name.data, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     if (file_handle != INVALID_HANDLE_VALUE) {
-        DWORD bytes_written = 0;
-        if (WriteFile(file_handle, file_data.data, (DWORD)file_data.count, &bytes_written, NULL) && ((int)bytes_written == file_data.count)) {
-
-        } else {
+        if (!write_file_data(file_handle, (u8 *)file_data.data, file_data.count)) {
             // TODO: error handling
             printf("WriteFile: Error writing file: %s\n", file_name.data);
         }
@@ -269,18 +256,22 @@ internal string read_file(string file_name) {
     string result{};
     HANDLE file_handle = CreateFileA(file_name.data, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
     if (file_handle != INVALID_HANDLE_VALUE) {
-        u64 bytes_to_read;
-        if (GetFileSizeEx(file_handle, (PLARGE_INTEGER)&bytes_to_read)) {
-            assert(bytes_to_read <= UINT32_MAX);
-            result.data = (char *)malloc(bytes_to_read + 1);
-            DWORD bytes_read;
-            if (ReadFile(file_handle, result.data, (DWORD)bytes_to_read, &bytes_read, NULL) && (DWORD)bytes_to_read ==  bytes_read) {
-                result.count = (u64)bytes_read;
-                result.data[result.count] = '\0';
-            } else {
-                // TODO: error handling
-                printf("ReadFile: error reading file, %s!\n", file_name.data);
+        LARGE_INTEGER bytes_to_read;
+        if (GetFileSizeEx(file_handle, &bytes_to_read)) {
+            result.data = (char *)malloc(bytes_to_read.QuadPart + 1);
+            // ReadFile takes a 32-bit count
+            while (result.count < bytes_to_read.QuadPart) {
+                s64 chunk = bytes_to_read.QuadPart - result.count;
+                if (chunk > (1 << 30)) chunk = 1 << 30;
+                DWORD bytes_read = 0;
+                if (!ReadFile(file_handle, result.data + result.count, (DWORD)chunk, &bytes_read, NULL) || bytes_read == 0) {
+                    // TODO: error handling
+                    printf("ReadFile: error reading file, %s!\n", file_name.data);
+                    break;
+                }
+                result.count += bytes_read;
             }
+            result.data[result.count] = '\0';
        } else {
             // TODO: error handling
             printf("GetFileSize: error getting size of file: %s!\n", file_name.data);
@@ -293,204 +284,626 @@ internal string read_file(string file_name) {
     return result;
 }
 
-internal string lf_to_crlf(string str) {
-    u8 *buf = (u8 *)calloc(str.count * 2, sizeof(u8));
-    u8 *ptr = buf;
-    u8 *mem = (u8 *)str.data;
-    int len = 0;
-    while (mem < (u8 *)str.data + str.count) {
-        if (*mem == '\n') {
-            *ptr++ = '\r';
-            *ptr++ = '\n';
-            len++;
-        } else {
-            *ptr++ = *mem;
-        }
-        mem++;
-        len++;
-    }
+internal string buffer_text(Buffer *buffer) {
+    s64 n = buffer_length(buffer);
+    u8 *ptr = (u8 *)malloc(n + 1);
+    text_read(buffer->text, 0, n, ptr);
+    ptr[n] = '\0';
 
-    buf = (u8 *)realloc(buf, len+1);
-    buf[len] = 0;
+    string contents = {(char*)ptr, n};
+    return contents;
+}
+
+internal void buffer_clear(Buffer *buffer) {
+    history_clear(&buffer->history);
+    text_clear(buffer->text);
+}
 
-    string result = {(char *)buf, len};
+internal s64 get_line_count(Buffer *buffer) {
+    s64 result = text_line_count(buffer->text);
     return result;
 }
 
-internal string crlf_to_lf(string str) {
-    u8 *buf = (u8 *)calloc(str.count, sizeof(u8));
-    u8 *memory = (u8 *)str.data;
-    u8 *ptr = buf;
-    size_t len = 0;
-    while (memory < (u8 *)str.data + str.count) {
-        if (*memory != '\r') {
-            *ptr++ = *memory;
-            len++;
-        }
-        memory++;
-    }
-    buf = (u8 *)realloc(buf, len + 1);
-    buf[len] = 0;
+// Edits between buffer_begin_edit and buffer_commit_edit bring the line index up to date once at
+// the commit, so commands look up lines and cursors only after committing.
+internal void buffer_begin_edit(Buffer *buffer) {
+    text_begin_batch(buffer->text);
+}
 
-    string result;
-    result.data = (char *)buf;
-    result.count = (int)len;
+internal void buffer_commit_edit(Buffer *buffer) {
+    text_end_batch(buffer->text);
+}
+
+internal void insert_string(Buffer *buffer, s64 position, u8 *data, s64 count) {
+    if (count <= 0) return;
+    history_insert(&buffer->history, position, data, count);
+    text_insert(buffer->text, position, data, count);
+}
+
+internal void insert_char(Buffer *buffer, s64 position, u8 c) {
+    insert_string(buffer, position, &c, 1);
+}
+
+internal string copy_range(Buffer *buffer, s64 start, s64 end) {
+    string result{};
+    result.count = end - start;
+    result.data = (char *)malloc(result.count + 1);
+    text_read(buffer->text, start, end, (u8 *)result.data);
+    result.data[result.count] = '\0';
     return result;
 }
 
-internal void update_line_bases(Buffer *buffer) {
-    buffer->text->line_bases.clear();
+internal void delete_range(Buffer *buffer, s64 start, s64 end) {
+    if (end > buffer_length(buffer)) end = buffer_length(buffer);
+    if (start >= end) return;
+    history_delete(&buffer->history, buffer->text, start, end);
+    text_delete(buffer->text, start, end);
+}
 
-    buffer->text->line_bases.push(0);
-    for (s64 i = 0; i < buffer_length(buffer); i++) {
-        if (char_from_pos(buffer, i) == '\n') {
-            buffer->text->line_bases.push(i + 1);
-        }
-    }
-    buffer->text->line_bases.push(buffer_length(buffer) + 1);
+internal void delete_single(Buffer *buffer, s64 pos) {
+    delete_range(buffer, pos, pos + 1);
 }
 
-internal void buffer_clear(Buffer *buffer) {
-    buffer->text->gap_start = 0;
-    buffer->text->gap_end = buffer->text->end;
-    update_line_bases(buffer);
+internal s64 get_line_length(Buffer *buffer, s64 line) {
+    s64 result = text_locate_line(buffer->text, line).length;
+    return result;
 }
 
-internal string buffer_text(Buffer *buffer) {
-    s64 n = buffer_length(buffer);
-    u8 *ptr = (u8 *)malloc(n + 1);
-    memcpy(ptr,
-        buffer->text->contents, buffer->text->gap_start);
-    memcpy(ptr + buffer->text->gap_start,
-        buffer->text->contents + buffer->text->gap_end,
-        buffer->text->end - buffer->text->gap_end);
-    ptr[n] = '\0';
+internal s64 get_line_pos(Buffer *buffer, s64 line) {
+    assert(line <= get_line_count(buffer) - 1);
+    s64 result = text_locate_line(buffer->text, line).start;
+    return result;
+}
 
-    string contents = {(char*)ptr, (int)n};
-    return contents;
+// where the line's text ends, before its \n or \r\n
+internal s64 get_line_end_pos(Buffer *buffer, s64 line) {
+    s64 begin = get_line_pos(buffer, line);
+    s64 end = begin + get_line_length(buffer, line) - 1;
+    if (end > begin && char_from_pos(buffer, end) == '\n' && char_from_pos(buffer, end - 1) == '\r') end--;
+    return end;
 }
 
-internal void buffer_gap_grow(Buffer *buffer) {
-    assert(buffer->text->gap_start == buffer->text->gap_end);
+// Typed newlines match the file's when it is kept with its bytes untouched, otherwise the text
+// holds LF and CRLF is only written out on save
+internal string buffer_newline(Buffer *buffer) {
+    if (buffer->raw_line_endings && buffer->line_ending == LineEnding::CRLF) return CONSTZ("\r\n");
+    return CONSTZ("\n");
+}
 
-    u8 *temp = (u8 *)calloc(buffer->text->end + GAP_SIZE + 1, sizeof(u8));
-    temp[buffer->text->end + GAP_SIZE] = '\0';
+// @note Multiple cursors
+// An edit at every cursor is one sorted sweep over the buffer inside a single transaction, so
+// the line index catches up once however many cursors there are. History keeps the whole sweep
+// as one Replacement, one undo record per keystroke. A single cursor edits like any other command,
+// so typing at it extends one record.
 
-    memcpy(temp,
-        buffer->text->contents,
-        buffer->text->gap_start);
-    memcpy(temp + buffer->text->gap_start + GAP_SIZE,
-        buffer->text->contents + buffer->text->gap_end,
-        buffer->text->end - buffer->text->gap_end);
+// edits sorted by start and apart from each other, positions are in the text before any of them
+internal void buffer_apply_edits(Buffer *buffer, CursorEdit *edits, s64 count) {
+    if (count == 1) {
+        CursorEdit edit = edits[0];
+        delete_range(buffer, edit.start, edit.end);
+        insert_string(buffer, edit.start, edit.data, edit.count);
+        return;
+    }
+    s64 changed = 0;
+    for (s64 i = 0; i < count; i++) {
+        if (edits[i].end > edits[i].start || edits[i].count > 0) changed++;
+    }
+    if (changed == 0) return;
+    history_replace(&buffer->history, buffer->text, edits, count);
+    TextBuffer *text = buffer->text;
+    buffer_begin_edit(buffer);
+    if (text_prefers_descending(text, edits[0].start, edits[count - 1].end)) {
+        // edits after the one being made have not moved it
+        for (s64 i = count - 1; i >= 0; i--) {
+            CursorEdit edit = edits[i];
+            if (edit.end > edit.start) text_delete(text, edit.start, edit.end);
+            if (edit.count > 0) text_insert(text, edit.start, edit.data, edit.count);
+        }
+    } else {
+        s64 shift = 0;
+        for (s64 i = 0; i < count; i++) {
+            CursorEdit edit = edits[i];
+            if (edit.end > edit.start) text_delete(text, edit.start + shift, edit.end + shift);
+            if (edit.count > 0) text_insert(text, edit.start + shift, edit.data, edit.count);
+            shift += edit.count - (edit.end - edit.start);
+        }
+    }
+    buffer_commit_edit(buffer);
+}
 
-    free(buffer->text->contents);
-    buffer->text->contents = temp;
-    buffer->text->gap_end += GAP_SIZE;
-    buffer->text->end += GAP_SIZE;
+// where each edit's text ends once all of them are applied
+internal void edits_new_ends(CursorEdit *edits, s64 count, s64 *ends) {
+    s64 shift = 0;
+    for (s64 i = 0; i < count; i++) {
+        ends[i] = edits[i].start + shift + edits[i].count;
+        shift += edits[i].count - (edits[i].end - edits[i].start);
+    }
 }
 
-internal void gap_shift(Buffer *buffer, s64 new_gap) {
-    u8 *temp = (u8 *)malloc((buffer->text->end + 1) * sizeof(u8));
-    memset(temp, '-', buffer->text->end);
-    temp[buffer->text->end] = '\0';
+// every cursor of the view sorted by position, *primary is the index of the view's own cursor
+internal Array<Selection> view_all_selections(View *view, s64 *primary) {
+    Array<Selection> all{};
+    all.reserve(view->selections.count + 1);
+    s64 lo = 0;
+    s64 hi = (s64)view->selections.count;
+    while (lo < hi) {
+        s64 mid = (lo + hi) / 2;
+        if (view->selections.data[mid].cursor.pos < view->cursor.pos) lo = mid + 1;
+        else hi = mid;
+    }
+    memcpy(all.data, view->selections.data, lo * sizeof(Selection));
+    all.data[lo] = {view->cursor, view->select_cursor};
+    memcpy(all.data + lo + 1, view->selections.data + lo, (view->selections.count - lo) * sizeof(Selection));
+    all.count = view->selections.count + 1;
+    *primary = lo;
+    return all;
+}
+
+// takes sorted cursors back, cursors that ended up at the same spot become one
+internal void view_set_selections(View *view, Array<Selection> all, s64 primary) {
+    view->selections.count = 0;
+    for (s64 i = 0; i < (s64)all.count; i++) {
+        Selection selection = all.data[i];
+        bool duplicate = i > 0 && selection.cursor.pos == all.data[i - 1].cursor.pos;
+        if (i == primary) {
+            view->cursor = selection.cursor;
+            view->select_cursor = selection.select_cursor;
+            if (duplicate) view->selections.count--;
+        } else if (!duplicate && !(i == primary + 1 && selection.cursor.pos == view->cursor.pos)) {
+            view->selections.push(selection);
+        }
+    }
+}
 
-    s64 gap_delta = buffer_gap_delta(buffer);
-    s64 old_gap_start = buffer->text->gap_start;
-    s64 old_gap_end = buffer->text->gap_end;
+// replaces the before bytes ahead of every cursor with data, the cursors end up after it
+internal void view_edit_cursors(View *view, s64 before, u8 *data, s64 count) {
+    Buffer *buffer = view->buffer;
+    s64 primary;
+    Array<Selection> all = view_all_selections(view, &primary);
+    s64 n = (s64)all.count;
+    CursorEdit *edits = (CursorEdit *)malloc(n * sizeof(CursorEdit));
+    s64 prev_end = 0;
+    for (s64 i = 0; i < n; i++) {
+        s64 pos = all.data[i].cursor.pos;
+        s64 start = pos - before > prev_end ? pos - before : prev_end;
+        edits[i] = {start, pos > start ? pos : start, data, count};
+        prev_end = edits[i].end;
+    }
+    buffer_apply_edits(buffer, edits, n);
 
-    if (new_gap > old_gap_start) {
-        memcpy(temp, buffer->text->contents, old_gap_start); // copy section before old gap
-        memcpy(temp + old_gap_start, buffer->text->contents + old_gap_end, new_gap - old_gap_start); //?
-        memcpy(temp + new_gap + gap_delta, buffer->text->contents + old_gap_end + new_gap - old_gap_start, buffer->text->end - (new_gap + gap_delta));
+    s64 *ends = (s64 *)malloc(n * sizeof(s64));
+    edits_new_ends(edits, n, ends);
+    for (s64 i = 0; i < n; i++) {
+        all.data[i].cursor = get_cursor_from_pos(buffer, ends[i]);
+        all.data[i].select_cursor = all.data[i].cursor;
+    }
+    view_set_selections(view, all, primary);
+    free(ends);
+    free(edits);
+    all.clear();
+}
+
+internal Cursor cursor_move_char(Buffer *buffer, Cursor cursor, s64 delta) {
+    s64 pos = clamp(cursor.pos + delta, 0, buffer_length(buffer));
+    return get_cursor_from_pos(buffer, pos);
+}
+
+internal Cursor cursor_move_line(Buffer *buffer, Cursor cursor, s64 delta) {
+    s64 line = cursor.line + delta;
+    if (line < 0 || line >= get_line_count(buffer)) return cursor;
+    cursor.line = line;
+    cursor.col = clamp(cursor.col, 0, get_line_length(buffer, line) - 1);
+    cursor.pos = get_line_pos(buffer, line) + cursor.col;
+    return cursor;
+}
+
+// moves never reorder cursors, but can bring them together
+internal void view_merge_selections(View *view) {
+    s64 kept = 0;
+    for (s64 i = 0; i < (s64)view->selections.count; i++) {
+        Selection selection = view->selections.data[i];
+        if (selection.cursor.pos == view->cursor.pos) continue;
+        if (kept > 0 && view->selections.data[kept - 1].cursor.pos == selection.cursor.pos) continue;
+        view->selections.data[kept++] = selection;
+    }
+    view->selections.count = kept;
+}
+
+// Saves run on a worker against a snapshot of the text, so editing carries on meanwhile. A save
+// asked for while one is running waits for it, and further asks only replace the waiting one.
+internal void buffer_save(Buffer *buffer, string file_name) {
+    if (buffer->save) {
+        free(buffer->save->next_file_name.data);
+        buffer->save->next_file_name = copy(file_name);
+        return;
+    }
+    char suffix[] = ".save";
+    bool convert = buffer->line_ending == LineEnding::CRLF && !buffer->raw_line_endings;
+    TextBuffer *text = buffer->text;
+    bool replaces_map = text_mapped(text) && strcmp(file_name.data, buffer->file_name.data) == 0;
+    buffer->save = save_start(text_snapshot(text), copy(file_name), join(file_name, STRZ(suffix)), convert, replaces_map);
+}
+
+// A mapped file cannot be replaced, so it is moved aside first. A text unchanged since the save
+// lets go of its mapping and maps the saved file instead, and removing the old file runs on the
+// worker. A text edited since still reads from the old file, which goes once nothing maps it.
+internal void buffer_replace_map(Buffer *buffer, SaveJob *job) {
+    TextBuffer *text = buffer->text;
+    bool unchanged = text->version == job->snapshot->version;
+    // the snapshot shares the mapping too
+    text_snapshot_release(job->snapshot);
+    if (unchanged) {
+        text_unmap(text);
+    }
+
+    char suffix[] = ".old";
+    job->old_name = join(job->file_name, STRZ(suffix));
+    if (MoveFileExA(job->file_name.data, job->old_name.data, MOVEFILE_REPLACE_EXISTING)) {
+        job->replaced = MoveFileExA(job->temp_name.data, job->file_name.data, 0) != 0;
+        if (!job->replaced) {
+            MoveFileExA(job->old_name.data, job->file_name.data, 0);
+            free_string(&job->old_name);
+        }
     } else {
-        memcpy(temp, buffer->text->contents, new_gap);
-        memcpy(temp + new_gap + gap_delta, buffer->text->contents + new_gap, old_gap_start - new_gap);
-        memcpy(temp + new_gap + gap_delta + (old_gap_start - new_gap), buffer->text->contents + old_gap_end, buffer->text->end - old_gap_end);
+        free_string(&job->old_name);
+        job->replaced = MoveFileExA(job->temp_name.data, job->file_name.data, MOVEFILE_REPLACE_EXISTING) != 0;
+    }
+    if (!job->replaced) {
+        DeleteFileA(job->temp_name.data);
     }
 
-    memcpy(buffer->text->contents, temp, buffer->text->end);
-    buffer->text->gap_start = new_gap;
-    buffer->text->gap_end = new_gap + gap_delta;
+    if (unchanged) {
+        FileMap map;
+        if (os_map_file(job->file_name.data, &map)) {
+            text_remap(text, map, job->replaced);
+        } else {
+            // TODO: error handling
+            printf("Error mapping file again after saving: %s\n", job->file_name.data);
+        }
+    } else if (job->old_name.data && text_mapped(text)) {
+        text_map_moved(text, job->old_name);
+        job->old_name = {};
+    }
+}
 
-    free(temp);
+internal void buffer_finish_save(Buffer *buffer) {
+    SaveJob *job = buffer->save;
+    os_thread_join(job->thread);
+    if (!job->removing_old) {
+        if (job->ok && job->replaces_map) {
+            buffer_replace_map(buffer, job);
+        }
+        if (job->replaced) {
+            f64 seconds = os_seconds() - job->start;
+            printf("Wrote %lld bytes to %s in %.3fs (%.1f MB/s)\n", (long long)job->written, job->file_name.data, seconds, (f64)job->written / (1024.0 * 1024.0) / seconds);
+            buffer->saved_at = os_seconds();
+        } else {
+            // TODO: error handling
+            printf("Error saving file: %s\n", job->file_name.data);
+        }
+        if (job->old_name.data) {
+            save_remove_old(job);
+            return;
+        }
+    }
+    buffer->save = nullptr;
+
+    // nothing to do when the waiting save would write the same text to the same file
+    bool unchanged = buffer->text->version == job->snapshot->version;
+    string next = job->next_file_name;
+    job->next_file_name = {};
+    if (next.data && (!job->replaced || !unchanged || strcmp(next.data, job->file_name.data) != 0)) {
+        buffer_save(buffer, next);
+    }
+    free(next.data);
+    save_free(job);
 }
 
-internal void buffer_ensure_gap(Buffer *buffer) {
-    if (buffer_gap_delta(buffer) <= 0) {
-        buffer_gap_grow(buffer);
+// finishes saves whose worker is done, or waits for all of them
+internal void update_saves(Application *app, bool wait) {
+    for (Buffer *buffer = app->buffer_list; buffer; buffer = buffer->next) {
+        while (buffer->save && (wait || save_done(buffer->save))) {
+            buffer_finish_save(buffer);
+        }
     }
 }
 
-internal int get_line_count(Buffer *buffer) {
-    int result = 1;
-    // s64 len = buffer_length(text);
-    // for (s64 p = 0; p < len; p++) {
-    //     if (char_from_pos(text, p) == '\n') result++;
-    // }
-    result = (int)buffer->text->line_bases.count - 1;
-    return result;
+// @note Highlighting
+// A pattern that does not parse, likely still being typed, highlights nothing.
+
+internal void highlight_set(Application *app, string pattern) {
+    Highlight *highlight = &app->highlight;
+    if (pattern.count == highlight->pattern.count && (pattern.count == 0 || memcmp(pattern.data, highlight->pattern.data, pattern.count) == 0)) return;
+    if (highlight->regex) regex_free(highlight->regex);
+    highlight->regex = nullptr;
+    free_string(&highlight->pattern);
+    highlight->id++;
+    if (pattern.count == 0) return;
+    highlight->pattern = join(pattern, CONSTZ(""));
+    const char *error = nullptr;
+    highlight->regex = regex_compile((u8 *)pattern.data, pattern.count, &error);
+}
+
+// Adds the highlighted matches overlapping [start, end) to out. Only what has not been searched
+// since the last edit nearby is searched, so this costs what the range does and not the buffer.
+internal void buffer_highlights(Application *app, Buffer *buffer, s64 start, s64 end, Array<StringMatch> *out) {
+    Highlight *highlight = &app->highlight;
+    if (highlight->regex == nullptr) return;
+    MatchIndex *index = &buffer->text->matches;
+    if (index->pattern != highlight->id) {
+        s64 reach = highlight->regex->max_length >= 0 ? highlight->regex->max_length : MATCH_INDEX_REACH;
+        match_index_reset(index, highlight->id, reach, buffer_length(buffer));
+    }
+    match_index_query(index, highlight->regex, buffer->text, start, end, out);
 }
 
-internal void insert_char(Buffer *buffer, s64 position, u8 c) {
-    buffer_ensure_gap(buffer);
+// @note Match count
+// The file bar of the view searched in shows where the cursor is among the highlighted matches.
+// The count runs on a worker when there is much to count and on the main thread when only a few
+// blocks around an edit need it, so it never holds up a frame for long.
 
-    if (position != buffer->text->gap_start) {
-        gap_shift(buffer, position);
+// the view whose buffer's matches are counted, the one searched in while the command view is up
+internal View *match_count_view(Application *app) {
+    View *view = app->command_mode ? app->incremental_search.view : app->active_view;
+    return view && !view->is_commandbuf ? view : nullptr;
+}
+
+internal void update_match_count(Application *app) {
+    View *view = match_count_view(app);
+    Buffer *buffer = view ? view->buffer : nullptr;
+    Highlight *highlight = &app->highlight;
+    MatchCountJob *job = app->match_count;
+    if (job && (job->buffer != buffer || job->pattern != highlight->id)) {
+        match_count_free(job);
+        app->match_count = job = nullptr;
     }
+    if (buffer == nullptr || highlight->regex == nullptr) return;
 
-    buffer->text->contents[position] = c;
-    buffer->text->gap_start++;
+    MatchCount *counts = &buffer->text->counts;
+    if (counts->pattern != highlight->id) {
+        s64 reach = highlight->regex->max_length >= 0 ? highlight->regex->max_length : MATCH_INDEX_REACH;
+        match_count_reset(counts, highlight->id, reach, buffer_length(buffer));
+    }
+    if (job) {
+        if (!match_count_poll(counts, job)) return;
+        match_count_free(job);
+        app->match_count = nullptr;
+    }
 
-    update_line_bases(buffer);
+    Array<CountTask> tasks{};
+    s64 bytes = match_count_tasks(counts, &tasks);
+    if (tasks.empty()) return;
+    TextSnapshot *snapshot = text_snapshot(buffer->text);
+    if (bytes > MATCH_COUNT_INLINE) {
+        app->match_count = match_count_start(buffer, snapshot, highlight->pattern, highlight->id, tasks);
+        return;
+    }
+    for (s64 i = 0; i < (s64)tasks.count; i++) {
+        match_count_follow(tasks.data, i);
+        match_count_task(highlight->regex, snapshot, &tasks.data[i]);
+    }
+    s64 hint = 0;
+    for (CountTask &task : tasks) {
+        match_count_take(counts, &task, snapshot->version, &hint);
+    }
+    // freed before the next edit, so the gap buffer gets its block back without a copy
+    text_snapshot_free(snapshot);
+    tasks.clear();
+}
+
+// n with a comma between every three digits
+internal void format_count(char *out, s64 size, s64 n) {
+    char digits[32];
+    s32 count = snprintf(digits, sizeof(digits), "%lld", (long long)n);
+    s64 at = 0;
+    for (s32 i = 0; i < count && at < size - 1; i++) {
+        if (i > 0 && (count - i) % 3 == 0) {
+            out[at++] = ',';
+            if (at == size - 1) break;
+        }
+        out[at++] = digits[i];
+    }
+    out[at] = '\0';
+}
+
+// "match 37 of 12,408" when the cursor is on a match, "12,408 matches" when it is not and
+// "12,000+ so far" while the first count is still running
+internal void match_status(Application *app, View *view, StringBuilder *builder) {
+    Highlight *highlight = &app->highlight;
+    if (highlight->regex == nullptr || view != match_count_view(app)) return;
+    MatchCount *counts = &view->buffer->text->counts;
+    if (counts->pattern != highlight->id) return;
+
+    s64 total = 0;
+    bool partial = false;
+    for (CountBlock &block : counts->blocks) {
+        total += block.count;
+        if (!block.counted) partial = true;
+    }
+    char number[32];
+    format_count(number, sizeof(number), total);
+    char status[96];
+    if (partial) {
+        snprintf(status, sizeof(status), "  %s+ so far", number);
+    } else {
+        match_count_locate(counts, highlight->regex, view->buffer->text, view->cursor.pos);
+        if (counts->at_match) {
+            char ordinal[32];
+            format_count(ordinal, sizeof(ordinal), counts->before + 1);
+            snprintf(status, sizeof(status), "  match %s of %s", ordinal, number);
+        } else {
+            snprintf(status, sizeof(status), total == 1 ? "  %s match" : "  %s matches", number);
+        }
+    }
+    append(builder, string_make(status));
 }
 
-internal string copy_range(Buffer *buffer, s64 start, s64 end) {
-    string result{};
-    result.count = (int)(end - start);
-    result.data = (char *)malloc(result.count + 1);
-    u8 *ptr = buffer->text->contents;
-    for (s64 i = 0, pos = start; pos < end; pos++, i++) {
-        u8 *str = ptr + raw_buffer_pos(buffer, pos);
-        result.data[i] = *str;
+// @note Incremental search
+// Typing "search <pattern>" in the command view looks for the pattern after every keystroke and
+// moves the view it was opened from to the nearest hit. Each keystroke cancels the search still
+// running for the one before, so the frame never waits on a scan. A plain string that grows can
+// only match where the shorter one did, so its search picks up at the last hit instead of the
+// origin, and a string that had no hit still has none.
+
+internal void incremental_search_jump(IncrementalSearch *search, StringMatch match) {
+    View *view = search->view;
+    if (match.pos < 0) {
+        view->cursor = search->origin;
+        view->line_offset = search->origin_line_offset;
+        return;
+    }
+    view->cursor = get_cursor_from_pos(view->buffer, match.pos);
+    if (view->cursor.line < view->line_offset || view->cursor.line >= view->line_offset + view->lines) {
+        view->line_offset = view->cursor.line - view->lines / 2 > 0 ? view->cursor.line - view->lines / 2 : 0;
     }
-    result.data[result.count] = '\0';
-    return result;
 }
 
-internal void delete_range(Buffer *buffer, s64 start, s64 end) {
-    if (buffer->text->gap_start != end) {
-        gap_shift(buffer, end);
-    }
-    size_t str_index = 0;
-    u8 *str = string_from_pos(buffer, start);
-    for (s64 pos = start; pos < end; pos++) {
-        str[str_index++] = 0;
+internal void incremental_search_push_step(IncrementalSearch *search, Searcher *literal, StringMatch match) {
+    SearchStep step{};
+    step.count = search->pattern.count;
+    step.match = match;
+    if (literal) {
+        step.literal = string_make((char *)malloc(literal->count), literal->count);
+        memcpy(step.literal.data, literal->needle, literal->count);
     }
-    buffer->text->gap_start = start;
+    search->steps.push(step);
+}
 
-    update_line_bases(buffer);
+internal void incremental_search_retire(IncrementalSearch *search) {
+    if (search->job == nullptr) return;
+    search_job_cancel(search->job);
+    search->job->next = search->retired;
+    search->retired = search->job;
+    search->job = nullptr;
 }
 
-internal void delete_single(Buffer *buffer, s64 pos) {
-    delete_range(buffer, pos, pos + 1);
+internal void incremental_search_pop_steps(IncrementalSearch *search, s64 count) {
+    while (search->steps.count > 0 && search->steps.data[search->steps.count - 1].count > count) {
+        free_string(&search->steps.data[search->steps.count - 1].literal);
+        search->steps.count--;
+    }
 }
 
-internal s32 get_line_length(Buffer *buffer, s64 line) {
-    s32 result = 0;
-    result = (s32)(buffer->text->line_bases[line + 1] - buffer->text->line_bases[line]); // newline??
-    return result;
+internal void incremental_search_begin(Application *app, View *view) {
+    IncrementalSearch *search = &app->incremental_search;
+    search->view = view;
+    search->origin = view->cursor;
+    search->origin_line_offset = view->line_offset;
+    search->command_version = app->command_view->buffer->text->version;
+    search->highlight_before = app->highlight.pattern.count > 0 ? copy(app->highlight.pattern) : string{};
+}
+
+// keep leaves the view at the hit for the whole pattern if there is one yet, otherwise it goes
+// back to where the search started
+internal void incremental_search_end(Application *app, bool keep) {
+    IncrementalSearch *search = &app->incremental_search;
+    if (search->view == nullptr) return;
+    SearchStep *last = search->steps.count > 0 ? &search->steps.data[search->steps.count - 1] : nullptr;
+    if (!keep || search->pattern.count == 0 || last == nullptr || last->count != search->pattern.count) {
+        StringMatch none{};
+        none.pos = -1;
+        incremental_search_jump(search, none);
+    }
+    if (!keep || search->pattern.count == 0) highlight_set(app, search->highlight_before);
+    free_string(&search->highlight_before);
+    incremental_search_retire(search);
+    incremental_search_pop_steps(search, 0);
+    search->steps.clear();
+    free_string(&search->pattern);
+    search->view = nullptr;
+}
+
+internal void incremental_search_set_pattern(IncrementalSearch *search, string pattern) {
+    bool same = pattern.count == search->pattern.count && (pattern.count == 0 || memcmp(pattern.data, search->pattern.data, pattern.count) == 0);
+    if (same && search->job) return;
+    incremental_search_retire(search);
+    s64 common = 0;
+    while (common < search->pattern.count && common < pattern.count && search->pattern.data[common] == pattern.data[common]) {
+        common++;
+    }
+    incremental_search_pop_steps(search, common);
+    free_string(&search->pattern);
+    search->pattern.data = (char *)malloc(pattern.count + 1);
+    memcpy(search->pattern.data, pattern.data, pattern.count);
+    search->pattern.data[pattern.count] = '\0';
+    search->pattern.count = pattern.count;
+
+    StringMatch none{};
+    none.pos = -1;
+    SearchStep *last = search->steps.count > 0 ? &search->steps.data[search->steps.count - 1] : nullptr;
+    if (pattern.count == 0) {
+        incremental_search_jump(search, none);
+        return;
+    }
+    if (last && last->count == pattern.count) {
+        incremental_search_jump(search, last->match);
+        return;
+    }
+
+    const char *error = nullptr;
+    Regex *regex = regex_compile((u8 *)pattern.data, pattern.count, &error);
+    // likely half typed, the view stays at the last hit until it parses
+    if (regex == nullptr) return;
+
+    s64 from = search->origin.pos;
+    Searcher *literal = regex->literal;
+    if (last && literal && last->literal.count > 0 && last->literal.count <= literal->count &&
+        memcmp(last->literal.data, literal->needle, last->literal.count) == 0) {
+        if (last->match.pos < 0) {
+            incremental_search_push_step(search, literal, none);
+            regex_free(regex);
+            incremental_search_jump(search, none);
+            return;
+        }
+        from = last->match.pos;
+    }
+    search->job = search_job_start(text_snapshot(search->view->buffer->text), regex, from, search->origin.pos);
 }
 
-internal s64 get_line_pos(Buffer *buffer, s64 line) {
-    assert(line <= (s64)buffer->text->line_bases.count - 1);
-    s64 result = buffer->text->line_bases[line];
-    return result;
+// the pattern is the first argument of a search command, empty for anything else
+internal string incremental_search_pattern(string command) {
+    string pattern{};
+    Array<string> args = split(command);
+    if (args.count >= 2 && args[0].count == 6 && strncmp(args[0].data, "search", 6) == 0) {
+        pattern = args[1];
+    }
+    args.clear();
+    return pattern;
 }
 
-internal s64 get_line_end_pos(Buffer *buffer, s64 line) {
-    s64 begin = get_line_pos(buffer, line);
-    s64 end = begin + get_line_length(buffer, line) - 1;
-    return end;
+internal void update_incremental_search(Application *app) {
+    IncrementalSearch *search = &app->incremental_search;
+    for (SearchJob **job = &search->retired; *job; ) {
+        if (search_job_done(*job)) {
+            SearchJob *done = *job;
+            *job = done->next;
+            search_job_free(done);
+        } else {
+            job = &(*job)->next;
+        }
+    }
+    if (search->view == nullptr) return;
+    if (!app->command_mode) {
+        incremental_search_end(app, false);
+        return;
+    }
+
+    Buffer *command = app->command_view->buffer;
+    if (command->text->version != search->command_version) {
+        search->command_version = command->text->version;
+        string s = buffer_text(command);
+        incremental_search_set_pattern(search, incremental_search_pattern(s));
+        free_string(&s);
+        highlight_set(app, search->pattern.count > 0 ? search->pattern : search->highlight_before);
+    }
+
+    if (search->job && search_job_done(search->job)) {
+        StringMatch match = search_job_match(search->job);
+        incremental_search_push_step(search, search->job->regex->literal, match);
+        search_job_free(search->job);
+        search->job = nullptr;
+        incremental_search_jump(search, match);
+    }
 }
 
 COMMAND_SIG(undefined) {
@@ -518,9 +931,13 @@ COMMAND_SIG(select_mode) {
     view->keymap = &select_keymap;
     view->select_active = true;
     view->select_cursor = view->cursor;
+    for (Selection &selection : view->selections) {
+        selection.select_cursor = selection.cursor;
+    }
 }
 
 COMMAND_SIG(command_mode) {
+    incremental_search_begin(app, app->active_view);
     app->command_mode = true;
     app->active_view = app->command_view;
     buffer_clear(app->command_view->buffer);
@@ -541,14 +958,15 @@ COMMAND_SIG(extend_line) {
 
 COMMAND_SIG(extend_line_below) {
     View *view = app->active_view;
-    int line = view->cursor.line + 1;
+    s64 line = view->cursor.line + 1;
     if (!view->select_active) {
         select_mode(app);
         line = view->cursor.line;
     }
     if (line >= get_line_count(view->buffer)) line = get_line_count(view->buffer) - 1;
-    Cursor end = get_cursor_from_pos(view->buffer, get_line_end_pos(view->buffer, line));
-    view->cursor = end;
+    // the whole line, its newline too
+    s64 last = get_line_pos(view->buffer, line) + get_line_length(view->buffer, line) - 1;
+    view->cursor = get_cursor_from_pos(view->buffer, last);
 }
 
 COMMAND_SIG(exchange_selection_mark) {
@@ -556,43 +974,42 @@ COMMAND_SIG(exchange_selection_mark) {
     Cursor c = view->cursor;
     view->cursor = view->select_cursor;
     view->select_cursor = c;
+    for (Selection &selection : view->selections) {
+        c = selection.cursor;
+        selection.cursor = selection.select_cursor;
+        selection.select_cursor = c;
+    }
 }
 
-inline internal Buffer *buffer_init(string file_name, string contents);
+inline internal Buffer *buffer_init();
+internal Buffer *buffer_open(string file_name);
 
 COMMAND_SIG(open) {
     View *view = app->active_view;
     if (app->command_args.empty()) return;
 
     string file_name;
-    string file_text;
     string arg = app->command_args[0];
     assert(arg.count > 0);
 
-    xp_path path = {(unsigned char *)arg.data, arg.count};
+    xp_path path = {(unsigned char *)arg.data, (int)arg.count};
     if (xp_path_relative(path)) {
         // TODO: change to "default" directory
         file_name = join(view->buffer->default_directory, arg);
     } else {
         file_name = copy(arg);
     }
-    string f = read_file(file_name);
-    file_text = crlf_to_lf(f);
-    free(f.data);
-
-    Buffer *buffer = buffer_init(file_name, file_text);
+    Buffer *buffer = buffer_open(file_name);
     view->buffer = buffer;
 }
 
 COMMAND_SIG(write_buffer) {
     View *view = app->active_view;
-    string text = buffer_text(view->buffer);
-    string write_str = lf_to_crlf(text);
 
     string path;
     if (app->command_args.count > 0) {
         string arg = app->command_args[0];
-        xp_path p = {(u8 *)arg.data, arg.count};
+        xp_path p = {(u8 *)arg.data, (int)arg.count};
         if (xp_path_relative(p)) {
             path = copy(arg);
         } else {
@@ -605,25 +1022,20 @@ COMMAND_SIG(write_buffer) {
     }
 
     if (path.data) {
-        write_file(path, write_str);
+        buffer_save(view->buffer, path);
     } else {
         assert(0);
     }
 
-    printf("Writing to %s\n", path.data);
-
     if (app->command_args.count > 0) {
         free_string(&path); 
     }
-
-    free_string(&text);
-    free_string(&write_str);
 }
 
 COMMAND_SIG(self_insert) {
     View *view = app->active_view;
-    insert_char(view->buffer, view->cursor.pos, last_insert_char);
-    view->cursor = get_cursor_from_pos(view->buffer, view->cursor.pos + 1);
+    u8 c = (u8)last_insert_char;
+    view_edit_cursors(view, 0, &c, 1);
 }
 
 COMMAND_SIG(goto_file_start) {
@@ -634,7 +1046,12 @@ COMMAND_SIG(goto_file_start) {
 
 COMMAND_SIG(goto_file_end) {
     View *view = app->active_view;
-    view->cursor = get_cursor_from_pos(view->buffer,  buffer_length(view->buffer) - 1);
+    s64 pos = buffer_length(view->buffer) - 1;
+    if (view->buffer->text->indexer) {
+        // stop at the first line the index has not reached yet
+        pos = get_line_pos(view->buffer, get_line_count(view->buffer) - 1);
+    }
+    view->cursor = get_cursor_from_pos(view->buffer, pos);
     view->line_offset = view->cursor.line - view->lines + 2;
 }
 
@@ -650,16 +1067,14 @@ COMMAND_SIG(goto_line_start) {
 
 COMMAND_SIG(insert_newline) {
     View *view = app->active_view;
-    insert_char(view->buffer, view->cursor.pos, '\n');
-    view->cursor = get_cursor_from_line(view->buffer, view->cursor.line + 1);
+    string newline = buffer_newline(view->buffer);
+    view_edit_cursors(view, 0, (u8 *)newline.data, newline.count);
 }
 
 COMMAND_SIG(insert_tab) {
     View *view = app->active_view;
-    for (int i = 0; i < 4; i++) {
-        insert_char(view->buffer, view->cursor.pos, ' ');
-    }
-    view->cursor = get_cursor_from_pos(view->buffer, view->cursor.pos + 4);
+    u8 tab[] = "    ";
+    view_edit_cursors(view, 0, tab, 4);
 }
 
 COMMAND_SIG(insert_at_line_start) {
@@ -695,18 +1110,19 @@ COMMAND_SIG(insert_at_line_end) {
 
 COMMAND_SIG(open_line_above) {
     View *view = app->active_view;
-    s64 pos = get_line_pos(view->buffer, view->cursor.line) - 1;
-    if (pos < 0) pos = 0;
-    insert_char(view->buffer, pos, '\n');
+    // a newline at the start of the line pushes it down below an empty one
+    s64 pos = get_line_pos(view->buffer, view->cursor.line);
+    string newline = buffer_newline(view->buffer);
+    insert_string(view->buffer, pos, (u8 *)newline.data, newline.count);
     view->cursor = get_cursor_from_line(view->buffer, view->cursor.line);
     insert_mode(app);
 }
 
-int get_line_indentation(Buffer *buffer, int line) {
+int get_line_indentation(Buffer *buffer, s64 line) {
     int indent = 0;
     if (line >= 0) {
         string s = get_line_string(buffer, line);
-        for (int i = 0; i < s.count; i++) {
+        for (s64 i = 0; i < s.count; i++) {
             if (s[i] != ' ') {
                 break;
             }
@@ -718,21 +1134,76 @@ int get_line_indentation(Buffer *buffer, int line) {
 
 COMMAND_SIG(open_line) {
     View *view = app->active_view;
-    int indent = get_line_indentation(view->buffer, view->cursor.line);
-    s64 pos = get_line_end_pos(view->buffer, view->cursor.line);
-    insert_char(view->buffer, pos++, '\n');
-    for (int i = 0; i < indent; i++, pos++) {
-        insert_char(view->buffer, pos, ' ');
+    Buffer *buffer = view->buffer;
+    s64 primary;
+    Array<Selection> all = view_all_selections(view, &primary);
+    s64 n = (s64)all.count;
+    CursorEdit *edits = (CursorEdit *)malloc(n * sizeof(CursorEdit));
+    string newline = buffer_newline(buffer);
+    for (s64 i = 0; i < n; i++) {
+        s64 line = all.data[i].cursor.line;
+        int indent = get_line_indentation(buffer, line);
+        s64 pos = get_line_end_pos(buffer, line);
+        u8 *text = (u8 *)malloc(newline.count + indent);
+        memcpy(text, newline.data, newline.count);
+        memset(text + newline.count, ' ', indent);
+        edits[i] = {pos, pos, text, newline.count + indent};
+    }
+    buffer_apply_edits(buffer, edits, n);
+
+    s64 *ends = (s64 *)malloc(n * sizeof(s64));
+    edits_new_ends(edits, n, ends);
+    for (s64 i = 0; i < n; i++) {
+        all.data[i].cursor = get_cursor_from_pos(buffer, ends[i]);
+        all.data[i].select_cursor = all.data[i].cursor;
+        free(edits[i].data);
     }
-    view->cursor = get_cursor_from_pos(view->buffer, get_line_end_pos(view->buffer, view->cursor.line + 1));
+    view_set_selections(view, all, primary);
+    free(ends);
+    free(edits);
+    all.clear();
     insert_mode(app);
 }
 
 COMMAND_SIG(delete_char_backward) {
     View *view = app->active_view;
-    if (view->cursor.pos > 0) {
-        delete_single(view->buffer, view->cursor.pos -1);
-        view->cursor = get_cursor_from_pos(view->buffer, view->cursor.pos - 1);
+    view_edit_cursors(view, 1, nullptr, 0);
+}
+
+COMMAND_SIG(add_cursor_below) {
+    View *view = app->active_view;
+    Cursor last = view->cursor;
+    if (!view->selections.empty() && view->selections.data[view->selections.count - 1].cursor.pos > last.pos) {
+        last = view->selections.data[view->selections.count - 1].cursor;
+    }
+    if (last.line + 1 >= get_line_count(view->buffer)) return;
+    last.col = view->cursor.col;
+    Cursor cursor = cursor_move_line(view->buffer, last, 1);
+    view->selections.push({cursor, cursor});
+}
+
+COMMAND_SIG(keep_primary_cursor) {
+    View *view = app->active_view;
+    view->selections.clear();
+}
+
+COMMAND_SIG(undo) {
+    View *view = app->active_view;
+    s64 pos = history_undo(&view->buffer->history, view->buffer->text);
+    if (pos >= 0) {
+        view->selections.clear();
+        view->cursor = get_cursor_from_pos(view->buffer, pos);
+        view->select_cursor = view->cursor;
+    }
+}
+
+COMMAND_SIG(redo) {
+    View *view = app->active_view;
+    s64 pos = history_redo(&view->buffer->history, view->buffer->text);
+    if (pos >= 0) {
+        view->selections.clear();
+        view->cursor = get_cursor_from_pos(view->buffer, pos);
+        view->select_cursor = view->cursor;
     }
 }
 
@@ -745,6 +1216,10 @@ COMMAND_SIG(move_char_left) {
     if (view->cursor.col < view->col_offset) {
         view->col_offset = view->cursor.col;
     }
+    for (Selection &selection : view->selections) {
+        selection.cursor = cursor_move_char(view->buffer, selection.cursor, -1);
+    }
+    view_merge_selections(view);
 }
 
 COMMAND_SIG(move_char_right) {
@@ -753,10 +1228,14 @@ COMMAND_SIG(move_char_right) {
     if (c.pos < buffer_length(view->buffer)) {
         view->cursor = get_cursor_from_pos(view->buffer, view->cursor.pos + 1);
     }
-    s32 cols = get_line_length(view->buffer, view->cursor.line);
+    s64 cols = get_line_length(view->buffer, view->cursor.line);
     if (view->cursor.col > view->col_offset + cols - 1) {
         view->col_offset = view->cursor.col - cols + 1;
     }
+    for (Selection &selection : view->selections) {
+        selection.cursor = cursor_move_char(view->buffer, selection.cursor, 1);
+    }
+    view_merge_selections(view);
 }
 
 COMMAND_SIG(move_next_word_end) {
@@ -799,6 +1278,10 @@ COMMAND_SIG(move_line_up) {
             view->line_offset = view->cursor.line;
         }
     }
+    for (Selection &selection : view->selections) {
+        selection.cursor = cursor_move_line(view->buffer, selection.cursor, -1);
+    }
+    view_merge_selections(view);
 }
 
 COMMAND_SIG(move_line_down) {
@@ -813,9 +1296,13 @@ COMMAND_SIG(move_line_down) {
             view->line_offset = cursor.line - view->lines + 1;
         }
     }
+    for (Selection &selection : view->selections) {
+        selection.cursor = cursor_move_line(view->buffer, selection.cursor, 1);
+    }
+    view_merge_selections(view);
 }
 
-bool buffer_line_empty(Buffer *buffer, int line) {
+bool buffer_line_empty(Buffer *buffer, s64 line) {
     bool empty = true;
     s64 end = get_line_end_pos(buffer, line);
     for (s64 pos = get_line_pos(buffer, line); pos < end; pos++) {
@@ -830,9 +1317,9 @@ bool buffer_line_empty(Buffer *buffer, int line) {
 
 COMMAND_SIG(move_paragraph_up) {
     View *view = app->active_view;
-    int line_count = get_line_count(view->buffer);
-    int move_line = view->cursor.line;
-    for (int line = view->cursor.line - 1; line >= 0; line--) {
+    s64 line_count = get_line_count(view->buffer);
+    s64 move_line = view->cursor.line;
+    for (s64 line = view->cursor.line - 1; line >= 0; line--) {
         if (buffer_line_empty(view->buffer, line)) {
             move_line = line;
             break;
@@ -844,9 +1331,9 @@ COMMAND_SIG(move_paragraph_up) {
 
 COMMAND_SIG(move_paragraph_down) {
     View *view = app->active_view;
-    int line_count = get_line_count(view->buffer);
-    int move_line = view->cursor.line;
-    for (int line = view->cursor.line + 1; line < line_count; line++) {
+    s64 line_count = get_line_count(view->buffer);
+    s64 move_line = view->cursor.line;
+    for (s64 line = view->cursor.line + 1; line < line_count; line++) {
         if (buffer_line_empty(view->buffer, line)) {
             move_line = line;
             break;
@@ -858,7 +1345,7 @@ COMMAND_SIG(move_paragraph_down) {
 
 COMMAND_SIG(page_up) {
     View *view = app->active_view;
-    s32 line = view->cursor.line;
+    s64 line = view->cursor.line;
     line -= view->lines;
     if (line < 0) {
         line = 0;
@@ -869,9 +1356,9 @@ COMMAND_SIG(page_up) {
 
 COMMAND_SIG(page_down) {
     View *view = app->active_view;
-    int line = view->cursor.line;
+    s64 line = view->cursor.line;
     line += view->lines;
-    int line_count = get_line_count(view->buffer);
+    s64 line_count = get_line_count(view->buffer);
     if (line >= line_count) {
         line = line_count - 1;
     }
@@ -881,44 +1368,90 @@ COMMAND_SIG(page_down) {
 
 COMMAND_SIG(delete_selection) {
     View *view = app->active_view;
-    s64 start = view->cursor.pos;
-    s64 end = view->select_cursor.pos;
-    if (end < start) {
-        s64 p = start;
-        start = end;
-        end = p;
+    Buffer *buffer = view->buffer;
+    s64 primary;
+    Array<Selection> all = view_all_selections(view, &primary);
+    s64 n = (s64)all.count;
+    CursorEdit *edits = (CursorEdit *)malloc(n * sizeof(CursorEdit));
+    for (s64 i = 0; i < n; i++) {
+        s64 start = all.data[i].cursor.pos;
+        s64 end = all.data[i].select_cursor.pos;
+        if (!view->select_active) end = start;
+        if (end < start) {
+            s64 p = start;
+            start = end;
+            end = p;
+        }
+        edits[i] = {start, end + 1, nullptr, 0};
+        all.data[i].cursor.pos = start;
     }
-
-    if (!view->select_active) {
-        start = view->cursor.pos;
-        end = start;
+    // selections can reach past each other, overlapping ones are deleted as one
+    std::sort(edits, edits + n, [](CursorEdit a, CursorEdit b) { return a.start < b.start; });
+    s64 merged = 0;
+    s64 length = buffer_length(buffer);
+    for (s64 i = 0; i < n; i++) {
+        if (edits[i].end > length) edits[i].end = length;
+        if (merged > 0 && edits[i].start <= edits[merged - 1].end) {
+            if (edits[i].end > edits[merged - 1].end) edits[merged - 1].end = edits[i].end;
+        } else {
+            edits[merged++] = edits[i];
+        }
     }
-
-    delete_range(view->buffer, start, end + 1);
-    view->cursor = get_cursor_from_pos(view->buffer, start);
-    view->select_cursor = view->cursor;
+    buffer_apply_edits(buffer, edits, merged);
+
+    // every cursor lands where the deletion covering it started
+    s64 *ends = (s64 *)malloc(merged * sizeof(s64));
+    edits_new_ends(edits, merged, ends);
+    for (s64 i = 0; i < n; i++) {
+        s64 lo = 0;
+        s64 hi = merged - 1;
+        while (lo < hi) {
+            s64 mid = (lo + hi + 1) / 2;
+            if (edits[mid].start <= all.data[i].cursor.pos) lo = mid;
+            else hi = mid - 1;
+        }
+        all.data[i].cursor = get_cursor_from_pos(buffer, ends[lo]);
+        all.data[i].select_cursor = all.data[i].cursor;
+    }
+    s64 primary_pos = all.data[primary].cursor.pos;
+    std::sort(all.begin(), all.end(), [](Selection a, Selection b) { return a.cursor.pos < b.cursor.pos; });
+    for (primary = 0; all.data[primary].cursor.pos != primary_pos; primary++);
+    view_set_selections(view, all, primary);
+    free(ends);
+    free(edits);
+    all.clear();
     normal_mode(app);
 }
 
-Array<StringMatch> buffer_search_forward(Buffer *buffer, string pattern, s64 pos) {
-    Array<StringMatch> match_list{};
-    s64 last = buffer_length(buffer);
-    for (s64 index = pos; index < last; index++) {
-        bool matches = true;
-        for (int pidx = 0; pidx < pattern.count; pidx++) {
-            if (pattern[pidx] != char_from_pos(buffer, index + pidx)) {
-                matches = false;
-                break;
-            }
+// The first match of the regex pattern at or after pos, its pos is -1 when there is none. Long
+// stretches of text are searched in chunks on every core.
+internal StringMatch buffer_search_forward(Buffer *buffer, string pattern, s64 pos) {
+    StringMatch match{};
+    match.pos = -1;
+    const char *error = nullptr;
+    // freed before the next edit, so the gap buffer gets its block back without a copy
+    TextSnapshot *snapshot = text_snapshot(buffer->text);
+    s32 threads = os_processor_count();
+    if (threads > 1 && snapshot->length - pos >= PARALLEL_SEARCH_MIN) {
+        ParallelSearch *search = parallel_search_start(snapshot, pattern, pos, threads, true, &error);
+        if (search) {
+            parallel_search_next(search, &match);
+            parallel_search_free(search);
+            return match;
         }
-        if (matches) {
-            StringMatch match{};
-            match.pos = index;
-            match.count = pattern.count;
-            match_list.push(match);
+    } else {
+        Regex *regex = regex_compile((u8 *)pattern.data, pattern.count, &error);
+        if (regex) {
+            match = regex_find(regex, snapshot, pos, snapshot->length);
+            regex_free(regex);
+            text_snapshot_free(snapshot);
+            return match;
         }
+        text_snapshot_free(snapshot);
     }
-    return match_list;
+    // TODO: error handling
+    printf("Bad pattern: %s\n", error);
+    return match;
 }
 
 COMMAND_SIG(search) {
@@ -929,11 +1462,321 @@ COMMAND_SIG(search) {
     View *view = app->active_view;    
     Buffer *buffer = view->buffer;
     string pattern = app->command_args[0];
-    Array<StringMatch> match_list = buffer_search_forward(buffer, pattern, view->cursor.pos);
-    if (match_list.count > 0) {
-        view->cursor = get_cursor_from_pos(buffer, match_list[0].pos);
+    highlight_set(app, pattern);
+    StringMatch match = buffer_search_forward(buffer, pattern, view->cursor.pos);
+    if (match.pos >= 0) {
+        view->cursor = get_cursor_from_pos(buffer, match.pos);
+    }
+}
+
+// @note Replace
+// "replace <pattern> [replacement]" replaces every match of the regex pattern in the buffer and
+// "replace -literal <text> [replacement]" every occurrence of the text. Arguments are split at
+// spaces, so the replacement and the literal text take \s for a space besides \n, \t and \\.
+// Every match is found first, on every core for a long text, and the edits then go in as one
+// undoable edit. Edits that are many for the length of the text are made by writing the new text
+// out in one pass, so a million of them cost a copy of the text rather than a million edits.
+
+internal string replace_unescape(string s) {
+    string result;
+    result.data = (char *)malloc(s.count + 1);
+    result.count = 0;
+    for (s64 i = 0; i < s.count; i++) {
+        char c = s.data[i];
+        if (c == '\\' && i + 1 < s.count) {
+            switch (s.data[++i]) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 's': c = ' '; break;
+            default:  c = s.data[i]; break;
+            }
+        }
+        result.data[result.count++] = c;
+    }
+    result.data[result.count] = '\0';
+    return result;
+}
+
+// a pattern matching exactly the text
+internal string regex_quote(string text) {
+    string result;
+    result.data = (char *)malloc(2 * text.count + 1);
+    result.count = 0;
+    for (s64 i = 0; i < text.count; i++) {
+        if (!isalnum((u8)text.data[i])) result.data[result.count++] = '\\';
+        result.data[result.count++] = text.data[i];
+    }
+    result.data[result.count] = '\0';
+    return result;
+}
+
+// An edit replacing each match of the pattern with count bytes of data, in order. Returns false
+// and sets error when the pattern is bad.
+internal bool buffer_replace_edits(Buffer *buffer, string pattern, u8 *data, s64 count, Array<CursorEdit> *edits, const char **error) {
+    // freed before the edit, so the gap buffer gets its block back without a copy
+    TextSnapshot *snapshot = text_snapshot(buffer->text);
+    s32 threads = os_processor_count();
+    StringMatch match;
+    if (threads > 1 && snapshot->length >= PARALLEL_SEARCH_MIN) {
+        ParallelSearch *search = parallel_search_start(snapshot, pattern, 0, threads, false, error);
+        if (search == nullptr) return false;
+        while (parallel_search_next(search, &match)) {
+            edits->push({match.pos, match.pos + match.count, data, count});
+        }
+        parallel_search_free(search);
+        return true;
+    }
+    Regex *regex = regex_compile((u8 *)pattern.data, pattern.count, error);
+    if (regex == nullptr) {
+        text_snapshot_free(snapshot);
+        return false;
     }
-    match_list.clear();
+    for (s64 pos = 0; (match = regex_find(regex, snapshot, pos, snapshot->length)).pos >= 0; pos = search_next_start(match)) {
+        edits->push({match.pos, match.pos + match.count, data, count});
+    }
+    regex_free(regex);
+    text_snapshot_free(snapshot);
+    return true;
+}
+
+// edits sorted by start and apart from each other, positions are in the text before any of them
+internal void buffer_replace(Buffer *buffer, CursorEdit *edits, s64 count) {
+    if (count == 0) return;
+    if (count * REPLACE_REBUILD_SPACING < buffer_length(buffer)) {
+        buffer_apply_edits(buffer, edits, count);
+        return;
+    }
+    history_replace(&buffer->history, buffer->text, edits, count);
+    text_rebuild(buffer->text, edits, count);
+}
+
+COMMAND_SIG(replace) {
+    Array<string> args = app->command_args;
+    bool literal = args.count > 0 && args[0].count == 8 && strncmp(args[0].data, "-literal", 8) == 0;
+    if (literal) {
+        args.data++;
+        args.count--;
+    }
+    if (args.count < 1 || args[0].count == 0) {
+        printf("Need pattern to replace..\n");
+        return;
+    }
+    View *view = app->active_view;
+    Buffer *buffer = view->buffer;
+    f64 start = os_seconds();
+    string pattern;
+    if (literal) {
+        string text = replace_unescape(args[0]);
+        pattern = regex_quote(text);
+        free_string(&text);
+    } else {
+        pattern = copy(args[0]);
+    }
+    string replacement = replace_unescape(args.count > 1 ? args[1] : string{});
+
+    Array<CursorEdit> edits{};
+    const char *error = nullptr;
+    if (!buffer_replace_edits(buffer, pattern, (u8 *)replacement.data, replacement.count, &edits, &error)) {
+        // TODO: error handling
+        printf("Bad pattern: %s\n", error);
+    } else if (edits.count > 0) {
+        // the cursor stays on the text it was on, or goes to the start of the match it was in
+        s64 pos = view->cursor.pos;
+        s64 shift = 0;
+        for (CursorEdit edit : edits) {
+            if (edit.start >= pos) break;
+            if (edit.end > pos) {
+                pos = edit.start;
+                break;
+            }
+            shift += edit.count - (edit.end - edit.start);
+        }
+        buffer_replace(buffer, edits.data, (s64)edits.count);
+        view->selections.clear();
+        view->cursor = get_cursor_from_pos(buffer, pos + shift);
+        view->select_cursor = view->cursor;
+        printf("%lld replacements in %.2fs\n", (long long)edits.count, os_seconds() - start);
+    }
+    edits.clear();
+    free_string(&pattern);
+    free_string(&replacement);
+}
+
+// @note Find in files
+// "grep <pattern> [directory]" streams one line per match into the results buffer, as
+// path:line:col: text with the path relative to the directory searched. Enter on a result line
+// opens the file there.
+
+// Full path of a file or directory, with forward slashes. A file not yet on disk keeps the name
+// it was given.
+internal string full_path(string file_name) {
+    xp_path path = {(unsigned char *)file_name.data, (int)file_name.count};
+    xp_path full = xp_fullpath(path);
+    // xp_fullpath hands back the path it was given when it cannot resolve it
+    string result = full.data == path.data ? copy(file_name) : string_make((char *)full.data, full.count);
+    xp_replace_slashes({(unsigned char *)result.data, (int)result.count});
+    return result;
+}
+
+// a grep's lines are not edits, they go in without undo history
+internal void grep_results_append(Buffer *results, string text) {
+    text_insert(results->text, buffer_length(results), (u8 *)text.data, text.count);
+}
+
+internal void update_grep(Application *app) {
+    GrepJob *job = app->grep;
+    if (job == nullptr) return;
+    // looked at before the output is taken, so none comes in after the last take
+    bool done = grep_done(job);
+    string output = grep_take_output(job);
+    if (output.count > 0) grep_results_append(app->grep_results, output);
+    free_string(&output);
+    if (!done) return;
+
+    char summary[256];
+    int count = snprintf(summary, sizeof(summary), "%lld matching lines in %lld of %lld files (%lld binary skipped), %.2fs\n",
+                         (long long)job->matched_lines, (long long)job->matched_files, (long long)job->files,
+                         (long long)job->binary_files, os_seconds() - job->start);
+    grep_results_append(app->grep_results, string_make(summary, count));
+    grep_free(job);
+    app->grep = nullptr;
+}
+
+COMMAND_SIG(grep) {
+    if (app->command_args.count < 1) {
+        printf("Need pattern to grep..\n");
+        return;
+    }
+    View *view = app->active_view;
+    string pattern = app->command_args[0];
+
+    string directory;
+    if (app->command_args.count > 1) {
+        string arg = app->command_args[1];
+        xp_path path = {(unsigned char *)arg.data, (int)arg.count};
+        if (xp_path_relative(path) && view->buffer->default_directory.count > 0) {
+            directory = join(view->buffer->default_directory, arg);
+        } else {
+            directory = join(arg, CONSTZ(""));
+        }
+    } else if (view->buffer->default_directory.count > 0) {
+        directory = copy(view->buffer->default_directory);
+    } else {
+        xp_path current = xp_current_path();
+        directory = string_make((char *)current.data, current.count);
+    }
+    string root = full_path(directory);
+    free_string(&directory);
+    if (root.count == 0 || root.data[root.count - 1] != '/') {
+        string slashed = join(root, CONSTZ("/"));
+        free_string(&root);
+        root = slashed;
+    }
+
+    if (app->grep) {
+        grep_free(app->grep);
+        app->grep = nullptr;
+    }
+    if (app->grep_results == nullptr) {
+        app->grep_results = buffer_init();
+        app->grep_results->file_name = copy(CONSTZ("*grep*"));
+    } else {
+        buffer_clear(app->grep_results);
+        free_string(&app->grep_results->default_directory);
+    }
+    Buffer *results = app->grep_results;
+    results->default_directory = copy(root);
+
+    // open buffers are searched as they are now, saved or not
+    Array<GrepBuffer> buffers;
+    for (Buffer *buffer = app->buffer_list; buffer; buffer = buffer->next) {
+        if (buffer == results || buffer->file_name.count == 0) continue;
+        string path = full_path(buffer->file_name);
+        if (path.count > root.count && grep_same_path(string_make(path.data, root.count), root)) {
+            GrepBuffer open{};
+            open.path = path;
+            open.snapshot = text_snapshot(buffer->text);
+            buffers.push(open);
+        } else {
+            free_string(&path);
+        }
+    }
+
+    const char *error = nullptr;
+    app->grep = grep_start(pattern, root, buffers.data, buffers.count, os_processor_count(), &error);
+    if (app->grep == nullptr) {
+        // TODO: error handling
+        printf("Bad pattern: %s\n", error);
+        return;
+    }
+    char header[256];
+    int count = snprintf(header, sizeof(header), "grep %.*s in %.*s\n", (int)pattern.count, pattern.data, (int)results->default_directory.count, results->default_directory.data);
+    grep_results_append(results, string_make(header, count));
+
+    view->buffer = results;
+    view->cursor = {};
+    view->select_cursor = {};
+    view->selections.clear();
+    view->line_offset = 0;
+}
+
+COMMAND_SIG(goto_result) {
+    View *view = app->active_view;
+    Buffer *results = view->buffer;
+    if (results != app->grep_results) return;
+
+    // path:line:col: text, the path can hold a ':' itself
+    string text = get_line_string(results, view->cursor.line);
+    s64 line = -1;
+    s64 col = -1;
+    s64 name_count = 0;
+    for (s64 i = 0; i < text.count && line < 0; i++) {
+        if (text.data[i] != ':') continue;
+        char *end;
+        s64 l = strtoll(text.data + i + 1, &end, 10);
+        if (end == text.data + i + 1 || *end != ':') continue;
+        char *col_start = end + 1;
+        s64 c = strtoll(col_start, &end, 10);
+        if (end == col_start || *end != ':') continue;
+        line = l;
+        col = c;
+        name_count = i;
+    }
+    if (line < 1 || col < 1) {
+        free_string(&text);
+        return;
+    }
+    string name = join(results->default_directory, string_make(text.data, name_count));
+    free_string(&text);
+
+    Buffer *buffer = nullptr;
+    string path = full_path(name);
+    for (Buffer *open = app->buffer_list; open && buffer == nullptr; open = open->next) {
+        if (open == results || open->file_name.count == 0) continue;
+        string open_path = full_path(open->file_name);
+        if (grep_same_path(open_path, path)) buffer = open;
+        free_string(&open_path);
+    }
+    free_string(&path);
+    if (buffer) {
+        free_string(&name);
+    } else {
+        buffer = buffer_open(name);
+    }
+
+    s64 line_count = get_line_count(buffer);
+    Cursor start = get_cursor_from_line(buffer, line - 1 < line_count ? line - 1 : line_count - 1);
+    s64 length = get_line_length(buffer, start.line);
+    s64 offset = col - 1 < length ? col - 1 : (length > 0 ? length - 1 : 0);
+    view->buffer = buffer;
+    view->cursor = get_cursor_from_pos(buffer, start.pos + offset);
+    view->select_cursor = view->cursor;
+    view->selections.clear();
+    view->line_offset = view->cursor.line - view->lines / 2 > 0 ? view->cursor.line - view->lines / 2 : 0;
+}
+
+COMMAND_SIG(no_highlight) {
+    highlight_set(app, {});
 }
 
 global TypeableCommand typeable_commands[] = {
@@ -941,10 +1784,15 @@ global TypeableCommand typeable_commands[] = {
     { CONSTZ("quit"),   { CONSTZ("q") }, quit_codex },
     { CONSTZ("open"),   { CONSTZ("o") }, open },
     { CONSTZ("search"), {},             search },
+    { CONSTZ("grep"),   {},             grep },
+    { CONSTZ("replace"), {},            replace },
+    { CONSTZ("nohighlight"), {},        no_highlight },
 };
 
 COMMAND_SIG(exit_command_mode) {
     View *view = app->active_view;
+    // a search typed out ends where the incremental one got to, or where it started
+    incremental_search_end(app, true);
     app->active_view = app->view_list;
     app->command_mode = false;
     normal_mode(app);
@@ -973,6 +1821,12 @@ internal bool execute_command(Keymap *keymap, Array<InputEvent> &events) {
         if (keymap == nullptr) return true;
         KeyBind bind = keymap->bindings[events[i].key];
         if (bind.kind == KeyBind::Command) {
+            // a run of typed characters undoes as one
+            local_persist CommandProc last_command;
+            if (bind.command.proc != self_insert || last_command != self_insert) {
+                edit_group++;
+            }
+            last_command = bind.command.proc;
             bind.command.proc(application);
             return true;
         } else {
@@ -1005,25 +1859,6 @@ internal void resize_application(RenderTarget *target, int w, int h) {
     }
 }
 
-inline internal TextBuffer *text_buffer_init(string contents) {
-    TextBuffer *text = (TextBuffer *)malloc(sizeof(TextBuffer));
-    block_zero(text, sizeof(TextBuffer));
-    text->contents = (u8*)contents.data;
-    text->gap_start = 0;
-    text->gap_end = 0;
-    text->end = contents.count;
-    return text;
-}
-
-inline internal TextBuffer *text_buffer_init() {
-    TextBuffer *text = (TextBuffer *)malloc(sizeof(TextBuffer));
-    block_zero(text, sizeof(TextBuffer));
-    text->contents = (u8 *)malloc(GAP_SIZE);
-    text->gap_start = 0;
-    text->end = text->gap_end = GAP_SIZE;
-    return text;
-}
-
 internal void push_buffer(Application *app, Buffer *buffer) {
     if (app->buffer_list == nullptr) {
         app->buffer_list = buffer;
@@ -1043,27 +1878,76 @@ inline internal Buffer *buffer_init() {
     Buffer *buffer = (Buffer *)malloc(sizeof(Buffer));
     block_zero(buffer, sizeof(Buffer));
     buffer->text = text_buffer_init();
-    update_line_bases(buffer);
     push_buffer(application, buffer);
     return buffer;
 }
 
-inline internal Buffer *buffer_init(string file_name, string contents) {
+inline internal Buffer *buffer_init(string file_name, TextBuffer *text, LineEnding line_ending) {
     Buffer *buffer = (Buffer *)malloc(sizeof(Buffer));
     block_zero(buffer, sizeof(Buffer));
     buffer->file_name = file_name;
     
-    xp_path path = {(unsigned char *)file_name.data, file_name.count};
+    xp_path path = {(unsigned char *)file_name.data, (int)file_name.count};
     path = xp_parent_path(path);
     buffer->default_directory = string_make((char *)path.data, path.count);
     
-    buffer->text = text_buffer_init(contents);
-    buffer->line_ending = LineEnding::CRLF;
-    update_line_bases(buffer);
+    buffer->text = text;
+    buffer->line_ending = line_ending;
     push_buffer(application, buffer);
     return buffer;
 }
 
+inline internal Buffer *buffer_init(string file_name, string contents) {
+    return buffer_init(file_name, text_buffer_init(contents), LineEnding::CRLF);
+}
+
+#define LINE_ENDING_SAMPLE (1024 * 1024)
+
+// Large files stay mapped and are read in place with their bytes untouched, so they are written
+// back as-is. Smaller files are copied out of the mapping and converted to LF when they use CRLF.
+internal Buffer *buffer_open(string file_name) {
+    FileMap map;
+    if (!os_map_file(file_name.data, &map)) {
+        return buffer_init(file_name, string{});
+    }
+    if (map.size >= LARGE_FILE_SIZE) {
+        LineEnding line_ending = detect_line_ending(map.data, LINE_ENDING_SAMPLE);
+        Buffer *buffer = buffer_init(file_name, text_buffer_init(map), line_ending);
+        buffer->raw_line_endings = true;
+        return buffer;
+    }
+
+    LineEnding line_ending = detect_line_ending(map.data, map.size);
+    string file_text;
+    file_text.data = (char *)malloc(map.size + 1);
+    if (line_ending == LineEnding::CRLF) {
+        file_text.count = crlf_to_lf((u8 *)file_text.data, map.data, map.size);
+    } else {
+        if (map.size) memcpy(file_text.data, map.data, map.size);
+        file_text.count = map.size;
+    }
+    file_text.data[file_text.count] = 0;
+    os_unmap_file(&map);
+    return buffer_init(file_name, text_buffer_init(file_text), line_ending);
+}
+
+// merges background indexing results, cursors keep their position but may land on a new line
+internal void update_line_indexing(Application *app) {
+    for (Buffer *buffer = app->buffer_list; buffer; buffer = buffer->next) {
+        if (text_poll_indexing(buffer->text)) {
+            for (View *view = app->view_list; view; view = view->next) {
+                if (view->buffer != buffer) continue;
+                view->cursor = get_cursor_from_pos(buffer, view->cursor.pos);
+                view->select_cursor = get_cursor_from_pos(buffer, view->select_cursor.pos);
+                for (Selection &selection : view->selections) {
+                    selection.cursor = get_cursor_from_pos(buffer, selection.cursor.pos);
+                    selection.select_cursor = get_cursor_from_pos(buffer, selection.select_cursor.pos);
+                }
+            }
+        }
+    }
+}
+
 internal void push_view(Application *app, View *view) {
     if (app->view_list == nullptr) {
         app->view_list = view;
@@ -1096,6 +1980,11 @@ internal Application *application_init() {
 internal string parse_arguments(int argc, char **argv) {
     string result{};
     for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-rope") == 0) large_file_backend = RopeBackend;
+        if (strcmp(argv[i], "-undo-budget") == 0 && i + 1 < argc) {
+            undo_budget = atoll(argv[++i]) * 1024 * 1024;
+            continue;
+        }
         if (*argv[i] == '-') continue;
         result = STRZ(argv[i]);
     }
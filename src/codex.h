@@ -3,7 +3,7 @@
 
 #define ARRAYCOUNT(array) (sizeof((array)) / sizeof((array)[0]))
 #define CONSTZ(str) { str, sizeof(str) - 1}
-#define STRZ(str)  { str, (int)strlen(str)}
+#define STRZ(str)  { str, (s64)strlen(str)}
 
 struct StringMatch {
     s64 pos;
@@ -41,10 +41,26 @@ struct Color {
 
 struct Cursor {
     s64 pos;
-    s32 line;
-    s32 col;
+    s64 line;
+    s64 col;
 };
 
+struct Selection {
+    Cursor cursor;
+    Cursor select_cursor;
+};
+
+// replaces [start, end) with count bytes of data
+struct CursorEdit {
+    s64 start;
+    s64 end;
+    u8 *data;
+    s64 count;
+};
+
+// edits closer together than this on average are made by rebuilding the text
+#define REPLACE_REBUILD_SPACING 4096
+
 enum LineEnding {
     CR,
     LF,
@@ -53,8 +69,8 @@ enum LineEnding {
 
 struct string {
     char *data;
-    int count;
-    char const &operator[](int i) {
+    s64 count;
+    char const &operator[](s64 i) {
         return data[i];
     }
 };
@@ -95,12 +111,465 @@ struct Rect {
     f32 y1;
 };
 
+// @note Line lengths include the trailing newline; the last line counts a virtual one,
+// so the index always holds buffer_length + 1 bytes.
+#define LINE_BLOCK_CAP 512
+#define LINE_BLOCK_FILL 384
+
+struct LineBlock {
+    s64 bytes;
+    s32 count;
+    s64 starts[LINE_BLOCK_CAP]; // relative to the first line of the block
+};
+
+struct LineLocation {
+    s64 block;
+    s64 slot;
+    s64 line;
+    s64 start;
+    s64 length;
+};
+
+struct LineIndex {
+    Array<LineBlock *> blocks;
+    // fenwick trees over the per-block totals, 1-based
+    Array<s64> tree_bytes;
+    Array<s64> tree_lines;
+    s64 line_count;
+    s64 bytes;
+
+    // last lookup, reused while motion stays on the same line
+    LineLocation last;
+    b32 last_valid;
+};
+
+// walk over the old lines while many edits are spliced into the index in one pass
+struct LineSplice {
+    Array<LineBlock *> blocks; // the index being built
+    s64 block;                 // old line the walk is at
+    s64 slot;
+    s64 base;                  // old position of block
+    s64 pos;                   // old position consumed up to
+    s64 pending;               // bytes of the line still open
+};
+
+// @note Shared bytes
+// Storage a snapshot can hold on to after the live text has moved on. The last holder to let go
+// frees it, or unmaps it when it came from a file.
+struct SharedBytes {
+    volatile s32 refs;
+    u8 *data;
+    FileMap map;
+    char *remove_name; // the mapped file, deleted along with the mapping once it was moved aside
+};
+
+// @note Piece table
+// The original text is never written to; inserted text is appended to the add buffer and the
+// document is the in-order walk of a treap of pieces keyed by byte offset. Pieces are shared with
+// snapshots, an edit copies the ones it would change while a snapshot still holds them.
+struct Piece {
+    volatile s32 refs;
+    Piece *left;
+    Piece *right;
+    u32 priority;
+    b32 add;
+    s64 start;
+    s64 length;
+    s64 bytes; // subtree total
+};
+
+struct PieceTable {
+    SharedBytes *original;
+    s64 original_length;
+    u8 *add;
+    s64 add_count;
+    s64 add_capacity;
+    SharedBytes *add_shared; // the add buffer while a snapshot holds it, appends still go in place
+    Piece *root;
+    u32 seed;
+
+    // last contiguous span read, dropped on every edit
+    u8 *span;
+    s64 span_start;
+    s64 span_end;
+};
+
+// @note Rope
+// B+tree whose leaves hold up to ROPE_LEAF_SIZE bytes inline; every node caches its byte and
+// newline totals so offset and line lookups are a single descent. All leaves sit at the same depth.
+// Nodes are shared with snapshots like pieces are.
+#define ROPE_LEAF_SIZE 2048
+#define ROPE_LEAF_FILL 1536
+#define ROPE_FANOUT 16
+#define ROPE_FANOUT_FILL 12
+
+struct RopeNode {
+    volatile s32 refs;
+    s64 bytes;
+    s64 newlines;
+    b32 leaf;
+    s32 count; // children of an internal node
+    union {
+        RopeNode *children[ROPE_FANOUT];
+        u8 text[ROPE_LEAF_SIZE];
+    };
+};
+
+struct Rope {
+    RopeNode *root;
+
+    // last leaf read, dropped on every edit
+    u8 *span;
+    s64 span_start;
+    s64 span_end;
+};
+
+// @note Background line indexing
+// Large mapped files are scanned for newlines on a worker thread. The index holds the lines found
+// so far plus one pending line covering the rest of the text, and the main thread splits the
+// pending line as the worker hands over blocks of lines. Edits past the start of the pending line
+// only change its length, and the blocks they reach are scanned again from the edited text.
+#define LINE_INDEXER_CHUNK (4 * 1024 * 1024)
+
+// bytes [start, end) of the scanned text that an edit past the frontier turned into count bytes
+struct IndexerEdit {
+    s64 start;
+    s64 end;
+    s64 count;
+};
+
+struct LineIndexer {
+    Thread thread;
+    u8 *text; // never written while the worker runs
+    s64 count;
+
+    // guarded by mutex
+    Mutex mutex;
+    Array<LineBlock *> blocks; // complete lines not merged yet
+    s64 scanned;
+    b32 done;
+    b32 cancel;
+
+    // main thread only
+    s64 merged; // where the pending line starts in the scanned text
+    Array<IndexerEdit> edits; // sorted and apart
+    Array<LineBlock *> held; // found blocks an edit reaches past, waiting for the blocks after them
+};
+
+// Part of the text edited during a batch, old_* is where it sits in the text the line index still
+// describes. Windows are apart and sorted the way the edits ran, up or down the text.
+struct BatchWindow {
+    s64 start;
+    s64 end;
+    s64 old_start;
+    s64 old_end;
+};
+
+// @note Match index
+// Matches of the highlighted pattern for the parts of a text searched so far, kept up to date
+// through edits. See match_index.cpp.
+struct TextRange {
+    s64 start;
+    s64 end;
+};
+
+struct MatchIndex {
+    u64 pattern; // the Highlight id the matches are for, 0 before any
+    s64 reach;   // how far back from an edit matches can change
+    s64 length;  // of the text
+    // a gap array in position order, the matches after the gap store pos - length
+    StringMatch *matches;
+    s64 capacity;
+    s64 gap_start;
+    s64 gap_end;
+    Array<TextRange> covered; // where every match start is known, sorted and apart
+};
+
+// @note Match count
+// The highlighted pattern's matches counted per block of a text, kept through edits. See
+// match_count.cpp.
+struct CountBlock {
+    u64 id; // new for every block, so a count made for one is never taken by another
+    s64 length;
+    s64 from;    // where its search started, past the last match of the block before
+    s64 spill;   // how far past its end the search after its last match starts
+    s64 count;   // of the matches starting in it
+    u64 changed; // text version of the last edit near it
+    b32 dirty;   // edited since it was counted, or never counted
+    b32 counted;
+};
+
+struct MatchCount {
+    u64 pattern; // the Highlight id the counts are for, 0 before any
+    s64 reach;
+    Array<CountBlock> blocks; // in text order, at least one
+    u64 next_id;
+    u64 stamp; // bumped whenever a count changes
+
+    // where the cursor was among the matches when last worked out
+    s64 status_pos;
+    u64 status_version;
+    u64 status_stamp;
+    s64 before; // matches starting before it
+    b32 at_match;
+};
+
+enum TextBackend {
+    GapBackend,
+    PieceBackend,
+    RopeBackend,
+};
+
 struct TextBuffer {
+    TextBackend backend;
+
+    // gap buffer
     u8 *contents;
     s64 gap_start;
     s64 gap_end;
     s64 end;
-    Array<s64> line_bases;
+    SharedBytes *contents_shared; // contents while a snapshot holds them, copied before any edit
+
+    PieceTable pieces;
+
+    Rope rope;
+
+    // unused by the rope, which counts newlines itself
+    LineIndex lines;
+    LineIndexer *indexer; // null once the index is complete
+
+    // between text_begin_batch and text_end_batch edits only widen these windows and the index
+    // catches up once at the end
+    s32 batch_depth;
+    Array<BatchWindow> batch_windows;
+    s64 batch_shift; // bytes added by all windows
+
+    u64 version; // bumped by every edit
+
+    MatchIndex matches;
+    MatchCount counts;
+};
+
+// @note Snapshots
+// A frozen view of the text for readers off the main thread, taken in O(1). It holds references
+// to the storage the text had at the time: the pieces or rope nodes plus the bytes behind them, or
+// the gap buffer's whole block. Edits made afterwards copy whatever they would change while it is
+// still held.
+struct TextSnapshot {
+    TextBackend backend;
+    s64 length;
+    u64 version; // of the text it was taken from
+
+    // gap buffer
+    SharedBytes *contents;
+    s64 gap_start;
+    s64 gap_end;
+
+    // piece table
+    Piece *pieces;
+    SharedBytes *original;
+    SharedBytes *add;
+
+    RopeNode *rope;
+};
+
+// @note Background save
+// The worker writes a snapshot into a temp file and renames it over the target. When the target
+// is mapped by the buffer the main thread swaps the files, then the worker removes the old one.
+struct SaveJob {
+    Thread thread;
+    TextSnapshot *snapshot;
+    string file_name;
+    string temp_name;
+    string old_name;
+    b32 convert; // expand LF to CRLF
+    b32 replaces_map;
+    b32 removing_old;
+    f64 start;
+
+    // guarded by mutex
+    Mutex mutex;
+    s64 read; // of the snapshot
+    s64 written;
+    b32 done;
+    b32 ok;
+    b32 replaced;
+
+    // a save asked for while this one runs, started once it finishes
+    string next_file_name;
+};
+
+// @note Background search
+// A job looks for a regex in a snapshot on its own thread. Setting cancel makes it stop at the next
+// slice, it still has to be seen done before it can be freed.
+struct Regex;
+
+struct SearchJob {
+    Thread thread;
+    TextSnapshot *snapshot;
+    Regex *regex;
+    s64 from;   // searched to the end of the text, then from the start up to origin
+    s64 origin;
+    volatile b32 cancel;
+
+    // guarded by mutex
+    Mutex mutex;
+    b32 done;
+    StringMatch match;
+
+    SearchJob *next; // cancelled jobs still winding down
+};
+
+// @note Parallel search
+// Workers search chunks of a snapshot and the thread reading the matches merges them in order.
+struct SearchChunk {
+    s64 start;
+    s64 end; // matches starting in [start, end) belong to the chunk
+    Array<StringMatch> matches;
+    b32 stopped; // at its first match, others may follow
+    b32 done;    // guarded by the search's mutex
+};
+
+struct ParallelSearch {
+    TextSnapshot *snapshot;
+    string pattern;
+    s64 overlap; // bytes searched past the end of a chunk
+    b32 first_only;
+    SearchChunk *chunks;
+    s64 chunk_count;
+    Thread *threads;
+    s32 thread_count;
+    volatile b32 cancel;
+
+    // guarded by mutex
+    Mutex mutex;
+    Condition changed; // a chunk was searched or merged
+    s64 next_chunk;    // the next one a worker takes
+    s64 merging;       // workers keep at most PARALLEL_SEARCH_AHEAD chunks each ahead of it
+
+    // the merge, only touched by the thread reading matches
+    Regex *regex;
+    s64 next_start;  // where the search after the last match handed out starts
+    s64 match_index; // into the merging chunk
+    b32 ready;       // the merging chunk is done
+    b32 synced;      // its matches from match_index on are the ones that follow
+};
+
+// @note Background match count
+// A worker counts the dirty blocks of a text in a snapshot, in order, and the main thread takes
+// each count as it is done.
+struct Buffer;
+
+struct CountTask {
+    u64 id;
+    s64 start; // in the snapshot
+    s64 end;
+    b32 last;  // the last block also owns an empty match at the very end
+    s64 from;  // the spill of the block before, replaced by the worker when it counts that one too
+    s64 spill;
+    s64 count;
+};
+
+struct MatchCountJob {
+    Thread thread;
+    Buffer *buffer;
+    TextSnapshot *snapshot;
+    Regex *regex;
+    u64 pattern;
+    CountTask *tasks;
+    s64 task_count;
+    s64 taken; // tasks the main thread has taken
+    volatile b32 cancel;
+
+    // guarded by mutex
+    Mutex mutex;
+    s64 finished;
+};
+
+// @note Find in files
+// Each worker has its own queue of directories and takes from another's when it runs dry. Result
+// lines collect in output until the main thread moves them into the results buffer.
+struct GrepQueue {
+    Mutex mutex;
+    Array<string> directories; // full paths ending in '/'
+};
+
+// an open buffer searched in place of its file
+struct GrepBuffer {
+    string path; // full, with forward slashes
+    TextSnapshot *snapshot;
+};
+
+struct GrepJob;
+
+struct GrepWorker {
+    GrepJob *job;
+    s32 index;
+    Thread thread;
+    Regex *regex;
+    u8 *read_buffer;
+    StringBuilder lines; // for the file being searched
+};
+
+struct GrepJob {
+    string root; // full, ending in '/'
+    string pattern;
+    GrepWorker *workers;
+    s32 worker_count;
+    GrepQueue *queues;
+    GrepBuffer *buffers;
+    s64 buffer_count;
+    volatile b32 cancel;
+    f64 start;
+
+    // guarded by mutex
+    Mutex mutex;
+    Condition changed; // a directory was queued or walked
+    s64 queued;        // directories waiting in the queues
+    s64 walking;       // directories being read
+    s64 next_buffer;
+    s32 running;       // workers not through yet
+    StringBuilder output;
+    s64 files;
+    s64 binary_files;
+    s64 matched_files;
+    s64 matched_lines;
+};
+
+// @note Undo history
+// Records keep their text in one arena in record order, so dropping the oldest records frees a
+// prefix of it. Records undone together share a group.
+enum Edit {
+    Insertion = 1,
+    Deletion,
+    Replacement, // many ranges replaced at once, undone and redone together
+};
+
+// how a Replacement record's arena text starts for each range, followed by the removed bytes and
+// then the added ones
+struct ReplacedRange {
+    s64 start; // in the text before the replacement
+    s64 removed;
+    s64 added;
+};
+
+struct EditRecord {
+    Edit kind;
+    s64 pos;
+    s64 count;  // of the text, or of all the arena bytes of a Replacement
+    s64 offset; // of the text in the arena
+    u64 group;
+};
+
+struct History {
+    Array<EditRecord> records;
+    s64 first;   // records before it were dropped
+    s64 current; // records from here on were undone and can be redone
+
+    u8 *arena;
+    s64 arena_start;
+    s64 arena_end;
+    s64 arena_capacity;
 };
 
 struct Buffer {
@@ -109,6 +578,13 @@ struct Buffer {
 
     string default_directory;
     LineEnding line_ending;
+    // mapped files are not converted on open, so they are written back byte for byte
+    b32 raw_line_endings;
+
+    SaveJob *save; // null when no save is running
+    f64 saved_at;
+
+    History history;
 
     Buffer *next;
 };
@@ -123,12 +599,15 @@ struct View {
 
     Keymap *keymap;
 
-    s32 line_offset;
-    s32 col_offset;
+    s64 line_offset;
+    s64 col_offset;
 
     b32 select_active;
     Cursor select_cursor;
 
+    // cursors besides the primary one above, sorted by position and never at the same spot
+    Array<Selection> selections;
+
     b32 is_commandbuf;
 
     View *next;
@@ -149,6 +628,36 @@ struct RenderTarget {
     RenderBatch *current;
 };
 
+// @note Incremental search
+// Steps keep what each prefix of the pattern found, so typing on refines the last hit and deleting
+// goes back to one already found.
+struct SearchStep {
+    s64 count;      // pattern bytes
+    string literal; // the text the pattern stands for when it is plain, empty otherwise
+    StringMatch match;
+};
+
+struct IncrementalSearch {
+    View *view; // nullptr when no search is under way
+    Cursor origin; // hits are the nearest after it, wrapping around
+    s64 origin_line_offset;
+    u64 command_version; // of the command buffer last looked at
+    string pattern;      // the steps are for prefixes of it
+    Array<SearchStep> steps;
+    SearchJob *job; // for the whole pattern
+    SearchJob *retired;
+    string highlight_before; // highlighted again when the search is given up
+};
+
+// @note Highlighting
+// Every match of the last pattern searched for is highlighted in the views, found through each
+// text's match index.
+struct Highlight {
+    string pattern;
+    Regex *regex; // nullptr when nothing is highlighted
+    u64 id;       // bumped with every new pattern
+};
+
 struct Application {
     Buffer *buffer_list;
 
@@ -158,6 +667,14 @@ struct Application {
     View *command_view;
     b32 command_mode;
     Array<string> command_args;
+
+    IncrementalSearch incremental_search;
+    Highlight highlight;
+
+    MatchCountJob *match_count; // null when no count is running
+
+    GrepJob *grep;          // null when no find in files is running
+    Buffer *grep_results;   // lines of path:line:col: text
 };
 
 typedef void (*CommandProc)(Application *);
@@ -212,17 +729,6 @@ struct Keymap {
     }
 };
 
-enum Edit {
-    Insertion = 1,
-    Deletion,
-};
-
-struct EditRecord {
-    Edit kind;
-    s64 pos;
-    StringBuilder text;
-};
-
 internal Color rgb_to_color(u32 rgb);
 
 #endif // CODEX_H
@@ -1,7 +1,5 @@
-inline internal string string_make(char *data, int count);
+inline internal string string_make(char *data, s64 count);
 internal void free_string(string *s);
-internal f32 get_string_width(string s, FontAtlas *atlas);
-internal string get_line_string(Buffer *buffer, s32 line);
 inline internal u8 char_from_pos(Buffer *buffer, s64 pos);
 internal string buffer_text(Buffer *buffer);
 internal void append(StringBuilder *builder, string s);
@@ -115,6 +113,190 @@ internal void draw_text(RenderTarget *target, string text, FontAtlas *atlas, Vec
     }
 }
 
+// @note Viewport
+// A view lays out only the rows it shows, reading each one straight out of the text's storage, and
+// a row stops at the right edge of the view. A frame costs what fits in the window whatever the
+// size of the file.
+
+// how far past a row cut off at the right edge the next one is looked for when the line index
+// does not know where it starts yet
+#define DRAW_ROW_SCAN (64 * 1024)
+
+// the atlas holds ASCII, other bytes show as '?'
+inline internal u8 atlas_char(u8 c) {
+    return c < 128 ? c : '?';
+}
+
+// Lays out [start, end) of one row from *x, stopping at a newline or at the first byte drawn at or
+// past right. Returns where it stopped, *x is where that byte is drawn.
+internal s64 layout_row(TextBuffer *text, FontAtlas *atlas, s64 start, s64 end, f32 *x, f32 right) {
+    for (s64 pos = start; pos < end; ) {
+        s64 count;
+        u8 *span = text_span(text, pos, &count);
+        if (count > end - pos) count = end - pos;
+        for (s64 i = 0; i < count; i++) {
+            if (span[i] == '\n' || *x >= right) return pos + i;
+            *x += atlas->glyphs[atlas_char(span[i])].ax;
+        }
+        pos += count;
+    }
+    return end;
+}
+
+// the first newline in [pos, end), or -1
+internal s64 find_newline(TextBuffer *text, s64 pos, s64 end) {
+    while (pos < end) {
+        s64 count;
+        u8 *span = text_span(text, pos, &count);
+        if (count > end - pos) count = end - pos;
+        u8 *found = (u8 *)memchr(span, '\n', count);
+        if (found) return pos + (found - span);
+        pos += count;
+    }
+    return -1;
+}
+
+// The part of each row of the view that is in view, from the first one down
+internal void view_rows(View *view, FontAtlas *atlas, Array<TextRange> *rows) {
+    Buffer *buffer = view->buffer;
+    TextBuffer *text = buffer->text;
+    s64 length = buffer_length(buffer);
+    s64 line_count = get_line_count(buffer);
+    s64 line = clamp(view->line_offset, 0, line_count - 1);
+    f32 right = view->rect.x1 - view->rect.x0;
+    s64 pos = get_line_pos(buffer, line);
+    for (s32 row = 0; row <= view->lines; row++, line++) {
+        f32 x = 0.0f;
+        if (line + 1 < line_count) {
+            s64 next = get_line_pos(buffer, line + 1);
+            rows->push({pos, layout_row(text, atlas, pos, next, &x, right)});
+            pos = next;
+            continue;
+        }
+        s64 stop = layout_row(text, atlas, pos, length, &x, right);
+        rows->push({pos, stop});
+        // the pending line of an index still being built holds the rest of the text, and its own
+        // newlines split it into rows
+        if (text->indexer == nullptr || stop == length) break;
+        s64 scan_end = stop + DRAW_ROW_SCAN < length ? stop + DRAW_ROW_SCAN : length;
+        s64 newline = find_newline(text, stop, scan_end);
+        if (newline < 0) break;
+        pos = newline + 1;
+    }
+}
+
+// Marks the parts of the matches inside row, which is laid out from position and cut off at right.
+// Matches come in order.
+internal void draw_matches(RenderTarget *target, FontAtlas *atlas, TextBuffer *text, TextRange row, Array<StringMatch> &matches, Vector2 position, f32 right) {
+    s64 pos = row.start;
+    f32 x = 0.0f;
+    for (StringMatch match : matches) {
+        s64 start = match.pos > pos ? match.pos : pos;
+        s64 end = match.pos + match.count < row.end ? match.pos + match.count : row.end;
+        if (end <= start) continue;
+        layout_row(text, atlas, pos, start, &x, right);
+        f32 from = x;
+        layout_row(text, atlas, start, end, &x, right);
+        pos = end;
+        draw_rectangle(target, {position.x + from, position.y, position.x + x, position.y + atlas->glyph_height}, theme_match);
+    }
+}
+
+// Draws row, laid out from position, the way draw_text draws a line
+internal void draw_row(RenderTarget *target, FontAtlas *atlas, TextBuffer *text, TextRange row, Vector2 position, Color color) {
+    set_texture(target, atlas->id);
+    f32 x = 0.0f;
+    for (s64 pos = row.start; pos < row.end; ) {
+        s64 count;
+        u8 *span = text_span(text, pos, &count);
+        if (count > row.end - pos) count = row.end - pos;
+        for (s64 i = 0; i < count; i++) {
+            u8 c = atlas_char(span[i]);
+            FontGlyph glyph = atlas->glyphs[c];
+            // blanks have nothing to draw
+            if (glyph.bx > 0.0f) {
+                Vector2 p = Vector2(position.x + x + glyph.bl, position.y - glyph.bt + glyph.by + atlas->ascend);
+                draw_glyph(target, atlas, p, c, color);
+            }
+            x += glyph.ax;
+        }
+        pos += count;
+    }
+}
+
+// Only the lines of the selection in view are drawn
+internal void draw_selection(RenderTarget *target, View *view, FontAtlas *atlas, Cursor start, Cursor end) {
+    if (end.pos < start.pos) {
+        Cursor temp = start;
+        start = end;
+        end = temp;
+    }
+    TextBuffer *text = view->buffer->text;
+    s64 length = buffer_length(view->buffer);
+    f32 right = view->rect.x1 - view->rect.x0;
+    s64 top = view->line_offset;
+    s64 bottom = view->line_offset + view->lines;
+
+    if (start.line >= top && start.line <= bottom) {
+        f32 width = 0.0f;
+        layout_row(text, atlas, start.pos, length, &width, right);
+        f32 x = 0.0f;
+        f32 y = (start.line - top) * atlas->glyph_height;
+        draw_rectangle(target, {x, y, x + width, y + atlas->glyph_height}, theme_select);
+    }
+
+    s64 first = start.line + 1 > top ? start.line + 1 : top;
+    s64 last = end.line < bottom + 1 ? end.line : bottom + 1;
+    for (s64 line = first; line < last; line++) {
+        Rect r{};
+        r.x0 = view->rect.x0;
+        r.x1 = view->rect.x1;
+        r.y0 = view->rect.y0 + (line - top) * atlas->glyph_height;
+        r.y1 = r.y0 + atlas->glyph_height;
+        draw_rectangle(target, r, theme_select);
+
+        s64 pos = get_line_pos(view->buffer, line);
+        f32 x = 0.0f;
+        TextRange row = {pos, layout_row(text, atlas, pos, length, &x, right)};
+        draw_row(target, atlas, text, row, Vector2(r.x0, r.y0), theme_background);
+    }
+
+    if (end.line >= top && end.line <= bottom) {
+        f32 width = 0.0f;
+        layout_row(text, atlas, end.pos - end.col, end.pos, &width, right);
+        f32 x0 = 0.0f;
+        f32 y = (end.line - top) * atlas->glyph_height;
+        draw_rectangle(target, {x0, y, x0 + width, y + atlas->glyph_height}, theme_select);
+    }
+}
+
+// cursor bg and fg
+internal void draw_cursor(RenderTarget *target, View *view, FontAtlas *atlas, Cursor cursor) {
+    f32 x = 0.0f;
+    // a cursor past the right edge is out of view
+    if (layout_row(view->buffer->text, atlas, cursor.pos - cursor.col, cursor.pos, &x, view->rect.x1 - view->rect.x0) < cursor.pos) return;
+    float cursor_x = view->rect.x0 + x;
+    float cursor_y = view->rect.y0 + cursor.line * atlas->glyph_height;
+    cursor_y -= view->line_offset * atlas->glyph_height;
+    u8 c = buffer_length(view->buffer) > 0 ? atlas_char(char_from_pos(view->buffer, cursor.pos)) : ' ';
+    float cursor_width = atlas->glyphs[c].ax;
+    if (cursor_width == 0.0f) cursor_width = atlas->glyphs[' '].ax;
+    Rect cursor_rect = {cursor_x, cursor_y, cursor_x + cursor_width, cursor_y + atlas->glyph_height};
+    draw_rectangle(target, cursor_rect, theme_cursor);
+    draw_text(target, string_make((char *)&c, 1), atlas, Vector2(), Vector2(cursor_x, cursor_y), theme_foreground);
+}
+
+inline internal bool cursor_visible(View *view, Cursor cursor) {
+    return cursor.line >= view->line_offset && cursor.line <= view->line_offset + view->lines;
+}
+
+// a selection can cover the view with both of its ends outside it
+inline internal bool selection_visible(View *view, Cursor a, Cursor b) {
+    s64 first = a.line < b.line ? a.line : b.line;
+    s64 last = a.line < b.line ? b.line : a.line;
+    return first <= view->line_offset + view->lines && last >= view->line_offset;
+}
+
 internal void draw_view(RenderTarget *target, View *view, FontAtlas *atlas) {
     // background
     if (view->is_commandbuf) {
@@ -129,90 +311,80 @@ internal void draw_view(RenderTarget *target, View *view, FontAtlas *atlas) {
         draw_rectangle(target, {view->rect.x0, y, view->rect.x1, y + atlas->glyph_height}, theme_line);
     }
 
-    // text
-    string text = buffer_text(view->buffer);
-    if (view->is_commandbuf) {
-        draw_text(target, text, atlas, Vector2(0.0f, view->line_offset * atlas->glyph_height), Vector2(view->rect.x0, view->rect.y0), theme_commandbuf_fg);
-    } else {
-        draw_text(target, text, atlas, Vector2(0.0f, view->line_offset * atlas->glyph_height), Vector2(view->rect.x0, view->rect.y0), theme_foreground);
-    }
-    free_string(&text);
-
-    // selection
-    if (view->select_active) {
-        Cursor start = view->cursor;
-        Cursor end = view->select_cursor;
-        if (end.pos < start.pos) {
-            Cursor temp = start;
-            start = end;
-            end = temp;
-        }
-
-        {
-            string s = get_line_string(view->buffer, start.line);
-            string shift = {s.data + start.col, s.count - start.col};
-            f32 x = 0.0f;
-            f32 y = (start.line * atlas->glyph_height) - (view->line_offset * atlas->glyph_height);
-            f32 width = get_string_width(shift, atlas);
-            free_string(&s);
-            draw_rectangle(target, {x, y, x + width, y + atlas->glyph_height}, theme_select);
+    // text, row by row out of the buffer's own storage
+    {
+        Buffer *buffer = view->buffer;
+        Array<TextRange> rows{};
+        view_rows(view, atlas, &rows);
+        s64 first = clamp(view->line_offset, 0, get_line_count(buffer) - 1);
+        f32 y = view->rect.y0 + (first - view->line_offset) * atlas->glyph_height;
+        if (!view->is_commandbuf) {
+            Array<StringMatch> matches{};
+            for (s64 i = 0; i < (s64)rows.count; i++) {
+                TextRange row = rows.data[i];
+                if (row.end == row.start) continue;
+                matches.count = 0;
+                buffer_highlights(application, buffer, row.start, row.end, &matches);
+                draw_matches(target, atlas, buffer->text, row, matches, Vector2(view->rect.x0, y + i * atlas->glyph_height), view->rect.x1 - view->rect.x0);
+            }
+            matches.clear();
         }
-
-        for (int line = start.line + 1; line < end.line; line++) {
-            Rect r{};
-            r.x0 = view->rect.x0;
-            r.x1 = view->rect.x1;
-            r.y0 = view->rect.y0 + (line * atlas->glyph_height) - (view->line_offset * atlas->glyph_height);
-            r.y1 = r.y0 + atlas->glyph_height;
-            float y = (line * atlas->glyph_height) - (view->line_offset * atlas->glyph_height);
-            draw_rectangle(target, r, theme_select);
-
-            string s = get_line_string(view->buffer, line);
-            draw_text(target, s, atlas, Vector2(0.0f, view->line_offset * atlas->glyph_height), Vector2(view->rect.x0, view->rect.y0 + (line - view->line_offset) * atlas->glyph_height), theme_background);
-            free_string(&s);
+        Color color = view->is_commandbuf ? theme_commandbuf_fg : theme_foreground;
+        for (s64 i = 0; i < (s64)rows.count; i++) {
+            draw_row(target, atlas, buffer->text, rows.data[i], Vector2(view->rect.x0, y + i * atlas->glyph_height), color);
         }
+        rows.clear();
+    }
 
-        {
-            string s = get_line_string(view->buffer, end.line);
-            assert(end.col < s.count);
-            string shift = {s.data, end.col};
-            f32 y = (end.line * atlas->glyph_height) - (view->line_offset * atlas->glyph_height);
-            f32 x0 = 0.0f;
-            f32 x1 = x0 + get_string_width(shift, atlas);
-            draw_rectangle(target, {x0, y, x1, y + atlas->glyph_height}, theme_select);
-            free_string(&s);
+    // selections
+    if (view->select_active) {
+        draw_selection(target, view, atlas, view->cursor, view->select_cursor);
+        for (Selection &selection : view->selections) {
+            if (selection_visible(view, selection.cursor, selection.select_cursor)) {
+                draw_selection(target, view, atlas, selection.cursor, selection.select_cursor);
+            }
         }
     }
 
-    // cursor bg and fg
-    float cursor_x = view->rect.x0;
-    float cursor_y = view->rect.y0 + view->cursor.line * atlas->glyph_height;
-    cursor_y -= view->line_offset * atlas->glyph_height;
-    for (s64 pos = view->cursor.pos - view->cursor.col; pos < view->cursor.pos; pos++) {
-        u8 c = char_from_pos(view->buffer, pos);
-        FontGlyph glyph = atlas->glyphs[c];
-        cursor_x += glyph.ax;
+    // cursors
+    for (Selection &selection : view->selections) {
+        if (cursor_visible(view, selection.cursor)) {
+            draw_cursor(target, view, atlas, selection.cursor);
+        }
     }
-    u8 c = view->buffer->text->contents ? char_from_pos(view->buffer, view->cursor.pos) : ' ';
-    float cursor_width = atlas->glyphs[c].ax;
-    if (cursor_width == 0.0f) cursor_width = atlas->glyphs[' '].ax;
-    Rect cursor_rect = {cursor_x, cursor_y, cursor_x + cursor_width, cursor_y + atlas->glyph_height};
-    draw_rectangle(target, cursor_rect, theme_cursor);
-    draw_text(target, string_make((char *)&c, 1), atlas, Vector2(), Vector2(cursor_x, cursor_y), theme_foreground);
+    draw_cursor(target, view, atlas, view->cursor);
 
     // file bar
     if (view->buffer->file_name.count > 0) {
         draw_rectangle(target, {0, (float)target->height - atlas->glyph_height, (float)target->width, (float)target->height}, theme_commandbuf_bg);
         StringBuilder builder{};
         append(&builder, view->buffer->file_name);
-        int line = view->cursor.line + 1;
-        int col = view->cursor.col;
-        size_t n = snprintf(NULL, 0, "  (%d, %d)", line, col);
+        long long line = view->cursor.line + 1;
+        long long col = view->cursor.col;
+        size_t n = snprintf(NULL, 0, "  (%lld, %lld)", line, col);
         char *buf = (char *)malloc(n + 1);
-        snprintf(buf, n + 1, "  (%d, %d)", line, col);
-        append(&builder, string_make(buf, (int)n));
+        snprintf(buf, n + 1, "  (%lld, %lld)", line, col);
+        append(&builder, string_make(buf, (s64)n));
+        free(buf);
+
+        match_status(application, view, &builder);
+
+        if (view->buffer->text->indexer) {
+            char progress[32];
+            snprintf(progress, sizeof(progress), "  indexing %lld%%", (long long)line_indexer_percent(view->buffer->text->indexer));
+            append(&builder, string_make(progress));
+        }
+
+        if (view->buffer->save && !view->buffer->save->removing_old) {
+            char progress[32];
+            snprintf(progress, sizeof(progress), "  saving %lld%%", (long long)save_percent(view->buffer->save));
+            append(&builder, string_make(progress));
+        } else if (view->buffer->saved_at > 0 && os_seconds() - view->buffer->saved_at < 2.0) {
+            char saved[] = "  saved";
+            append(&builder, string_make(saved));
+        }
 
-        draw_text(target, string_make(builder.data, (int)builder.count), atlas, Vector2(), Vector2(0.0f, (float)target->height - atlas->glyph_height), theme_commandbuf_fg);
+        draw_text(target, string_make(builder.data, (s64)builder.count), atlas, Vector2(), Vector2(0.0f, (float)target->height - atlas->glyph_height), theme_commandbuf_fg);
 
         free_builder(&builder);
     }
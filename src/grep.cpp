@@ -0,0 +1,388 @@
+// @note Find in files
+// Workers walk the tree and search what they find as they go. A directory's files are searched by
+// the worker that listed it and its subdirectories go on that worker's queue. A worker takes the
+// newest directory from its own queue, which keeps the walk depth first and the queues short, and
+// the oldest from another's when its own runs dry, which hands over the biggest part of the tree
+// still untouched. Small files are read whole into a buffer the worker keeps, larger ones are
+// mapped. A zero byte near the start marks a file as binary and nothing more of it is looked at.
+//
+// Open buffers under the root are searched from snapshots before the walk, and the walk skips
+// their files, so results show unsaved edits. Each matching line gives one result line.
+
+#define GREP_READ_SIZE (1024 * 1024) // files up to this size are read, larger ones mapped
+#define GREP_BINARY_SAMPLE 8000      // bytes looked at for a zero
+#define GREP_LINE_MAX 256            // of a matching line shown in its result
+
+internal string string_make(char *str, s64 count);
+internal void append(StringBuilder *builder, string s);
+internal void free_builder(StringBuilder *b);
+
+// directory + name, with a '/' on the end for a directory
+internal string grep_path(string directory, char *name, bool is_directory) {
+    s64 count = (s64)strlen(name);
+    string path;
+    path.count = directory.count + count + (is_directory ? 1 : 0);
+    path.data = (char *)malloc(path.count + 1);
+    memcpy(path.data, directory.data, directory.count);
+    memcpy(path.data + directory.count, name, count);
+    if (is_directory) path.data[path.count - 1] = '/';
+    path.data[path.count] = '\0';
+    return path;
+}
+
+// the path as the results show it, relative to the root
+inline internal string grep_name(GrepJob *job, string path) {
+    return string_make(path.data + job->root.count, path.count - job->root.count);
+}
+
+inline internal bool grep_same_path(string a, string b) {
+    if (a.count != b.count) return false;
+#ifdef _WIN32
+    return _strnicmp(a.data, b.data, a.count) == 0;
+#else
+    return memcmp(a.data, b.data, a.count) == 0;
+#endif
+}
+
+internal bool grep_is_open(GrepJob *job, string path) {
+    for (s64 i = 0; i < job->buffer_count; i++) {
+        if (grep_same_path(job->buffers[i].path, path)) return true;
+    }
+    return false;
+}
+
+// the start of the line holding pos, looking back no further than floor
+internal s64 grep_line_start(TextSnapshot *snapshot, s64 pos, s64 floor) {
+    u8 chunk[256];
+    while (pos > floor) {
+        s64 from = pos - (s64)sizeof(chunk) > floor ? pos - (s64)sizeof(chunk) : floor;
+        text_snapshot_read(snapshot, from, pos, chunk);
+        for (s64 i = pos - from - 1; i >= 0; i--) {
+            if (chunk[i] == '\n') return from + i + 1;
+        }
+        pos = from;
+    }
+    return floor;
+}
+
+// the '\n' ending the line holding pos, or the end of the text
+internal s64 grep_line_end(TextSnapshot *snapshot, s64 pos) {
+    while (pos < snapshot->length) {
+        s64 count;
+        u8 *span = text_snapshot_span(snapshot, pos, &count);
+        u8 *found = (u8 *)memchr(span, '\n', count);
+        if (found) return pos + (found - span);
+        pos += count;
+    }
+    return snapshot->length;
+}
+
+internal s64 grep_count_lines(TextSnapshot *snapshot, s64 start, s64 end) {
+    s64 lines = 0;
+    for (s64 pos = start; pos < end; ) {
+        s64 count;
+        u8 *span = text_snapshot_span(snapshot, pos, &count);
+        if (count > end - pos) count = end - pos;
+        lines += newline_count(span, count);
+        pos += count;
+    }
+    return lines;
+}
+
+// Adds a result line to the worker's lines for every line with a match, returns how many. Lines are
+// only counted up to each match, so a file with few matches costs little more than the search.
+internal s64 grep_search_text(GrepWorker *worker, string name, TextSnapshot *snapshot) {
+    s64 length = snapshot->length;
+    s64 matched = 0;
+    s64 line = 0;       // of counted
+    s64 line_start = 0; // of the line counted is on
+    s64 counted = 0;
+    while (counted <= length) {
+        StringMatch match = regex_find(worker->regex, snapshot, counted, length);
+        if (match.pos < 0) break;
+        s64 newlines = grep_count_lines(snapshot, counted, match.pos);
+        if (newlines > 0) {
+            line += newlines;
+            line_start = grep_line_start(snapshot, match.pos, counted);
+        }
+        s64 line_end = grep_line_end(snapshot, match.pos);
+
+        u8 text[GREP_LINE_MAX];
+        s64 count = line_end - line_start < GREP_LINE_MAX ? line_end - line_start : GREP_LINE_MAX;
+        text_snapshot_read(snapshot, line_start, line_start + count, text);
+        if (count > 0 && text[count - 1] == '\r') count--;
+        char location[64];
+        int location_count = snprintf(location, sizeof(location), ":%lld:%lld: ", (long long)line + 1, (long long)(match.pos - line_start + 1));
+        append(&worker->lines, name);
+        append(&worker->lines, string_make(location, location_count));
+        append(&worker->lines, string_make((char *)text, count));
+        append(&worker->lines, CONSTZ("\n"));
+        matched++;
+
+        // one result per line, the search goes on from the next
+        line++;
+        line_start = line_end + 1;
+        counted = line_start;
+    }
+    return matched;
+}
+
+// hands the lines of the file just searched to the main thread
+internal void grep_flush(GrepWorker *worker, bool binary, s64 matched) {
+    GrepJob *job = worker->job;
+    os_mutex_lock(&job->mutex);
+    job->files++;
+    if (binary) job->binary_files++;
+    if (matched > 0) job->matched_files++;
+    job->matched_lines += matched;
+    if (worker->lines.count > 0) {
+        append(&job->output, string_make(worker->lines.data, worker->lines.count));
+    }
+    os_mutex_unlock(&job->mutex);
+    worker->lines.count = 0;
+}
+
+internal void grep_file(GrepWorker *worker, string path, s64 size) {
+    GrepJob *job = worker->job;
+    if (grep_is_open(job, path)) return;
+    FileMap map{};
+    u8 *data;
+    s64 count;
+    if (size <= GREP_READ_SIZE) {
+        count = os_read_file(path.data, worker->read_buffer, size);
+        if (count < 0) return;
+        data = worker->read_buffer;
+    } else {
+        if (!os_map_file(path.data, &map)) return;
+        data = map.data;
+        count = map.size;
+    }
+
+    bool binary = count > 0 && memchr(data, 0, count < GREP_BINARY_SAMPLE ? count : GREP_BINARY_SAMPLE) != nullptr;
+    s64 matched = 0;
+    if (!binary) {
+        TextSnapshot snapshot;
+        SharedBytes shared;
+        text_snapshot_bytes(&snapshot, &shared, data, count);
+        matched = grep_search_text(worker, grep_name(job, path), &snapshot);
+    }
+    os_unmap_file(&map);
+    grep_flush(worker, binary, matched);
+}
+
+internal void grep_push_directory(GrepWorker *worker, string path) {
+    GrepJob *job = worker->job;
+    GrepQueue *queue = &job->queues[worker->index];
+    os_mutex_lock(&queue->mutex);
+    queue->directories.push(path);
+    os_mutex_unlock(&queue->mutex);
+
+    os_mutex_lock(&job->mutex);
+    job->queued++;
+    os_condition_wake_all(&job->changed);
+    os_mutex_unlock(&job->mutex);
+}
+
+internal bool grep_queue_pop(GrepQueue *queue, bool newest, string *path) {
+    os_mutex_lock(&queue->mutex);
+    bool found = queue->directories.count > 0;
+    if (found) {
+        if (newest) {
+            *path = queue->directories.data[--queue->directories.count];
+        } else {
+            *path = queue->directories.data[0];
+            queue->directories.remove(0, 1);
+        }
+    }
+    os_mutex_unlock(&queue->mutex);
+    return found;
+}
+
+// false once every directory is walked or the job is cancelled
+internal bool grep_take_directory(GrepWorker *worker, string *path) {
+    GrepJob *job = worker->job;
+    for (;;) {
+        if (search_cancelled(&job->cancel)) return false;
+        bool found = grep_queue_pop(&job->queues[worker->index], true, path);
+        for (s32 i = 1; i < job->worker_count && !found; i++) {
+            found = grep_queue_pop(&job->queues[(worker->index + i) % job->worker_count], false, path);
+        }
+        if (found) break;
+
+        // nothing to steal, but a directory being walked may still queue more
+        os_mutex_lock(&job->mutex);
+        while (!search_cancelled(&job->cancel) && job->queued == 0 && job->walking > 0) {
+            os_condition_wait(&job->changed, &job->mutex);
+        }
+        bool finished = job->queued == 0 && job->walking == 0;
+        os_mutex_unlock(&job->mutex);
+        if (finished) return false;
+    }
+    os_mutex_lock(&job->mutex);
+    job->queued--;
+    job->walking++;
+    os_mutex_unlock(&job->mutex);
+    return true;
+}
+
+internal void grep_directory(GrepWorker *worker, string path) {
+    GrepJob *job = worker->job;
+    // listed without the '/' on the end, except for a root like "/"
+    xp_path dir = {(unsigned char *)path.data, (int)(path.count > 1 ? path.count - 1 : path.count)};
+    xp_directory directory;
+    bool listed = xp_directory_new(dir, &directory);
+    // A directory whose full path is not the one it was reached by is a link, which could lead
+    // back up the tree. xp_fullpath hands back the path it was given when it cannot resolve it.
+    bool linked = directory.path.data != dir.data && (directory.path.count != dir.count || memcmp(directory.path.data, dir.data, dir.count) != 0);
+    if (directory.path.data == dir.data) directory.path.data = nullptr;
+    for (int i = 0; listed && !linked && i < directory.file_count && !search_cancelled(&job->cancel); i++) {
+        xp_file *file = &directory.files[i];
+        // hidden entries, which takes in "." and ".." and version control directories
+        if (file->name[0] == '.') continue;
+        if (file->attributes & XP_DIRECTORY) {
+            grep_push_directory(worker, grep_path(path, file->name, true));
+        } else {
+            string file_path = grep_path(path, file->name, false);
+            grep_file(worker, file_path, (s64)file->bytes);
+            free(file_path.data);
+        }
+    }
+    xp_directory_free(&directory);
+}
+
+internal void grep_run(void *data) {
+    GrepWorker *worker = (GrepWorker *)data;
+    GrepJob *job = worker->job;
+    for (;;) {
+        os_mutex_lock(&job->mutex);
+        s64 index = job->next_buffer < job->buffer_count ? job->next_buffer++ : -1;
+        os_mutex_unlock(&job->mutex);
+        if (index < 0 || search_cancelled(&job->cancel)) break;
+        GrepBuffer *buffer = &job->buffers[index];
+        s64 matched = grep_search_text(worker, grep_name(job, buffer->path), buffer->snapshot);
+        // let go as soon as possible, the buffer's next edit may be waiting to reuse its block
+        text_snapshot_free(buffer->snapshot);
+        buffer->snapshot = nullptr;
+        grep_flush(worker, false, matched);
+    }
+
+    string path;
+    while (grep_take_directory(worker, &path)) {
+        grep_directory(worker, path);
+        free(path.data);
+        os_mutex_lock(&job->mutex);
+        job->walking--;
+        if (job->queued == 0 && job->walking == 0) os_condition_wake_all(&job->changed);
+        os_mutex_unlock(&job->mutex);
+    }
+
+    os_mutex_lock(&job->mutex);
+    job->running--;
+    os_mutex_unlock(&job->mutex);
+}
+
+// Searches every file under root, which is a full path ending in '/', for the regex pattern on
+// thread_count workers. Takes ownership of root and of the buffers and their snapshots, also when
+// the pattern is bad, in which case it returns nullptr and sets error.
+internal GrepJob *grep_start(string pattern, string root, GrepBuffer *buffers, s64 buffer_count, s32 thread_count, const char **error) {
+    Regex *first = regex_compile((u8 *)pattern.data, pattern.count, error);
+    if (first == nullptr) {
+        for (s64 i = 0; i < buffer_count; i++) {
+            free(buffers[i].path.data);
+            text_snapshot_free(buffers[i].snapshot);
+        }
+        free(buffers);
+        free(root.data);
+        return nullptr;
+    }
+    GrepJob *job = (GrepJob *)malloc(sizeof(GrepJob));
+    block_zero(job, sizeof(GrepJob));
+    job->root = root;
+    job->pattern.data = (char *)malloc(pattern.count + 1);
+    memcpy(job->pattern.data, pattern.data, pattern.count);
+    job->pattern.data[pattern.count] = '\0';
+    job->pattern.count = pattern.count;
+    job->buffers = buffers;
+    job->buffer_count = buffer_count;
+    job->start = os_seconds();
+    os_mutex_init(&job->mutex);
+    os_condition_init(&job->changed);
+
+    job->worker_count = thread_count > 0 ? thread_count : 1;
+    job->queues = (GrepQueue *)malloc(job->worker_count * sizeof(GrepQueue));
+    block_zero(job->queues, job->worker_count * sizeof(GrepQueue));
+    for (s32 i = 0; i < job->worker_count; i++) {
+        os_mutex_init(&job->queues[i].mutex);
+    }
+    job->queues[0].directories.push(grep_path(root, (char *)"", false));
+    job->queued = 1;
+
+    // each worker compiles its own, a regex keeps its state cache to itself
+    job->workers = (GrepWorker *)malloc(job->worker_count * sizeof(GrepWorker));
+    block_zero(job->workers, job->worker_count * sizeof(GrepWorker));
+    job->running = job->worker_count;
+    for (s32 i = 0; i < job->worker_count; i++) {
+        GrepWorker *worker = &job->workers[i];
+        worker->job = job;
+        worker->index = i;
+        worker->regex = i == 0 ? first : regex_compile((u8 *)pattern.data, pattern.count, error);
+        regex_set_cancel(worker->regex, &job->cancel);
+        worker->read_buffer = (u8 *)malloc(GREP_READ_SIZE);
+    }
+    for (s32 i = 0; i < job->worker_count; i++) {
+        job->workers[i].thread = os_thread_start(grep_run, &job->workers[i]);
+    }
+    return job;
+}
+
+internal bool grep_done(GrepJob *job) {
+    os_mutex_lock(&job->mutex);
+    bool done = job->running == 0;
+    os_mutex_unlock(&job->mutex);
+    return done;
+}
+
+// result lines found since the last call, the caller frees them
+internal string grep_take_output(GrepJob *job) {
+    os_mutex_lock(&job->mutex);
+    string output = string_make(job->output.data, (s64)job->output.count);
+    job->output = {};
+    os_mutex_unlock(&job->mutex);
+    return output;
+}
+
+// cancels the job if it is still running
+internal void grep_free(GrepJob *job) {
+    os_atomic_store(&job->cancel, true);
+    os_mutex_lock(&job->mutex);
+    os_condition_wake_all(&job->changed);
+    os_mutex_unlock(&job->mutex);
+    for (s32 i = 0; i < job->worker_count; i++) {
+        GrepWorker *worker = &job->workers[i];
+        os_thread_join(worker->thread);
+        regex_free(worker->regex);
+        free(worker->read_buffer);
+        free_builder(&worker->lines);
+    }
+    for (s32 i = 0; i < job->worker_count; i++) {
+        GrepQueue *queue = &job->queues[i];
+        for (string &directory : queue->directories) {
+            free(directory.data);
+        }
+        queue->directories.clear();
+        os_mutex_free(&queue->mutex);
+    }
+    for (s64 i = 0; i < job->buffer_count; i++) {
+        free(job->buffers[i].path.data);
+        if (job->buffers[i].snapshot) text_snapshot_free(job->buffers[i].snapshot);
+    }
+    free(job->buffers);
+    free(job->workers);
+    free(job->queues);
+    free_builder(&job->output);
+    free(job->root.data);
+    free(job->pattern.data);
+    os_condition_free(&job->changed);
+    os_mutex_free(&job->mutex);
+    free(job);
+}
@@ -0,0 +1,226 @@
+// @note Undo history
+// Edits are recorded before they reach the text. An insert that continues the last record of the
+// same group extends it, so typing a word or inserting a block undoes with one backend call. An
+// edit at many places is one record, undone range by range inside the batch the undo opens, or
+// by rebuilding the text once when its ranges are as dense as a replace would rebuild for.
+// Once the history holds more than undo_budget bytes the oldest groups are dropped.
+
+global s64 undo_budget = 64 * 1024 * 1024;
+// bumped per command, records made while one command runs share it
+global u64 edit_group = 1;
+
+inline internal s64 history_bytes(History *history) {
+    s64 records = (s64)history->records.count - history->first;
+    return history->arena_end - history->arena_start + records * (s64)sizeof(EditRecord);
+}
+
+internal void history_reserve(History *history, s64 count) {
+    if (history->arena_end + count <= history->arena_capacity) return;
+    // slide the live text down rather than grow while most of the arena has been dropped
+    if (history->arena_start > 0 && history->arena_start >= history->arena_capacity / 2) {
+        s64 start = history->arena_start;
+        memmove(history->arena, history->arena + start, history->arena_end - start);
+        for (s64 i = history->first; i < (s64)history->records.count; i++) {
+            history->records.data[i].offset -= start;
+        }
+        history->arena_start = 0;
+        history->arena_end -= start;
+        if (history->arena_end + count <= history->arena_capacity) return;
+    }
+    s64 capacity = history->arena_capacity * 2;
+    if (capacity < history->arena_end + count) capacity = history->arena_end + count;
+    if (capacity < 4096) capacity = 4096;
+    history->arena = (u8 *)realloc(history->arena, capacity);
+    history->arena_capacity = capacity;
+}
+
+// a new edit forgets what was undone
+internal void history_drop_redo(History *history) {
+    if (history->current == (s64)history->records.count) return;
+    history->records.count = history->current;
+    if (history->current > history->first) {
+        EditRecord *last = &history->records.data[history->current - 1];
+        history->arena_end = last->offset + last->count;
+    } else {
+        history->arena_end = history->arena_start;
+    }
+}
+
+internal void history_trim(History *history) {
+    while (history->first < history->current && history_bytes(history) > undo_budget) {
+        u64 group = history->records.data[history->first].group;
+        while (history->first < history->current && history->records.data[history->first].group == group) {
+            history->first++;
+        }
+    }
+    if (history->first < (s64)history->records.count) {
+        history->arena_start = history->records.data[history->first].offset;
+    } else {
+        history->arena_start = history->arena_end;
+    }
+    if (history->first > 0 && history->first >= (s64)history->records.count / 2) {
+        history->records.remove(0, history->first);
+        history->current -= history->first;
+        history->first = 0;
+    }
+}
+
+internal void history_push(History *history, Edit kind, s64 pos, s64 count) {
+    EditRecord record;
+    record.kind = kind;
+    record.pos = pos;
+    record.count = count;
+    record.offset = history->arena_end;
+    record.group = edit_group;
+    history->records.push(record);
+    history->current++;
+}
+
+// the last record, when the next edit of the given kind at pos continues it
+internal EditRecord *history_extendable(History *history, Edit kind, s64 pos) {
+    if (history->current == history->first) return nullptr;
+    EditRecord *last = &history->records.data[history->current - 1];
+    if (last->kind != kind || last->group != edit_group) return nullptr;
+    if (kind == Insertion && last->pos + last->count == pos) return last;
+    // forward deletes keep removing at the same spot
+    if (kind == Deletion && last->pos == pos) return last;
+    return nullptr;
+}
+
+internal void history_insert(History *history, s64 pos, u8 *data, s64 count) {
+    history_drop_redo(history);
+    history_reserve(history, count);
+    memcpy(history->arena + history->arena_end, data, count);
+    EditRecord *last = history_extendable(history, Insertion, pos);
+    if (last) {
+        last->count += count;
+    } else {
+        history_push(history, Insertion, pos, count);
+    }
+    history->arena_end += count;
+    history_trim(history);
+}
+
+// must run before the text is deleted
+internal void history_delete(History *history, TextBuffer *text, s64 start, s64 end) {
+    history_drop_redo(history);
+    history_reserve(history, end - start);
+    text_read(text, start, end, history->arena + history->arena_end);
+    EditRecord *last = history_extendable(history, Deletion, start);
+    if (last) {
+        last->count += end - start;
+    } else {
+        history_push(history, Deletion, start, end - start);
+    }
+    history->arena_end += end - start;
+    history_trim(history);
+}
+
+// Records edits sorted by start and apart from each other, positions in the text before any of
+// them, as one Replacement. Must run before the text is edited.
+internal void history_replace(History *history, TextBuffer *text, CursorEdit *edits, s64 count) {
+    history_drop_redo(history);
+    s64 total = 0;
+    for (s64 i = 0; i < count; i++) {
+        total += (s64)sizeof(ReplacedRange) + (edits[i].end - edits[i].start) + edits[i].count;
+    }
+    history_reserve(history, total);
+    u8 *at = history->arena + history->arena_end;
+    for (s64 i = 0; i < count; i++) {
+        CursorEdit edit = edits[i];
+        ReplacedRange range = {edit.start, edit.end - edit.start, edit.count};
+        // the arena is not aligned for it
+        memcpy(at, &range, sizeof(ReplacedRange));
+        at += sizeof(ReplacedRange);
+        text_read(text, edit.start, edit.end, at);
+        at += range.removed;
+        memcpy(at, edit.data, edit.count);
+        at += edit.count;
+    }
+    history_push(history, Replacement, edits[0].start, total);
+    history->arena_end += total;
+    history_trim(history);
+}
+
+// undoes or redoes a Replacement
+internal void history_replay(History *history, TextBuffer *text, EditRecord record, bool undo) {
+    Array<CursorEdit> edits{};
+    u8 *at = history->arena + record.offset;
+    u8 *end = at + record.count;
+    s64 shift = 0;
+    while (at < end) {
+        ReplacedRange range;
+        memcpy(&range, at, sizeof(ReplacedRange));
+        u8 *removed = at + sizeof(ReplacedRange);
+        u8 *added = removed + range.removed;
+        at = added + range.added;
+        CursorEdit edit;
+        if (undo) {
+            edit = {range.start + shift, range.start + shift + range.added, removed, range.removed};
+        } else {
+            edit = {range.start, range.start + range.removed, added, range.added};
+        }
+        shift += range.added - range.removed;
+        edits.push(edit);
+    }
+    if ((s64)edits.count * REPLACE_REBUILD_SPACING >= text_length(text)) {
+        text_rebuild(text, edits.data, (s64)edits.count);
+    } else {
+        // from the last range back, so the ones before it have not moved
+        for (s64 i = (s64)edits.count - 1; i >= 0; i--) {
+            CursorEdit edit = edits.data[i];
+            if (edit.end > edit.start) text_delete(text, edit.start, edit.end);
+            if (edit.count > 0) text_insert(text, edit.start, edit.data, edit.count);
+        }
+    }
+    edits.clear();
+}
+
+// Both return where the cursor goes, or -1 when there is nothing to undo or redo
+internal s64 history_undo(History *history, TextBuffer *text) {
+    if (history->current == history->first) return -1;
+    u64 group = history->records.data[history->current - 1].group;
+    s64 pos = -1;
+    text_begin_batch(text);
+    while (history->current > history->first && history->records.data[history->current - 1].group == group) {
+        EditRecord record = history->records.data[--history->current];
+        if (record.kind == Replacement) {
+            history_replay(history, text, record, true);
+        } else if (record.kind == Insertion) {
+            text_delete(text, record.pos, record.pos + record.count);
+        } else {
+            text_insert(text, record.pos, history->arena + record.offset, record.count);
+        }
+        pos = record.pos;
+    }
+    text_end_batch(text);
+    return pos;
+}
+
+internal s64 history_redo(History *history, TextBuffer *text) {
+    if (history->current == (s64)history->records.count) return -1;
+    u64 group = history->records.data[history->current].group;
+    s64 pos = -1;
+    text_begin_batch(text);
+    while (history->current < (s64)history->records.count && history->records.data[history->current].group == group) {
+        EditRecord record = history->records.data[history->current++];
+        if (record.kind == Replacement) {
+            history_replay(history, text, record, false);
+            pos = record.pos;
+        } else if (record.kind == Insertion) {
+            text_insert(text, record.pos, history->arena + record.offset, record.count);
+            pos = record.pos + record.count;
+        } else {
+            text_delete(text, record.pos, record.pos + record.count);
+            pos = record.pos;
+        }
+    }
+    text_end_batch(text);
+    return pos;
+}
+
+internal void history_clear(History *history) {
+    history->records.clear();
+    free(history->arena);
+    block_zero(history, sizeof(History));
+}
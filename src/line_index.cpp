@@ -0,0 +1,640 @@
+// @note Line index
+// Lines are kept in blocks of up to LINE_BLOCK_CAP start offsets. Two fenwick trees over the
+// per-block byte and line totals give O(log n) lookups, and an edit only rewrites the block(s)
+// holding the touched lines. The tree is rebuilt when blocks are split or removed.
+
+internal LineBlock *line_block_new() {
+    LineBlock *block = (LineBlock *)malloc(sizeof(LineBlock));
+    block->bytes = 0;
+    block->count = 0;
+    return block;
+}
+
+internal void line_block_push(Array<LineBlock *> *blocks, s64 length) {
+    LineBlock *block = blocks->count > 0 ? blocks->data[blocks->count - 1] : nullptr;
+    if (block == nullptr || block->count >= LINE_BLOCK_FILL) {
+        block = line_block_new();
+        blocks->push(block);
+    }
+    block->starts[block->count++] = block->bytes;
+    block->bytes += length;
+}
+
+// pushes a line for every newline in text, base is where text starts and *line_start is the
+// start of the line still open
+internal void line_block_push_text(Array<LineBlock *> *blocks, u8 *text, s64 count, s64 base, s64 *line_start) {
+    s64 offsets[1024];
+    for (s64 pos = 0; pos < count; ) {
+        s64 scanned;
+        s64 n = newline_find(text + pos, count - pos, offsets, ARRAYCOUNT(offsets), &scanned);
+        for (s64 i = 0; i < n; i++) {
+            s64 newline = base + pos + offsets[i];
+            line_block_push(blocks, newline + 1 - *line_start);
+            *line_start = newline + 1;
+        }
+        pos += scanned;
+    }
+}
+
+internal void line_index_clear(LineIndex *index) {
+    for (LineBlock *block : index->blocks) {
+        free(block);
+    }
+    index->blocks.clear();
+    index->tree_bytes.clear();
+    index->tree_lines.clear();
+    index->line_count = 0;
+    index->bytes = 0;
+    index->last_valid = false;
+}
+
+internal void line_index_rebuild_tree(LineIndex *index) {
+    s64 n = (s64)index->blocks.count;
+    index->tree_bytes.count = 0;
+    index->tree_lines.count = 0;
+    index->tree_bytes.push(0);
+    index->tree_lines.push(0);
+    index->line_count = 0;
+    index->bytes = 0;
+    index->last_valid = false;
+    for (s64 i = 0; i < n; i++) {
+        LineBlock *block = index->blocks.data[i];
+        index->tree_bytes.push(block->bytes);
+        index->tree_lines.push(block->count);
+        index->bytes += block->bytes;
+        index->line_count += block->count;
+    }
+    for (s64 i = 1; i <= n; i++) {
+        s64 parent = i + (i & -i);
+        if (parent <= n) {
+            index->tree_bytes.data[parent] += index->tree_bytes.data[i];
+            index->tree_lines.data[parent] += index->tree_lines.data[i];
+        }
+    }
+}
+
+internal void line_index_tree_add(LineIndex *index, s64 block, s64 bytes, s64 lines) {
+    index->bytes += bytes;
+    index->line_count += lines;
+    index->last_valid = false;
+    for (s64 i = block + 1; i < (s64)index->tree_bytes.count; i += i & -i) {
+        index->tree_bytes.data[i] += bytes;
+        index->tree_lines.data[i] += lines;
+    }
+}
+
+// appends the last block to the trees without touching the blocks before it
+internal void line_index_tree_push(LineIndex *index) {
+    LineBlock *block = index->blocks.data[index->blocks.count - 1];
+    s64 i = (s64)index->tree_bytes.count;
+    assert(i == (s64)index->blocks.count);
+    s64 bytes = block->bytes;
+    s64 lines = block->count;
+    for (s64 j = i - 1; j > i - (i & -i); j -= j & -j) {
+        bytes += index->tree_bytes.data[j];
+        lines += index->tree_lines.data[j];
+    }
+    index->tree_bytes.push(bytes);
+    index->tree_lines.push(lines);
+    index->bytes += block->bytes;
+    index->line_count += block->count;
+    index->last_valid = false;
+}
+
+internal LineLocation line_index_find(LineIndex *index, s64 key, bool by_bytes) {
+    assert(index->line_count > 0);
+    Array<s64> *tree = by_bytes ? &index->tree_bytes : &index->tree_lines;
+    key = clamp(key, 0, (by_bytes ? index->bytes : index->line_count) - 1);
+
+    s64 n = (s64)index->blocks.count;
+    s64 step = 1;
+    while (step * 2 <= n) step *= 2;
+
+    // descend to the last block whose prefix total is <= key
+    s64 block = 0;
+    s64 bytes = 0;
+    s64 lines = 0;
+    for (; step > 0; step >>= 1) {
+        s64 next = block + step;
+        if (next <= n && tree->data[next] <= key) {
+            block = next;
+            key -= tree->data[next];
+            bytes += index->tree_bytes.data[next];
+            lines += index->tree_lines.data[next];
+        }
+    }
+
+    LineBlock *b = index->blocks.data[block];
+    s64 slot = key;
+    if (by_bytes) {
+        s64 lo = 0;
+        s64 hi = b->count - 1;
+        while (lo < hi) {
+            s64 mid = (lo + hi + 1) / 2;
+            if (b->starts[mid] <= key) lo = mid;
+            else hi = mid - 1;
+        }
+        slot = lo;
+    }
+
+    LineLocation result{};
+    result.block = block;
+    result.slot = slot;
+    result.line = lines + slot;
+    result.start = bytes + b->starts[slot];
+    result.length = (slot + 1 < b->count ? b->starts[slot + 1] : b->bytes) - b->starts[slot];
+    return result;
+}
+
+inline internal LineLocation line_index_locate_line(LineIndex *index, s64 line) {
+    if (index->last_valid && index->last.line == line) {
+        return index->last;
+    }
+    index->last = line_index_find(index, line, false);
+    index->last_valid = true;
+    return index->last;
+}
+
+inline internal LineLocation line_index_locate_pos(LineIndex *index, s64 pos) {
+    LineLocation *last = &index->last;
+    if (index->last_valid && pos >= last->start && pos < last->start + last->length) {
+        return *last;
+    }
+    // lookups walking down the text mostly land on the next line
+    if (index->last_valid && pos >= last->start + last->length) {
+        LineBlock *block = index->blocks.data[last->block];
+        LineLocation next = *last;
+        next.slot++;
+        if (next.slot == block->count && next.block + 1 < (s64)index->blocks.count) {
+            next.block++;
+            next.slot = 0;
+            block = index->blocks.data[next.block];
+        }
+        if (next.slot < block->count) {
+            next.line++;
+            next.start += last->length;
+            next.length = (next.slot + 1 < block->count ? block->starts[next.slot + 1] : block->bytes) - block->starts[next.slot];
+            if (pos < next.start + next.length) {
+                *last = next;
+                return next;
+            }
+        }
+    }
+    index->last = line_index_find(index, pos, true);
+    index->last_valid = true;
+    return index->last;
+}
+
+internal void line_index_set_length(LineIndex *index, LineLocation loc, s64 length) {
+    LineBlock *block = index->blocks.data[loc.block];
+    s64 delta = length - loc.length;
+    for (s64 i = loc.slot + 1; i < block->count; i++) {
+        block->starts[i] += delta;
+    }
+    block->bytes += delta;
+    line_index_tree_add(index, loc.block, delta, 0);
+}
+
+// inserts lines directly after loc
+internal void line_index_insert_lines(LineIndex *index, LineLocation loc, s64 *lengths, s64 count) {
+    LineBlock *block = index->blocks.data[loc.block];
+    s64 slot = loc.slot + 1;
+    s64 added = 0;
+    for (s64 i = 0; i < count; i++) {
+        added += lengths[i];
+    }
+
+    if (block->count + count <= LINE_BLOCK_CAP) {
+        s64 at = slot < block->count ? block->starts[slot] : block->bytes;
+        memmove(&block->starts[slot + count], &block->starts[slot], (block->count - slot) * sizeof(s64));
+        for (s64 i = slot + count; i < block->count + count; i++) {
+            block->starts[i] += added;
+        }
+        for (s64 i = 0; i < count; i++) {
+            block->starts[slot + i] = at;
+            at += lengths[i];
+        }
+        block->count += (s32)count;
+        block->bytes += added;
+        line_index_tree_add(index, loc.block, added, count);
+        return;
+    }
+
+    // split: the new lines and the tail of the block go into fresh blocks after it
+    Array<LineBlock *> fresh{};
+    for (s64 i = 0; i < count; i++) {
+        line_block_push(&fresh, lengths[i]);
+    }
+    for (s64 i = slot; i < block->count; i++) {
+        s64 end = i + 1 < block->count ? block->starts[i + 1] : block->bytes;
+        line_block_push(&fresh, end - block->starts[i]);
+    }
+    if (slot < block->count) {
+        block->bytes = block->starts[slot];
+    }
+    block->count = (s32)slot;
+
+    index->blocks.insert(loc.block + 1, fresh.data, fresh.count);
+    fresh.clear();
+    line_index_rebuild_tree(index);
+}
+
+// removes count lines directly after loc
+internal void line_index_remove_lines(LineIndex *index, LineLocation loc, s64 count) {
+    bool emptied = false;
+    s64 slot = loc.slot + 1;
+    for (s64 b = loc.block; count > 0 && b < (s64)index->blocks.count; b++, slot = 0) {
+        LineBlock *block = index->blocks.data[b];
+        s64 n = block->count - slot;
+        if (n > count) n = count;
+        if (n <= 0) continue;
+
+        s64 from = block->starts[slot];
+        s64 to = slot + n < block->count ? block->starts[slot + n] : block->bytes;
+        s64 removed = to - from;
+        memmove(&block->starts[slot], &block->starts[slot + n], (block->count - slot - n) * sizeof(s64));
+        block->count -= (s32)n;
+        for (s64 i = slot; i < block->count; i++) {
+            block->starts[i] -= removed;
+        }
+        block->bytes -= removed;
+        count -= n;
+
+        if (block->count == 0) {
+            free(block);
+            index->blocks.data[b] = nullptr;
+            emptied = true;
+        } else {
+            line_index_tree_add(index, b, -removed, -n);
+        }
+    }
+
+    if (emptied) {
+        size_t live = 0;
+        for (size_t i = 0; i < index->blocks.count; i++) {
+            if (index->blocks.data[i]) {
+                index->blocks.data[live++] = index->blocks.data[i];
+            }
+        }
+        index->blocks.count = live;
+        line_index_rebuild_tree(index);
+    }
+}
+
+internal void line_index_insert(LineIndex *index, s64 pos, u8 *text, s64 count) {
+    LineLocation loc = line_index_locate_pos(index, pos);
+    s64 head = pos - loc.start;
+    s64 tail = loc.length - head;
+
+    s64 line_start = 0;
+    Array<s64> lengths{};
+    s64 offsets[256];
+    for (s64 i = 0; i < count; ) {
+        s64 scanned;
+        s64 n = newline_find(text + i, count - i, offsets, ARRAYCOUNT(offsets), &scanned);
+        for (s64 k = 0; k < n; k++) {
+            s64 newline = i + offsets[k];
+            lengths.push(newline + 1 - line_start);
+            line_start = newline + 1;
+        }
+        i += scanned;
+    }
+
+    if (lengths.empty()) {
+        line_index_set_length(index, loc, loc.length + count);
+        return;
+    }
+
+    lengths.data[0] += head;
+    lengths.push(count - line_start + tail);
+    line_index_set_length(index, loc, lengths.data[0]);
+    line_index_insert_lines(index, loc, lengths.data + 1, (s64)lengths.count - 1);
+    lengths.clear();
+}
+
+internal void line_index_delete(LineIndex *index, s64 start, s64 end) {
+    LineLocation first = line_index_locate_pos(index, start);
+    LineLocation last = line_index_locate_pos(index, end);
+    s64 length = (start - first.start) + (last.start + last.length - end);
+    if (last.line > first.line) {
+        line_index_remove_lines(index, first, last.line - first.line);
+    }
+    line_index_set_length(index, first, length);
+}
+
+// @note Splicing
+// Many windows from one batch go in with a single pass instead of a lookup per window. Blocks
+// outside every window are carried over as they are, the blocks under a run of windows are
+// repacked from their old line ends and the windows' new text, and the tree is rebuilt once.
+
+// closes every old line ending in (pos, to], skipping those that ended inside a window
+internal void line_splice_old(LineSplice *splice, LineIndex *index, s64 to) {
+    while (splice->block < (s64)index->blocks.count) {
+        LineBlock *block = index->blocks.data[splice->block];
+        s64 end = splice->base + (splice->slot + 1 < block->count ? block->starts[splice->slot + 1] : block->bytes);
+        if (end > to) break;
+        if (end > splice->pos) {
+            line_block_push(&splice->blocks, splice->pending + end - splice->pos);
+            splice->pending = 0;
+            splice->pos = end;
+        }
+        if (++splice->slot == block->count) {
+            splice->slot = 0;
+            splice->base += block->bytes;
+            splice->block++;
+        }
+    }
+    splice->pending += to - splice->pos;
+    splice->pos = to;
+}
+
+internal void line_splice_text(LineSplice *splice, u8 *text, s64 count) {
+    s64 line_start = 0;
+    s64 offsets[256];
+    for (s64 i = 0; i < count; ) {
+        s64 scanned;
+        s64 n = newline_find(text + i, count - i, offsets, ARRAYCOUNT(offsets), &scanned);
+        for (s64 k = 0; k < n; k++) {
+            s64 newline = i + offsets[k];
+            line_block_push(&splice->blocks, splice->pending + newline + 1 - line_start);
+            splice->pending = 0;
+            line_start = newline + 1;
+        }
+        i += scanned;
+    }
+    splice->pending += count - line_start;
+}
+
+// windows are sorted and apart, text holds the new bytes of all of them back to back
+internal void line_index_splice(LineIndex *index, BatchWindow *windows, s64 count, u8 *text) {
+    LineSplice splice{};
+    s64 n = (s64)index->blocks.count;
+    s64 b = 0;
+    s64 base = 0;
+    for (s64 w = 0; w < count; ) {
+        while (b + 1 < n && base + index->blocks.data[b]->bytes <= windows[w].old_start) {
+            splice.blocks.push(index->blocks.data[b]);
+            base += index->blocks.data[b]->bytes;
+            b++;
+        }
+
+        // the run ends at a block boundary no window reaches across
+        s64 last = b;
+        s64 last_end = base + index->blocks.data[b]->bytes;
+        splice.block = b;
+        splice.slot = 0;
+        splice.base = base;
+        splice.pos = base;
+        splice.pending = 0;
+        while (w < count && (windows[w].old_start < last_end || last == n - 1)) {
+            BatchWindow window = windows[w++];
+            while (last + 1 < n && last_end <= window.old_end) {
+                last++;
+                last_end += index->blocks.data[last]->bytes;
+            }
+            line_splice_old(&splice, index, window.old_start);
+            line_splice_text(&splice, text, window.end - window.start);
+            text += window.end - window.start;
+            splice.pos = window.old_end;
+        }
+        line_splice_old(&splice, index, last_end);
+
+        for (; b <= last; b++) {
+            free(index->blocks.data[b]);
+        }
+        base = last_end;
+    }
+    for (; b < n; b++) {
+        splice.blocks.push(index->blocks.data[b]);
+    }
+    index->blocks.clear();
+    index->blocks = splice.blocks;
+    line_index_rebuild_tree(index);
+}
+
+// @note Background indexing
+// The worker packs lines into blocks itself, so merging on the main thread only appends block
+// pointers and their tree entries.
+internal void line_indexer_run(void *data) {
+    LineIndexer *indexer = (LineIndexer *)data;
+    Array<LineBlock *> blocks{};
+    s64 line_start = 0;
+    bool cancel = false;
+    for (s64 pos = 0; pos < indexer->count && !cancel; ) {
+        s64 end = pos + LINE_INDEXER_CHUNK;
+        if (end > indexer->count) end = indexer->count;
+        line_block_push_text(&blocks, indexer->text + pos, end - pos, pos, &line_start);
+        pos = end;
+
+        os_mutex_lock(&indexer->mutex);
+        indexer->blocks.insert(indexer->blocks.count, blocks.data, blocks.count);
+        indexer->scanned = pos;
+        cancel = indexer->cancel;
+        os_mutex_unlock(&indexer->mutex);
+        blocks.count = 0;
+    }
+    blocks.clear();
+
+    os_mutex_lock(&indexer->mutex);
+    indexer->done = true;
+    os_mutex_unlock(&indexer->mutex);
+}
+
+// resets the index to a single pending line and starts scanning text on a worker
+internal LineIndexer *line_indexer_start(LineIndex *index, u8 *text, s64 count) {
+    line_index_clear(index);
+    line_block_push(&index->blocks, count + 1);
+    line_index_rebuild_tree(index);
+
+    LineIndexer *indexer = (LineIndexer *)malloc(sizeof(LineIndexer));
+    block_zero(indexer, sizeof(LineIndexer));
+    indexer->text = text;
+    indexer->count = count;
+    os_mutex_init(&indexer->mutex);
+    indexer->thread = os_thread_start(line_indexer_run, indexer);
+    return indexer;
+}
+
+// start of the pending line, the worker's blocks describe the text from here on as it was scanned
+inline internal s64 line_indexer_frontier(LineIndex *index) {
+    return line_index_locate_line(index, index->line_count - 1).start;
+}
+
+// Records that the text [start, end), at or past frontier, now holds count bytes. Edits are kept in
+// offsets of the scanned text, an edit touching earlier ones is folded into them.
+internal void line_indexer_edit(LineIndexer *indexer, s64 frontier, s64 start, s64 end, s64 count) {
+    Array<IndexerEdit> *edits = &indexer->edits;
+    // text offset minus scanned offset, up to the edit being looked at
+    s64 shift = frontier - indexer->merged;
+    size_t first = 0;
+    while (first < edits->count) {
+        IndexerEdit edit = edits->data[first];
+        if (edit.start + shift + edit.count >= start) break;
+        shift += edit.count - (edit.end - edit.start);
+        first++;
+    }
+
+    IndexerEdit merged = { start - shift, 0, 0 };
+    s64 from = start;
+    s64 to = end;
+    size_t last = first;
+    for (; last < edits->count; last++) {
+        IndexerEdit edit = edits->data[last];
+        s64 edit_start = edit.start + shift;
+        if (edit_start > end) break;
+        if (edit.start < merged.start) merged.start = edit.start;
+        if (edit_start < from) from = edit_start;
+        if (edit_start + edit.count > to) to = edit_start + edit.count;
+        shift += edit.count - (edit.end - edit.start);
+    }
+    merged.end = end - shift;
+    if (last > first && edits->data[last - 1].end > merged.end) merged.end = edits->data[last - 1].end;
+    merged.count = (to - from) - (end - start) + count;
+    if (last > first) edits->remove(first, last - first);
+    edits->insert(first, merged);
+}
+
+internal void text_read(TextBuffer *text, s64 start, s64 end, u8 *dest);
+
+// scans text [start, end) and appends its lines to the index, returns the length of the line left open
+internal s64 line_indexer_rescan(LineIndex *index, TextBuffer *text, s64 start, s64 end) {
+    u8 *data = (u8 *)malloc(end - start + 1);
+    text_read(text, start, end, data);
+    Array<LineBlock *> blocks{};
+    s64 line_start = 0;
+    line_block_push_text(&blocks, data, end - start, 0, &line_start);
+    free(data);
+    for (LineBlock *block : blocks) {
+        index->blocks.push(block);
+        line_index_tree_push(index);
+    }
+    blocks.clear();
+    return end - start - line_start;
+}
+
+// Edits before the frontier never move the pending line out of the last slot of the last block.
+// Merging takes it off, appends the blocks found since the last merge and pushes back what is
+// left of it as the new pending line. Found blocks no edit reaches go in as they are. Those an
+// edit reaches are scanned again from text, together with the blocks after them up to a line end
+// no edit touches, so they wait while an edit reaches past the last block found.
+internal bool line_indexer_merge(LineIndexer *indexer, LineIndex *index, TextBuffer *text, bool *done) {
+    os_mutex_lock(&indexer->mutex);
+    Array<LineBlock *> found = indexer->blocks;
+    indexer->blocks = Array<LineBlock *>{};
+    *done = indexer->done;
+    os_mutex_unlock(&indexer->mutex);
+
+    Array<LineBlock *> *held = &indexer->held;
+    Array<IndexerEdit> *edits = &indexer->edits;
+    if (!found.empty()) {
+        held->insert(held->count, found.data, found.count);
+        found.clear();
+    }
+    if (held->empty() && !(*done && !edits->empty())) {
+        return false;
+    }
+
+    s64 last = (s64)index->blocks.count - 1;
+    LineBlock *block = index->blocks.data[last];
+    s64 pending = block->bytes - block->starts[block->count - 1];
+    s64 frontier = index->bytes - pending;
+    block->bytes -= pending;
+    block->count--;
+    line_index_tree_add(index, last, -pending, -1);
+    if (block->count == 0) {
+        // only the last entry of a fenwick tree covers the last block
+        free(block);
+        index->blocks.count--;
+        index->tree_bytes.count--;
+        index->tree_lines.count--;
+    }
+
+    // where the next line starts in the text and in the scanned text
+    s64 pos = frontier;
+    s64 scanned = indexer->merged;
+    size_t used = 0;
+    size_t applied = 0;
+    bool waiting = false;
+    bool merged = *done;
+    while (used < held->count) {
+        LineBlock *next = held->data[used];
+        if (applied == edits->count || edits->data[applied].start >= scanned + next->bytes) {
+            index->blocks.push(next);
+            line_index_tree_push(index);
+            pos += next->bytes;
+            scanned += next->bytes;
+            used++;
+            merged = true;
+            continue;
+        }
+
+        size_t run = used;
+        s64 end = scanned + next->bytes;
+        s64 shift = pos - scanned;
+        size_t edit = applied;
+        while (edit < edits->count && edits->data[edit].start < end) {
+            // an edit reaching a line end joins the line after it, so the run takes its block too
+            while (edits->data[edit].end >= end && run + 1 < held->count) {
+                run++;
+                end += held->data[run]->bytes;
+            }
+            if (edits->data[edit].end >= end) break;
+            shift += edits->data[edit].count - (edits->data[edit].end - edits->data[edit].start);
+            edit++;
+        }
+        if (edit < edits->count && edits->data[edit].start < end) {
+            waiting = true;
+            break;
+        }
+        line_indexer_rescan(index, text, pos, end + shift);
+        for (; used <= run; used++) {
+            free(held->data[used]);
+        }
+        applied = edit;
+        pos = end + shift;
+        scanned = end;
+        merged = true;
+    }
+
+    if (*done && (waiting || applied < edits->count)) {
+        // the worker is done, what is left past pos is scanned here
+        for (; used < held->count; used++) {
+            free(held->data[used]);
+        }
+        s64 length = frontier + pending - 1;
+        s64 open = line_indexer_rescan(index, text, pos, length);
+        applied = edits->count;
+        pos = length - open;
+    }
+    if (used > 0) held->remove(0, used);
+    if (applied > 0) edits->remove(0, applied);
+    indexer->merged = scanned;
+
+    // what is left goes into a block of its own, so the next merge frees it outright
+    index->blocks.push(line_block_new());
+    line_block_push(&index->blocks, pending - (pos - frontier));
+    line_index_tree_push(index);
+    return merged;
+}
+
+internal s64 line_indexer_percent(LineIndexer *indexer) {
+    os_mutex_lock(&indexer->mutex);
+    s64 scanned = indexer->scanned;
+    os_mutex_unlock(&indexer->mutex);
+    return indexer->count > 0 ? 100 * scanned / indexer->count : 100;
+}
+
+// the worker must have been joined
+internal void line_indexer_free(LineIndexer *indexer) {
+    os_mutex_free(&indexer->mutex);
+    for (LineBlock *block : indexer->blocks) {
+        free(block);
+    }
+    indexer->blocks.clear();
+    for (LineBlock *block : indexer->held) {
+        free(block);
+    }
+    indexer->held.clear();
+    indexer->edits.clear();
+    free(indexer);
+}
@@ -0,0 +1,316 @@
+// @note Match count
+// The highlighted pattern's matches are counted block by block, so the total for a huge text is
+// what its counted blocks add up to while the others are still being counted. A block counts the
+// matches starting in it, searched for from where the last match of the block before left off.
+// An edit sends back only the blocks within the pattern's reach of it, which keep their last count
+// until they are counted again, and a block whose search now ends somewhere else sends back the
+// one after it. Counting a block searches past its end only as far as a match starting in it can
+// run: the longest match, and MATCH_INDEX_REACH bytes otherwise, as for highlighting. Edits send
+// back blocks as far as that reach and no further, so no count looks beyond it, not even to the
+// end of a long line.
+
+#define MATCH_COUNT_BLOCK (256 * 1024)
+// dirty blocks adding up to no more than this are counted on the main thread right away
+#define MATCH_COUNT_INLINE (512 * 1024)
+
+internal CountBlock match_count_block(MatchCount *counts, s64 length) {
+    CountBlock block{};
+    block.id = ++counts->next_id;
+    block.length = length;
+    block.dirty = true;
+    return block;
+}
+
+// drops the counts and cuts the text into blocks again, for a new pattern or a new text
+internal void match_count_reset(MatchCount *counts, u64 pattern, s64 reach, s64 length) {
+    counts->pattern = pattern;
+    counts->reach = reach;
+    counts->blocks.count = 0;
+    counts->stamp++;
+    for (s64 pos = 0; pos < length || counts->blocks.empty(); pos += MATCH_COUNT_BLOCK) {
+        s64 n = length - pos < MATCH_COUNT_BLOCK ? length - pos : MATCH_COUNT_BLOCK;
+        counts->blocks.push(match_count_block(counts, n));
+    }
+}
+
+// the block holding pos, the last one for the end of the text, *start is where it starts
+internal s64 match_count_find(MatchCount *counts, s64 pos, s64 *start) {
+    s64 at = 0;
+    s64 last = (s64)counts->blocks.count - 1;
+    for (s64 k = 0; k < last; k++) {
+        s64 length = counts->blocks.data[k].length;
+        if (pos < at + length) {
+            *start = at;
+            return k;
+        }
+        at += length;
+    }
+    *start = at;
+    return last;
+}
+
+// sends the blocks holding any of [a, b] back to be counted
+internal void match_count_dirty(MatchCount *counts, u64 version, s64 a, s64 b) {
+    s64 at = 0;
+    for (CountBlock &block : counts->blocks) {
+        if (at > b) break;
+        if (at + block.length >= a) {
+            block.dirty = true;
+            block.changed = version;
+        }
+        at += block.length;
+    }
+}
+
+// Splits a block grown past twice the size and merges one shrunk below a quarter of it with a
+// neighbour. The new blocks keep the old counts between them, so the total holds until they are
+// counted.
+internal void match_count_tidy(MatchCount *counts, s64 k) {
+    CountBlock old = counts->blocks.data[k];
+    if (old.length > 2 * MATCH_COUNT_BLOCK) {
+        s64 n = old.length / MATCH_COUNT_BLOCK;
+        Array<CountBlock> pieces{};
+        for (s64 i = 0; i < n; i++) {
+            CountBlock piece = match_count_block(counts, i < n - 1 ? MATCH_COUNT_BLOCK : old.length - (n - 1) * MATCH_COUNT_BLOCK);
+            piece.changed = old.changed;
+            piece.counted = old.counted;
+            if (i == 0) piece.count = old.count;
+            pieces.push(piece);
+        }
+        counts->blocks.data[k] = pieces.data[0];
+        counts->blocks.insert(k + 1, pieces.data + 1, n - 1);
+        pieces.clear();
+    } else if (old.length < MATCH_COUNT_BLOCK / 4 && counts->blocks.count > 1) {
+        s64 j = k + 1 < (s64)counts->blocks.count ? k : k - 1;
+        CountBlock a = counts->blocks.data[j];
+        CountBlock b = counts->blocks.data[j + 1];
+        CountBlock merged = match_count_block(counts, a.length + b.length);
+        merged.count = a.count + b.count;
+        merged.counted = a.counted && b.counted;
+        merged.changed = a.changed > b.changed ? a.changed : b.changed;
+        counts->blocks.data[j] = merged;
+        counts->blocks.remove(j + 1, 1);
+    }
+}
+
+internal void match_count_insert(MatchCount *counts, u64 version, s64 pos, s64 count) {
+    if (counts->pattern == 0) return;
+    s64 start;
+    s64 k = match_count_find(counts, pos, &start);
+    counts->blocks.data[k].length += count;
+    match_count_dirty(counts, version, pos - counts->reach - 1, pos + count + 1);
+    match_count_tidy(counts, k);
+}
+
+internal void match_count_delete(MatchCount *counts, u64 version, s64 start, s64 end) {
+    if (counts->pattern == 0) return;
+    // positions are the ones before the delete
+    s64 at = 0;
+    s64 dropped = 0;
+    for (s64 i = 0; i < (s64)counts->blocks.count && at < end; ) {
+        CountBlock *block = &counts->blocks.data[i];
+        s64 a = at > start ? at : start;
+        s64 b = at + block->length < end ? at + block->length : end;
+        at += block->length;
+        if (b > a) block->length -= b - a;
+        if (block->length == 0 && counts->blocks.count > 1) {
+            dropped += block->count;
+            counts->blocks.remove(i, 1);
+            continue;
+        }
+        i++;
+    }
+    s64 block_start;
+    s64 k = match_count_find(counts, start, &block_start);
+    counts->blocks.data[k].count += dropped;
+    match_count_dirty(counts, version, start - counts->reach - 1, start + 1);
+    match_count_tidy(counts, k);
+}
+
+// how far a search for the matches starting before end has to look
+internal s64 match_count_window(Regex *regex, s64 end) {
+    if (regex->max_length >= 0) return end + regex->max_length;
+    return end + MATCH_INDEX_REACH;
+}
+
+struct LiteralCount {
+    s64 limit; // matches from here on belong to the next task
+    s64 count;
+    s64 next; // where the search would go on
+    s64 length;
+};
+
+internal bool match_count_literal(void *data, s64 pos) {
+    LiteralCount *counting = (LiteralCount *)data;
+    if (pos >= counting->limit) return false;
+    counting->count++;
+    counting->next = pos + counting->length;
+    return true;
+}
+
+internal void match_count_task(Regex *regex, TextSnapshot *snapshot, CountTask *task) {
+    s64 limit = task->last ? snapshot->length + 1 : task->end;
+    s64 window = task->last ? snapshot->length : match_count_window(regex, task->end);
+    s64 pos = task->start + task->from;
+    task->count = 0;
+    if (regex->literal) {
+        // plain text streams its matches straight out of the searcher
+        LiteralCount counting = { limit, 0, pos, regex->literal->count };
+        text_find_all(snapshot, regex->literal, pos, window, match_count_literal, &counting);
+        task->count = counting.count;
+        pos = counting.next;
+    }
+    while (!regex->literal && pos < limit) {
+        StringMatch match = regex_find(regex, snapshot, pos, window);
+        if (match.pos < 0 || match.pos >= limit) break;
+        task->count++;
+        pos = search_next_start(match);
+    }
+    task->spill = pos > task->end ? pos - task->end : 0;
+}
+
+// Every dirty block as a task, in order. Returns the bytes they cover.
+internal s64 match_count_tasks(MatchCount *counts, Array<CountTask> *tasks) {
+    s64 bytes = 0;
+    s64 at = 0;
+    s64 last = (s64)counts->blocks.count - 1;
+    for (s64 k = 0; k <= last; k++) {
+        CountBlock block = counts->blocks.data[k];
+        if (block.dirty) {
+            CountTask task{};
+            task.id = block.id;
+            task.start = at;
+            task.end = at + block.length;
+            task.last = k == last;
+            task.from = k > 0 ? counts->blocks.data[k - 1].spill : 0;
+            tasks->push(task);
+            bytes += block.length;
+        }
+        at += block.length;
+    }
+    return bytes;
+}
+
+// a task right after another starts where that one spilled to
+inline internal void match_count_follow(CountTask *tasks, s64 i) {
+    if (i > 0 && tasks[i - 1].end == tasks[i].start) tasks[i].from = tasks[i - 1].spill;
+}
+
+// Takes a count made in the text at version, unless its block has been edited since or the block
+// before it now ends somewhere else. *hint is where the last one was found, tasks come in order.
+internal void match_count_take(MatchCount *counts, CountTask *task, u64 version, s64 *hint) {
+    s64 n = (s64)counts->blocks.count;
+    s64 k = -1;
+    for (s64 i = 0; i < n && k < 0; i++) {
+        s64 j = (*hint + i) % n;
+        if (counts->blocks.data[j].id == task->id) k = j;
+    }
+    if (k < 0) return;
+    *hint = k;
+    CountBlock *block = &counts->blocks.data[k];
+    if (!block->dirty || block->changed > version) return;
+    // a block before that is still dirty checks this one again once it is counted
+    if (k > 0 && !counts->blocks.data[k - 1].dirty && counts->blocks.data[k - 1].spill != task->from) return;
+    block->from = task->from;
+    block->spill = task->spill;
+    block->count = task->count;
+    block->dirty = false;
+    block->counted = true;
+    counts->stamp++;
+    CountBlock *next = k + 1 < n ? &counts->blocks.data[k + 1] : nullptr;
+    if (next && !next->dirty && next->from != block->spill) {
+        next->dirty = true;
+    }
+}
+
+// @note Background match count
+internal void match_count_run(void *data) {
+    MatchCountJob *job = (MatchCountJob *)data;
+    for (s64 i = 0; i < job->task_count && !search_cancelled(&job->cancel); i++) {
+        match_count_follow(job->tasks, i);
+        match_count_task(job->regex, job->snapshot, &job->tasks[i]);
+        os_mutex_lock(&job->mutex);
+        job->finished = i + 1;
+        os_mutex_unlock(&job->mutex);
+    }
+}
+
+// Counts the tasks in the snapshot on a worker with its own compile of the pattern. Takes
+// ownership of the snapshot and the tasks.
+internal MatchCountJob *match_count_start(Buffer *buffer, TextSnapshot *snapshot, string pattern, u64 id, Array<CountTask> tasks) {
+    const char *error = nullptr;
+    Regex *regex = regex_compile((u8 *)pattern.data, pattern.count, &error);
+    if (regex == nullptr) {
+        text_snapshot_free(snapshot);
+        tasks.clear();
+        return nullptr;
+    }
+    MatchCountJob *job = (MatchCountJob *)malloc(sizeof(MatchCountJob));
+    block_zero(job, sizeof(MatchCountJob));
+    job->buffer = buffer;
+    job->snapshot = snapshot;
+    job->regex = regex;
+    job->pattern = id;
+    job->tasks = tasks.data;
+    job->task_count = (s64)tasks.count;
+    regex_set_cancel(regex, &job->cancel);
+    os_mutex_init(&job->mutex);
+    job->thread = os_thread_start(match_count_run, job);
+    return job;
+}
+
+// Takes the counts finished so far. Returns true once all of them are.
+internal bool match_count_poll(MatchCount *counts, MatchCountJob *job) {
+    os_mutex_lock(&job->mutex);
+    s64 finished = job->finished;
+    os_mutex_unlock(&job->mutex);
+    s64 hint = 0;
+    for (; job->taken < finished; job->taken++) {
+        match_count_take(counts, &job->tasks[job->taken], job->snapshot->version, &hint);
+    }
+    return finished == job->task_count;
+}
+
+// stops the worker if it is still going
+internal void match_count_free(MatchCountJob *job) {
+    os_atomic_store(&job->cancel, true);
+    os_thread_join(job->thread);
+    os_mutex_free(&job->mutex);
+    regex_free(job->regex);
+    text_snapshot_free(job->snapshot);
+    free(job->tasks);
+    free(job);
+}
+
+// Works out how many matches start before pos and whether one starts at it, searching the block
+// holding pos up to it. Kept until the cursor, the text or a count changes.
+internal void match_count_locate(MatchCount *counts, Regex *regex, TextBuffer *text, s64 pos) {
+    if (pos == counts->status_pos && text->version == counts->status_version && counts->stamp == counts->status_stamp) return;
+    counts->status_pos = pos;
+    counts->status_version = text->version;
+    counts->status_stamp = counts->stamp;
+
+    s64 start;
+    s64 k = match_count_find(counts, pos, &start);
+    s64 before = 0;
+    for (s64 i = 0; i < k; i++) {
+        before += counts->blocks.data[i].count;
+    }
+    bool at_match = false;
+    // freed before the next edit, so the gap buffer gets its block back without a copy
+    TextSnapshot *snapshot = text_snapshot(text);
+    s64 window = match_count_window(regex, pos + 1);
+    for (s64 p = start + counts->blocks.data[k].from; p <= pos; ) {
+        StringMatch match = regex_find(regex, snapshot, p, window);
+        if (match.pos < 0 || match.pos > pos) break;
+        if (match.pos == pos) {
+            at_match = true;
+            break;
+        }
+        before++;
+        p = search_next_start(match);
+    }
+    text_snapshot_free(snapshot);
+    counts->before = before;
+    counts->at_match = at_match;
+}
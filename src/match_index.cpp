@@ -0,0 +1,255 @@
+// @note Match index
+// Matches of the highlighted pattern are found once and kept, for the parts of the text that have
+// been drawn. The matches sit in a gap array like the gap buffer's bytes: the ones after the gap
+// store their position relative to the end of the text, so an edit moves the gap to itself and
+// every match after it shifts for free. Whether there is a match at a position depends on at most
+// the pattern's longest match of text after it and one byte either side, so an edit only undoes
+// the matches starting within that reach before it and up to its end. That stretch is dropped from
+// the covered ranges and searched again the next time it is drawn.
+
+// how far past its start an unbounded pattern's match is looked for
+#define MATCH_INDEX_REACH 4096
+
+internal void match_index_clear(MatchIndex *index) {
+    index->gap_start = 0;
+    index->gap_end = index->capacity;
+    index->covered.count = 0;
+    index->length = 0;
+}
+
+// drops what was found and starts over for a new pattern
+internal void match_index_reset(MatchIndex *index, u64 pattern, s64 reach, s64 length) {
+    match_index_clear(index);
+    index->pattern = pattern;
+    index->reach = reach;
+    index->length = length;
+}
+
+inline internal s64 match_index_count(MatchIndex *index) {
+    return index->capacity - (index->gap_end - index->gap_start);
+}
+
+inline internal StringMatch match_index_get(MatchIndex *index, s64 i) {
+    if (i < index->gap_start) return index->matches[i];
+    StringMatch match = index->matches[i - index->gap_start + index->gap_end];
+    match.pos += index->length;
+    return match;
+}
+
+// the first match starting at or after pos
+internal s64 match_index_lower_bound(MatchIndex *index, s64 pos) {
+    s64 lo = 0;
+    s64 hi = match_index_count(index);
+    while (lo < hi) {
+        s64 mid = lo + (hi - lo) / 2;
+        if (match_index_get(index, mid).pos < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+internal void match_index_move_gap(MatchIndex *index, s64 i) {
+    StringMatch *matches = index->matches;
+    while (index->gap_start > i) {
+        StringMatch match = matches[--index->gap_start];
+        match.pos -= index->length;
+        matches[--index->gap_end] = match;
+    }
+    while (index->gap_start < i) {
+        StringMatch match = matches[index->gap_end++];
+        match.pos += index->length;
+        matches[index->gap_start++] = match;
+    }
+}
+
+// drops matches [i, j)
+internal void match_index_remove(MatchIndex *index, s64 i, s64 j) {
+    if (j <= i) return;
+    match_index_move_gap(index, i);
+    index->gap_end += j - i;
+}
+
+// adds a match at the gap, which has to be where it belongs in order
+internal void match_index_push(MatchIndex *index, StringMatch match) {
+    if (index->gap_start == index->gap_end) {
+        s64 after = index->capacity - index->gap_end;
+        s64 capacity = index->capacity < 64 ? 128 : index->capacity * 2;
+        index->matches = (StringMatch *)realloc(index->matches, capacity * sizeof(StringMatch));
+        memmove(index->matches + capacity - after, index->matches + index->gap_end, after * sizeof(StringMatch));
+        index->gap_end = capacity - after;
+        index->capacity = capacity;
+    }
+    index->matches[index->gap_start++] = match;
+}
+
+// the first covered range ending after pos
+internal s64 match_index_find_range(MatchIndex *index, s64 pos) {
+    s64 lo = 0;
+    s64 hi = (s64)index->covered.count;
+    while (lo < hi) {
+        s64 mid = lo + (hi - lo) / 2;
+        if (index->covered.data[mid].end <= pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+internal void match_index_cover(MatchIndex *index, s64 start, s64 end) {
+    if (end <= start) return;
+    // ranges that touch [start, end) merge with it
+    s64 first = match_index_find_range(index, start - 1);
+    s64 last = first;
+    while (last < (s64)index->covered.count && index->covered.data[last].start <= end) {
+        TextRange range = index->covered.data[last];
+        if (range.start < start) start = range.start;
+        if (range.end > end) end = range.end;
+        last++;
+    }
+    TextRange range = {start, end};
+    if (last > first) {
+        index->covered.data[first] = range;
+        index->covered.remove(first + 1, last - first - 1);
+    } else {
+        index->covered.insert(first, range);
+    }
+}
+
+internal void match_index_uncover(MatchIndex *index, s64 start, s64 end) {
+    if (start < 0) start = 0;
+    if (end <= start) return;
+    s64 i = match_index_find_range(index, start);
+    if (i < (s64)index->covered.count && index->covered.data[i].start < start && index->covered.data[i].end > end) {
+        // punches a hole in one range
+        TextRange after = {end, index->covered.data[i].end};
+        index->covered.data[i].end = start;
+        index->covered.insert(i + 1, after);
+        return;
+    }
+    if (i < (s64)index->covered.count && index->covered.data[i].start < start) {
+        index->covered.data[i].end = start;
+        i++;
+    }
+    s64 j = i;
+    while (j < (s64)index->covered.count && index->covered.data[j].end <= end) j++;
+    index->covered.remove(i, j - i);
+    if (i < (s64)index->covered.count && index->covered.data[i].start < end) {
+        index->covered.data[i].start = end;
+    }
+}
+
+// moves range ends in (pos, ...) by delta, ones that would land before pos land on it
+internal void match_index_shift_ranges(MatchIndex *index, s64 pos, s64 delta) {
+    s64 kept = 0;
+    for (TextRange range : index->covered) {
+        if (range.start > pos) range.start = range.start + delta > pos ? range.start + delta : pos;
+        if (range.end > pos) range.end = range.end + delta > pos ? range.end + delta : pos;
+        if (range.end > range.start) index->covered.data[kept++] = range;
+    }
+    index->covered.count = kept;
+}
+
+// The starts inside a dropped match were skipped, not found to hold none, so they are searched
+// again along with the ones the edit reaches.
+internal s64 match_index_dropped_end(MatchIndex *index, s64 i, s64 j) {
+    s64 end = 0;
+    for (s64 k = i; k < j; k++) {
+        StringMatch match = match_index_get(index, k);
+        if (match.pos + match.count > end) end = match.pos + match.count;
+    }
+    return end;
+}
+
+internal void match_index_insert(MatchIndex *index, s64 pos, s64 count) {
+    if (index->pattern == 0) return;
+    s64 i = match_index_lower_bound(index, pos - index->reach);
+    s64 j = match_index_lower_bound(index, pos + 1);
+    s64 dropped_end = match_index_dropped_end(index, i, j);
+    if (dropped_end > pos) dropped_end += count;
+    match_index_remove(index, i, j);
+    match_index_move_gap(index, i);
+    index->length += count;
+    match_index_shift_ranges(index, pos, count);
+    match_index_uncover(index, pos - index->reach, dropped_end > pos + count + 1 ? dropped_end : pos + count + 1);
+}
+
+internal void match_index_delete(MatchIndex *index, s64 start, s64 end) {
+    if (index->pattern == 0) return;
+    s64 i = match_index_lower_bound(index, start - index->reach);
+    s64 j = match_index_lower_bound(index, end + 1);
+    s64 dropped_end = match_index_dropped_end(index, i, j);
+    dropped_end = dropped_end > end ? dropped_end - (end - start) : start;
+    match_index_remove(index, i, j);
+    match_index_move_gap(index, i);
+    index->length -= end - start;
+    match_index_shift_ranges(index, start, start - end);
+    match_index_uncover(index, start - index->reach, dropped_end > start + 1 ? dropped_end : start + 1);
+}
+
+// Searches the starts in [start, end), none of which are covered. A match that runs on past end
+// replaces the ones after it that it overlaps, and the search goes on until it finds the next one
+// again, past which nothing changes.
+internal void match_index_fill(MatchIndex *index, Regex *regex, TextSnapshot *snapshot, s64 start, s64 end) {
+    s64 i = match_index_lower_bound(index, start);
+    // a search picks up where the match before left off
+    s64 pos = start;
+    if (i > 0) {
+        s64 after = search_next_start(match_index_get(index, i - 1));
+        if (after > pos) pos = after;
+    }
+    match_index_move_gap(index, i);
+    bool dropped = false;
+    for (;;) {
+        bool has_next = index->gap_end < index->capacity;
+        StringMatch next = has_next ? match_index_get(index, index->gap_start) : StringMatch{};
+        s64 limit = pos < end ? end : (dropped && has_next ? next.pos : pos);
+        if (pos >= limit) break;
+        StringMatch match = regex_find(regex, snapshot, pos, limit + index->reach + 1);
+        if (match.pos < 0 || match.pos >= limit) break;
+        pos = search_next_start(match);
+        while (index->gap_end < index->capacity && index->matches[index->gap_end].pos + index->length < pos) {
+            index->gap_end++;
+            dropped = true;
+        }
+        match_index_push(index, match);
+    }
+    match_index_cover(index, start, end);
+    if (dropped && index->gap_end == index->capacity) {
+        // what followed the dropped matches is not known any more
+        s64 r = match_index_find_range(index, pos);
+        if (r < (s64)index->covered.count && index->covered.data[r].start <= pos) {
+            match_index_uncover(index, pos, index->covered.data[r].end);
+        }
+    }
+}
+
+// Adds the non-empty matches overlapping [start, end) to out in order, first searching the parts
+// not searched yet
+internal void match_index_query(MatchIndex *index, Regex *regex, TextBuffer *text, s64 start, s64 end, Array<StringMatch> *out) {
+    s64 length = text_length(text);
+    if (end > length) end = length;
+    // a match ending in the range can start up to reach before it, and an empty one can start at
+    // the very end of the text
+    s64 from = start - index->reach > 0 ? start - index->reach : 0;
+    s64 to = end < length ? end : length + 1;
+    TextSnapshot *snapshot = nullptr;
+    for (s64 pos = from; pos < to; ) {
+        s64 r = match_index_find_range(index, pos);
+        if (r < (s64)index->covered.count && index->covered.data[r].start <= pos) {
+            pos = index->covered.data[r].end;
+            continue;
+        }
+        s64 hole_end = r < (s64)index->covered.count && index->covered.data[r].start < to ? index->covered.data[r].start : to;
+        if (snapshot == nullptr) snapshot = text_snapshot(text);
+        match_index_fill(index, regex, snapshot, pos, hole_end);
+        pos = hole_end;
+    }
+    // freed before the next edit, so the gap buffer gets its block back without a copy
+    if (snapshot) text_snapshot_free(snapshot);
+
+    s64 count = match_index_count(index);
+    for (s64 i = match_index_lower_bound(index, from); i < count; i++) {
+        StringMatch match = match_index_get(index, i);
+        if (match.pos >= end) break;
+        if (match.pos + match.count > start) out->push(match);
+    }
+}
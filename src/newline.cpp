@@ -0,0 +1,282 @@
+// @note Newline scanning
+// Every newline search over bulk text goes through these kernels: line indexing, rope newline
+// counts and line ending detection and conversion. An SSE2 version is the x86 baseline and an AVX2 version is
+// picked at startup when the cpu has it. Both compare a whole register of bytes against '\n' and
+// turn the result into a bit mask, so a block without newlines costs one compare.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NEWLINE_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+typedef s64 (*NewlineCountProc)(u8 *text, s64 count);
+// writes the offsets of the newlines in text to out until out is full; every newline before
+// *scanned has been written
+typedef s64 (*NewlineFindProc)(u8 *text, s64 count, s64 *out, s64 out_count, s64 *scanned);
+
+struct NewlineKernel {
+    const char *name;
+    NewlineCountProc count;
+    NewlineFindProc find;
+};
+
+inline internal u32 bit_scan_forward(u32 mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctz(mask);
+#endif
+}
+
+internal s64 newline_count_scalar(u8 *text, s64 count) {
+    s64 result = 0;
+    for (s64 i = 0; i < count; i++) {
+        if (text[i] == '\n') result++;
+    }
+    return result;
+}
+
+internal s64 newline_find_scalar(u8 *text, s64 count, s64 *out, s64 out_count, s64 *scanned) {
+    s64 n = 0;
+    s64 i = 0;
+    for (; i < count; i++) {
+        if (text[i] == '\n') {
+            if (n == out_count) break;
+            out[n++] = i;
+        }
+    }
+    *scanned = i;
+    return n;
+}
+
+#if NEWLINE_SIMD
+internal s64 newline_count_sse2(u8 *text, s64 count) {
+    __m128i newline = _mm_set1_epi8('\n');
+    __m128i zero = _mm_setzero_si128();
+    s64 result = 0;
+    s64 i = 0;
+    while (count - i >= 16) {
+        // matches are -1, so subtracting counts them per byte lane; flush before a lane can wrap
+        s64 blocks = (count - i) / 16;
+        if (blocks > 255) blocks = 255;
+        __m128i lanes = zero;
+        for (s64 b = 0; b < blocks; b++, i += 16) {
+            __m128i v = _mm_loadu_si128((__m128i *)(text + i));
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(v, newline));
+        }
+        __m128i sums = _mm_sad_epu8(lanes, zero);
+        result += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+    return result + newline_count_scalar(text + i, count - i);
+}
+
+internal s64 newline_find_sse2(u8 *text, s64 count, s64 *out, s64 out_count, s64 *scanned) {
+    __m128i newline = _mm_set1_epi8('\n');
+    s64 n = 0;
+    s64 i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((__m128i *)(text + i));
+        u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+        while (mask) {
+            if (n == out_count) {
+                // full inside this block, resume right after the last newline written
+                *scanned = n > 0 ? out[n - 1] + 1 : i;
+                return n;
+            }
+            out[n++] = i + bit_scan_forward(mask);
+            mask &= mask - 1;
+        }
+    }
+
+    // tail shorter than a register
+    s64 rest;
+    s64 found = newline_find_scalar(text + i, count - i, out + n, out_count - n, &rest);
+    for (s64 k = n; k < n + found; k++) {
+        out[k] += i;
+    }
+    n += found;
+    i += rest;
+    *scanned = i;
+    return n;
+}
+
+TARGET_AVX2 internal s64 newline_count_avx2(u8 *text, s64 count) {
+    __m256i newline = _mm256_set1_epi8('\n');
+    __m256i zero = _mm256_setzero_si256();
+    s64 result = 0;
+    s64 i = 0;
+    while (count - i >= 32) {
+        s64 blocks = (count - i) / 32;
+        if (blocks > 255) blocks = 255;
+        __m256i lanes = zero;
+        for (s64 b = 0; b < blocks; b++, i += 32) {
+            __m256i v = _mm256_loadu_si256((__m256i *)(text + i));
+            lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(v, newline));
+        }
+        __m256i sums = _mm256_sad_epu8(lanes, zero);
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        result += _mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+    }
+    return result + newline_count_sse2(text + i, count - i);
+}
+
+TARGET_AVX2 internal s64 newline_find_avx2(u8 *text, s64 count, s64 *out, s64 out_count, s64 *scanned) {
+    __m256i newline = _mm256_set1_epi8('\n');
+    s64 n = 0;
+    s64 i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256((__m256i *)(text + i));
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline));
+        while (mask) {
+            if (n == out_count) {
+                // full inside this block, resume right after the last newline written
+                *scanned = n > 0 ? out[n - 1] + 1 : i;
+                return n;
+            }
+            out[n++] = i + bit_scan_forward(mask);
+            mask &= mask - 1;
+        }
+    }
+
+    // tail shorter than a register
+    s64 rest;
+    s64 found = newline_find_sse2(text + i, count - i, out + n, out_count - n, &rest);
+    for (s64 k = n; k < n + found; k++) {
+        out[k] += i;
+    }
+    n += found;
+    i += rest;
+    *scanned = i;
+    return n;
+}
+
+internal bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    // the os has to save ymm registers as well
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // NEWLINE_SIMD
+
+global NewlineKernel newline_kernels[] = {
+    { "scalar", newline_count_scalar, newline_find_scalar },
+#if NEWLINE_SIMD
+    { "sse2",   newline_count_sse2,   newline_find_sse2 },
+    { "avx2",   newline_count_avx2,   newline_find_avx2 },
+#endif
+};
+
+internal s32 newline_kernels_supported() {
+#if NEWLINE_SIMD
+    return cpu_has_avx2() ? 3 : 2;
+#else
+    return 1;
+#endif
+}
+
+// picked during static initialization, before any thread can scan
+global NewlineKernel *newline_kernel = &newline_kernels[newline_kernels_supported() - 1];
+
+inline internal s64 newline_count(u8 *text, s64 count) {
+    return newline_kernel->count(text, count);
+}
+
+inline internal s64 newline_find(u8 *text, s64 count, s64 *out, s64 out_count, s64 *scanned) {
+    return newline_kernel->find(text, count, out, out_count, scanned);
+}
+
+// @note Line endings
+// Text is kept with LF endings. CRLF files lose their '\r's in one pass on open and get them
+// back while being streamed out on save, so LF files are never converted at all.
+
+// the line ending most lines use, a file without newlines counts as LF
+internal LineEnding detect_line_ending(u8 *text, s64 count) {
+    s64 offsets[1024];
+    s64 lf = 0;
+    s64 crlf = 0;
+    for (s64 pos = 0; pos < count; ) {
+        s64 scanned;
+        s64 n = newline_find(text + pos, count - pos, offsets, ARRAYCOUNT(offsets), &scanned);
+        for (s64 i = 0; i < n; i++) {
+            s64 newline = pos + offsets[i];
+            if (newline > 0 && text[newline - 1] == '\r') crlf++;
+            else lf++;
+        }
+        pos += scanned;
+    }
+    return crlf > lf ? LineEnding::CRLF : LineEnding::LF;
+}
+
+// copies src to dest dropping the '\r' of every "\r\n", returns the new length. dest may be src,
+// writes never pass the bytes still to be read.
+internal s64 crlf_to_lf(u8 *dest, u8 *src, s64 count) {
+    s64 offsets[1024];
+    s64 out = 0;
+    s64 start = 0;
+    for (s64 pos = 0; pos < count; ) {
+        s64 scanned;
+        s64 n = newline_find(src + pos, count - pos, offsets, ARRAYCOUNT(offsets), &scanned);
+        for (s64 i = 0; i < n; i++) {
+            s64 newline = pos + offsets[i];
+            if (newline > 0 && src[newline - 1] == '\r') {
+                memmove(dest + out, src + start, newline - 1 - start);
+                out += newline - 1 - start;
+                start = newline;
+            }
+        }
+        pos += scanned;
+    }
+    memmove(dest + out, src + start, count - start);
+    return out + count - start;
+}
+
+// copies src into dest expanding every '\n' to "\r\n" until dest is full, returns the bytes
+// written and sets *consumed to how much of src they cover
+internal s64 lf_to_crlf(u8 *dest, s64 dest_count, u8 *src, s64 count, s64 *consumed) {
+    s64 offsets[1024];
+    s64 out = 0;
+    s64 start = 0;
+    for (s64 pos = 0; pos < count; ) {
+        s64 scanned;
+        s64 n = newline_find(src + pos, count - pos, offsets, ARRAYCOUNT(offsets), &scanned);
+        for (s64 i = 0; i < n; i++) {
+            s64 newline = pos + offsets[i];
+            s64 length = newline - start;
+            if (out + length + 2 > dest_count) {
+                // as much of the line as fits, the caller flushes and comes back for the rest
+                s64 fit = dest_count - out < length ? dest_count - out : length;
+                memcpy(dest + out, src + start, fit);
+                *consumed = start + fit;
+                return out + fit;
+            }
+            memcpy(dest + out, src + start, length);
+            dest[out + length] = '\r';
+            dest[out + length + 1] = '\n';
+            out += length + 2;
+            start = newline + 1;
+        }
+        pos += scanned;
+    }
+    s64 fit = dest_count - out < count - start ? dest_count - out : count - start;
+    memcpy(dest + out, src + start, fit);
+    *consumed = start + fit;
+    return out + fit;
+}
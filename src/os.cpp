@@ -0,0 +1,326 @@
+// @note OS layer
+// Platform calls the editor needs beyond what xpath covers. Each function has a win32 and a
+// linux body.
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// read-only view of a whole file, pages are faulted in as they are touched
+struct FileMap {
+    u8 *data;
+    s64 size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+#ifdef _WIN32
+internal bool os_map_file(char *file_name, FileMap *map) {
+    block_zero(map, sizeof(FileMap));
+    // share delete so the file can still be replaced while it is mapped
+    map->file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        printf("CreateFile: error opening file: %s!\n", file_name);
+        map->file = NULL;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(map->file, &size)) {
+        printf("GetFileSize: error getting size of file: %s!\n", file_name);
+        CloseHandle(map->file);
+        map->file = NULL;
+        return false;
+    }
+    map->size = size.QuadPart;
+    // empty files cannot be mapped
+    if (map->size == 0) {
+        return true;
+    }
+
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map->mapping) {
+        map->data = (u8 *)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (map->data == nullptr) {
+        printf("MapViewOfFile: error mapping file: %s!\n", file_name);
+        if (map->mapping) CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        block_zero(map, sizeof(FileMap));
+        return false;
+    }
+    return true;
+}
+
+internal void os_unmap_file(FileMap *map) {
+    if (map->data) UnmapViewOfFile(map->data);
+    if (map->mapping) CloseHandle(map->mapping);
+    if (map->file) CloseHandle(map->file);
+    block_zero(map, sizeof(FileMap));
+}
+
+// Reads up to size bytes from the start of the file into dest, for files small enough that
+// mapping them costs more than copying. Returns the count read or -1.
+internal s64 os_read_file(char *file_name, u8 *dest, s64 size) {
+    HANDLE file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return -1;
+    s64 total = 0;
+    while (total < size) {
+        DWORD chunk = size - total < (1 << 30) ? (DWORD)(size - total) : (1 << 30);
+        DWORD read = 0;
+        if (!ReadFile(file, dest + total, chunk, &read, NULL) || read == 0) break;
+        total += read;
+    }
+    CloseHandle(file);
+    return total;
+}
+#elif defined(__linux__)
+internal bool os_map_file(char *file_name, FileMap *map) {
+    block_zero(map, sizeof(FileMap));
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        printf("open: error opening file: %s!\n", file_name);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        printf("fstat: error getting size of file: %s!\n", file_name);
+        close(fd);
+        return false;
+    }
+    map->size = st.st_size;
+    if (map->size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void *data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("mmap: error mapping file: %s!\n", file_name);
+        map->size = 0;
+        return false;
+    }
+    map->data = (u8 *)data;
+    return true;
+}
+
+internal void os_unmap_file(FileMap *map) {
+    if (map->data) munmap(map->data, map->size);
+    block_zero(map, sizeof(FileMap));
+}
+
+internal s64 os_read_file(char *file_name, u8 *dest, s64 size) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) return -1;
+    s64 total = 0;
+    while (total < size) {
+        ssize_t n = pread(fd, dest + total, size - total, total);
+        if (n <= 0) break;
+        total += n;
+    }
+    close(fd);
+    return total;
+}
+#endif
+
+#ifdef _WIN32
+internal f64 os_seconds() {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (f64)counter.QuadPart / (f64)frequency.QuadPart;
+}
+#elif defined(__linux__)
+internal f64 os_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (f64)now.tv_sec + (f64)now.tv_nsec * 1e-9;
+}
+#endif
+
+typedef void (*ThreadProc)(void *data);
+
+// heap copy handed to the new thread, which frees it
+struct ThreadStart {
+    ThreadProc proc;
+    void *data;
+};
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+
+struct Mutex {
+    CRITICAL_SECTION section;
+};
+
+struct Condition {
+    CONDITION_VARIABLE variable;
+};
+
+internal DWORD WINAPI win32_thread_start(LPVOID param) {
+    ThreadStart start = *(ThreadStart *)param;
+    free(param);
+    start.proc(start.data);
+    return 0;
+}
+
+internal Thread os_thread_start(ThreadProc proc, void *data) {
+    ThreadStart *start = (ThreadStart *)malloc(sizeof(ThreadStart));
+    start->proc = proc;
+    start->data = data;
+    return CreateThread(NULL, 0, win32_thread_start, start, 0, NULL);
+}
+
+internal void os_thread_join(Thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+internal void os_mutex_init(Mutex *mutex) {
+    InitializeCriticalSection(&mutex->section);
+}
+
+internal void os_mutex_free(Mutex *mutex) {
+    DeleteCriticalSection(&mutex->section);
+}
+
+internal void os_mutex_lock(Mutex *mutex) {
+    EnterCriticalSection(&mutex->section);
+}
+
+internal void os_mutex_unlock(Mutex *mutex) {
+    LeaveCriticalSection(&mutex->section);
+}
+
+internal void os_condition_init(Condition *condition) {
+    InitializeConditionVariable(&condition->variable);
+}
+
+internal void os_condition_free(Condition *condition) {
+}
+
+// the mutex has to be held, it is let go while waiting and held again on return
+internal void os_condition_wait(Condition *condition, Mutex *mutex) {
+    SleepConditionVariableCS(&condition->variable, &mutex->section, INFINITE);
+}
+
+internal void os_condition_wake_all(Condition *condition) {
+    WakeAllConditionVariable(&condition->variable);
+}
+
+internal s32 os_processor_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (s32)info.dwNumberOfProcessors;
+}
+
+// both return the new value
+internal s32 os_atomic_increment(volatile s32 *value) {
+    return InterlockedIncrement((volatile LONG *)value);
+}
+
+internal s32 os_atomic_decrement(volatile s32 *value) {
+    return InterlockedDecrement((volatile LONG *)value);
+}
+
+// for flags one thread sets and others poll
+internal s32 os_atomic_load(volatile s32 *value) {
+    return InterlockedCompareExchange((volatile LONG *)value, 0, 0);
+}
+
+internal void os_atomic_store(volatile s32 *value, s32 new_value) {
+    InterlockedExchange((volatile LONG *)value, new_value);
+}
+#elif defined(__linux__)
+typedef pthread_t Thread;
+
+struct Mutex {
+    pthread_mutex_t mutex;
+};
+
+struct Condition {
+    pthread_cond_t cond;
+};
+
+internal void *linux_thread_start(void *param) {
+    ThreadStart start = *(ThreadStart *)param;
+    free(param);
+    start.proc(start.data);
+    return NULL;
+}
+
+internal Thread os_thread_start(ThreadProc proc, void *data) {
+    ThreadStart *start = (ThreadStart *)malloc(sizeof(ThreadStart));
+    start->proc = proc;
+    start->data = data;
+    Thread thread;
+    pthread_create(&thread, NULL, linux_thread_start, start);
+    return thread;
+}
+
+internal void os_thread_join(Thread thread) {
+    pthread_join(thread, NULL);
+}
+
+internal void os_mutex_init(Mutex *mutex) {
+    pthread_mutex_init(&mutex->mutex, NULL);
+}
+
+internal void os_mutex_free(Mutex *mutex) {
+    pthread_mutex_destroy(&mutex->mutex);
+}
+
+internal void os_mutex_lock(Mutex *mutex) {
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+internal void os_mutex_unlock(Mutex *mutex) {
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+internal void os_condition_init(Condition *condition) {
+    pthread_cond_init(&condition->cond, NULL);
+}
+
+internal void os_condition_free(Condition *condition) {
+    pthread_cond_destroy(&condition->cond);
+}
+
+internal void os_condition_wait(Condition *condition, Mutex *mutex) {
+    pthread_cond_wait(&condition->cond, &mutex->mutex);
+}
+
+internal void os_condition_wake_all(Condition *condition) {
+    pthread_cond_broadcast(&condition->cond);
+}
+
+internal s32 os_processor_count() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (s32)count : 1;
+}
+
+internal s32 os_atomic_increment(volatile s32 *value) {
+    return __atomic_add_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+internal s32 os_atomic_decrement(volatile s32 *value) {
+    return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+internal s32 os_atomic_load(volatile s32 *value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+internal void os_atomic_store(volatile s32 *value, s32 new_value) {
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+}
+#endif
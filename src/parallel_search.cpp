@@ -0,0 +1,205 @@
+// @note Parallel search
+// The text is cut into chunks that workers search at the same time, each with its own compile of
+// the pattern since a regex keeps its state cache to itself. A chunk owns the matches starting in
+// it and its search runs past its end as far as the longest match can reach. Patterns whose
+// matches never hold a '\n' get chunks cut at line starts instead and need nothing past the end.
+// Ones that can run over lines without bound cannot be cut at all, the merge searches the whole
+// text itself one match at a time.
+//
+// Chunks finish in any order and are merged in text order as they come in, so the first matches
+// are ready long before the scan is through. A chunk's matches follow from searching it from its
+// start. When the match merged before it runs into the chunk, the merge searches on from where
+// that match ends until it meets one of the chunk's own, after which the two agree.
+
+#define PARALLEL_SEARCH_CHUNK (4 * 1024 * 1024)
+#define PARALLEL_SEARCH_MIN (16 * 1024 * 1024) // less text than this is searched on the caller's thread
+#define PARALLEL_SEARCH_AHEAD 4                // chunks each worker may search ahead of the merge
+
+// where a search after the match starts, one byte on from an empty match
+inline internal s64 search_next_start(StringMatch match) {
+    return match.pos + (match.count > 0 ? match.count : 1);
+}
+
+// the first line start at or after pos, or the end of the text
+internal s64 parallel_search_cut(TextSnapshot *snapshot, s64 pos) {
+    while (pos < snapshot->length) {
+        s64 count;
+        u8 *span = text_snapshot_span(snapshot, pos, &count);
+        u8 *found = (u8 *)memchr(span, '\n', count);
+        if (found) return pos + (found - span) + 1;
+        pos += count;
+    }
+    return snapshot->length;
+}
+
+internal void parallel_search_run(void *data) {
+    ParallelSearch *search = (ParallelSearch *)data;
+    const char *error;
+    Regex *regex = regex_compile((u8 *)search->pattern.data, search->pattern.count, &error);
+    regex_set_cancel(regex, &search->cancel);
+    s64 ahead = PARALLEL_SEARCH_AHEAD * search->thread_count;
+    for (;;) {
+        os_mutex_lock(&search->mutex);
+        while (!search_cancelled(&search->cancel) && search->next_chunk < search->chunk_count && search->next_chunk >= search->merging + ahead) {
+            os_condition_wait(&search->changed, &search->mutex);
+        }
+        s64 index = search->next_chunk++;
+        os_mutex_unlock(&search->mutex);
+        if (search_cancelled(&search->cancel) || index >= search->chunk_count) break;
+
+        SearchChunk *chunk = &search->chunks[index];
+        for (s64 pos = chunk->start; ; pos = search_next_start(chunk->matches.data[chunk->matches.count - 1])) {
+            StringMatch match = regex_find(regex, search->snapshot, pos, chunk->end + search->overlap);
+            if (match.pos < 0 || match.pos >= chunk->end) break;
+            chunk->matches.push(match);
+            if (search->first_only) {
+                chunk->stopped = true;
+                break;
+            }
+        }
+
+        os_mutex_lock(&search->mutex);
+        chunk->done = true;
+        os_condition_wake_all(&search->changed);
+        os_mutex_unlock(&search->mutex);
+    }
+    regex_free(regex);
+}
+
+// Searches the snapshot from from to its end on up to thread_count workers, first_only has each
+// chunk stop at its first match. Takes ownership of the snapshot, also when the pattern is bad, in
+// which case it returns nullptr and sets error.
+internal ParallelSearch *parallel_search_start(TextSnapshot *snapshot, string pattern, s64 from, s32 thread_count, bool first_only, const char **error) {
+    Regex *regex = regex_compile((u8 *)pattern.data, pattern.count, error);
+    if (regex == nullptr) {
+        text_snapshot_free(snapshot);
+        return nullptr;
+    }
+    ParallelSearch *search = (ParallelSearch *)malloc(sizeof(ParallelSearch));
+    block_zero(search, sizeof(ParallelSearch));
+    search->snapshot = snapshot;
+    search->pattern.data = (char *)malloc(pattern.count + 1);
+    memcpy(search->pattern.data, pattern.data, pattern.count);
+    search->pattern.data[pattern.count] = '\0';
+    search->pattern.count = pattern.count;
+    search->first_only = first_only;
+    search->regex = regex;
+
+    s64 length = snapshot->length;
+    if (from > length) from = length;
+    search->next_start = from;
+    bool lines = !regex->multiline;
+    bool whole = !lines && regex->max_length < 0;
+    search->overlap = lines || whole ? 0 : regex->max_length;
+    Array<SearchChunk> chunks{};
+    for (s64 start = from; ; ) {
+        SearchChunk chunk{};
+        chunk.start = start;
+        chunk.end = whole ? length : start + PARALLEL_SEARCH_CHUNK;
+        if (lines && chunk.end < length) chunk.end = parallel_search_cut(snapshot, chunk.end);
+        // the last chunk also owns an empty match at the very end
+        if (chunk.end >= length) chunk.end = length + 1;
+        chunks.push(chunk);
+        if (chunk.end > length) break;
+        start = chunk.end;
+    }
+    search->chunks = chunks.data;
+    search->chunk_count = (s64)chunks.count;
+
+    os_mutex_init(&search->mutex);
+    os_condition_init(&search->changed);
+    search->thread_count = thread_count < search->chunk_count ? thread_count : (s32)search->chunk_count;
+    if (search->thread_count < 1) search->thread_count = 1;
+    if (whole) {
+        // left for the merge to search on from its start
+        search->chunks[0].stopped = true;
+        search->chunks[0].done = true;
+        search->thread_count = 0;
+    }
+    search->threads = (Thread *)malloc(search->thread_count * sizeof(Thread));
+    for (s32 i = 0; i < search->thread_count; i++) {
+        search->threads[i] = os_thread_start(parallel_search_run, search);
+    }
+    return search;
+}
+
+internal void parallel_search_next_chunk(ParallelSearch *search) {
+    search->chunks[search->merging].matches.clear();
+    search->ready = false;
+    os_mutex_lock(&search->mutex);
+    search->merging++;
+    os_condition_wake_all(&search->changed);
+    os_mutex_unlock(&search->mutex);
+}
+
+// Hands out the next match in text order, waiting for the chunk it lies in to be searched.
+// Returns false once there are no more.
+internal bool parallel_search_next(ParallelSearch *search, StringMatch *match) {
+    while (search->merging < search->chunk_count) {
+        SearchChunk *chunk = &search->chunks[search->merging];
+        if (!search->ready) {
+            os_mutex_lock(&search->mutex);
+            while (!chunk->done) {
+                os_condition_wait(&search->changed, &search->mutex);
+            }
+            os_mutex_unlock(&search->mutex);
+            search->ready = true;
+            search->synced = search->next_start <= chunk->start;
+            search->match_index = 0;
+        }
+
+        Array<StringMatch> *matches = &chunk->matches;
+        if (search->synced) {
+            if (search->match_index < (s64)matches->count) {
+                *match = matches->data[search->match_index++];
+                search->next_start = search_next_start(*match);
+                return true;
+            }
+            if (!chunk->stopped) {
+                parallel_search_next_chunk(search);
+                continue;
+            }
+            search->synced = false;
+        }
+
+        StringMatch found = regex_find(search->regex, search->snapshot, search->next_start, chunk->end + search->overlap);
+        if (found.pos < 0 || found.pos >= chunk->end) {
+            parallel_search_next_chunk(search);
+            continue;
+        }
+        while (search->match_index < (s64)matches->count && matches->data[search->match_index].pos < found.pos) {
+            search->match_index++;
+        }
+        if (search->match_index < (s64)matches->count && matches->data[search->match_index].pos == found.pos &&
+            matches->data[search->match_index].count == found.count) {
+            search->synced = true;
+            continue;
+        }
+        *match = found;
+        search->next_start = search_next_start(found);
+        return true;
+    }
+    return false;
+}
+
+// stops the workers if they are still going
+internal void parallel_search_free(ParallelSearch *search) {
+    os_mutex_lock(&search->mutex);
+    os_atomic_store(&search->cancel, true);
+    os_condition_wake_all(&search->changed);
+    os_mutex_unlock(&search->mutex);
+    for (s32 i = 0; i < search->thread_count; i++) {
+        os_thread_join(search->threads[i]);
+    }
+    for (s64 i = 0; i < search->chunk_count; i++) {
+        search->chunks[i].matches.clear();
+    }
+    free(search->chunks);
+    free(search->threads);
+    os_condition_free(&search->changed);
+    os_mutex_free(&search->mutex);
+    regex_free(search->regex);
+    text_snapshot_free(search->snapshot);
+    free(search->pattern.data);
+    free(search);
+}
@@ -0,0 +1,244 @@
+// @note Piece table backend
+// Pieces live in a treap with implicit byte keys: split/merge give O(log n) insert and delete
+// and offset lookup walks one root-to-leaf path. Consecutive typing extends the piece that ends
+// at the tail of the add buffer instead of allocating a new one. Split and merge take over the
+// references they are passed and copy a piece before changing it while a snapshot holds it, so
+// an edit copies at most the pieces along the paths it walks.
+
+inline internal s64 piece_bytes(Piece *piece) {
+    return piece ? piece->bytes : 0;
+}
+
+inline internal void piece_update(Piece *piece) {
+    piece->bytes = piece_bytes(piece->left) + piece->length + piece_bytes(piece->right);
+}
+
+internal Piece *piece_new(PieceTable *table, b32 add, s64 start, s64 length) {
+    // xorshift32
+    u32 x = table->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    table->seed = x;
+
+    Piece *piece = (Piece *)malloc(sizeof(Piece));
+    block_zero(piece, sizeof(Piece));
+    piece->refs = 1;
+    piece->priority = x;
+    piece->add = add;
+    piece->start = start;
+    piece->length = length;
+    piece->bytes = length;
+    return piece;
+}
+
+inline internal void piece_ref(Piece *piece) {
+    if (piece) os_atomic_increment(&piece->refs);
+}
+
+internal void piece_release(Piece *piece) {
+    if (piece && os_atomic_decrement(&piece->refs) == 0) {
+        piece_release(piece->left);
+        piece_release(piece->right);
+        free(piece);
+    }
+}
+
+// a piece that can be changed in place, copied when something else still holds it
+internal Piece *piece_unique(Piece *piece) {
+    if (piece->refs == 1) return piece;
+    Piece *copy = (Piece *)malloc(sizeof(Piece));
+    *copy = *piece;
+    copy->refs = 1;
+    piece_ref(copy->left);
+    piece_ref(copy->right);
+    piece_release(piece);
+    return copy;
+}
+
+internal Piece *piece_merge(Piece *a, Piece *b) {
+    if (a == nullptr) return b;
+    if (b == nullptr) return a;
+    if (a->priority > b->priority) {
+        a = piece_unique(a);
+        a->right = piece_merge(a->right, b);
+        piece_update(a);
+        return a;
+    }
+    b = piece_unique(b);
+    b->left = piece_merge(a, b->left);
+    piece_update(b);
+    return b;
+}
+
+// left receives the first pos bytes, a piece straddling pos is cut in two
+internal void piece_split(PieceTable *table, Piece *node, s64 pos, Piece **left, Piece **right) {
+    if (node == nullptr) {
+        *left = *right = nullptr;
+        return;
+    }
+
+    node = piece_unique(node);
+    s64 left_bytes = piece_bytes(node->left);
+    if (pos <= left_bytes) {
+        piece_split(table, node->left, pos, left, &node->left);
+        piece_update(node);
+        *right = node;
+    } else if (pos >= left_bytes + node->length) {
+        piece_split(table, node->right, pos - left_bytes - node->length, &node->right, right);
+        piece_update(node);
+        *left = node;
+    } else {
+        s64 cut = pos - left_bytes;
+        Piece *tail = piece_new(table, node->add, node->start + cut, node->length - cut);
+        Piece *rest = node->right;
+        node->right = nullptr;
+        node->length = cut;
+        piece_update(node);
+        *left = node;
+        *right = piece_merge(tail, rest);
+    }
+}
+
+// whether inserting at pos can grow the piece ending there, which must end at add_start
+internal bool piece_extendable(Piece *node, s64 pos, s64 add_start) {
+    while (node) {
+        s64 left_bytes = piece_bytes(node->left);
+        if (pos <= left_bytes) {
+            node = node->left;
+        } else if (pos < left_bytes + node->length) {
+            return false;
+        } else if (pos == left_bytes + node->length) {
+            return node->add && node->start + node->length == add_start;
+        } else {
+            pos -= left_bytes + node->length;
+            node = node->right;
+        }
+    }
+    return false;
+}
+
+internal void piece_extend(Piece **slot, s64 pos, s64 count) {
+    for (;;) {
+        Piece *node = *slot = piece_unique(*slot);
+        node->bytes += count;
+        s64 left_bytes = piece_bytes(node->left);
+        if (pos <= left_bytes) {
+            slot = &node->left;
+        } else if (pos == left_bytes + node->length) {
+            node->length += count;
+            return;
+        } else {
+            pos -= left_bytes + node->length;
+            slot = &node->right;
+        }
+    }
+}
+
+// takes over the reference to original
+internal void piece_table_init(PieceTable *table, SharedBytes *original, s64 length) {
+    block_zero(table, sizeof(PieceTable));
+    table->seed = 0x9E3779B9;
+    table->original = original;
+    table->original_length = length;
+    if (length > 0) {
+        table->root = piece_new(table, false, 0, length);
+    }
+}
+
+internal void piece_table_clear(PieceTable *table) {
+    piece_release(table->root);
+    table->root = nullptr;
+    table->span = nullptr;
+}
+
+internal void piece_table_free(PieceTable *table) {
+    piece_table_clear(table);
+    shared_bytes_release(table->original);
+    if (table->add_shared) {
+        shared_bytes_release(table->add_shared);
+    } else {
+        free(table->add);
+    }
+    block_zero(table, sizeof(PieceTable));
+}
+
+inline internal s64 piece_table_length(PieceTable *table) {
+    return piece_bytes(table->root);
+}
+
+// the piece holding pos, *base is where it starts
+internal Piece *piece_find(Piece *node, s64 pos, s64 *base) {
+    *base = 0;
+    while (node) {
+        s64 left_bytes = piece_bytes(node->left);
+        if (pos < *base + left_bytes) {
+            node = node->left;
+        } else if (pos < *base + left_bytes + node->length) {
+            *base += left_bytes;
+            return node;
+        } else {
+            *base += left_bytes + node->length;
+            node = node->right;
+        }
+    }
+    return nullptr;
+}
+
+// returns the contiguous bytes from pos to the end of its piece
+internal u8 *piece_table_span(PieceTable *table, s64 pos, s64 *count) {
+    if (table->span && pos >= table->span_start && pos < table->span_end) {
+        *count = table->span_end - pos;
+        return table->span + (pos - table->span_start);
+    }
+
+    s64 base;
+    Piece *node = piece_find(table->root, pos, &base);
+    if (node == nullptr) {
+        *count = 0;
+        return nullptr;
+    }
+    u8 *source = node->add ? table->add : table->original->data;
+    table->span = source + node->start;
+    table->span_start = base;
+    table->span_end = base + node->length;
+    *count = table->span_end - pos;
+    return table->span + (pos - base);
+}
+
+internal void piece_table_insert(PieceTable *table, s64 pos, u8 *text, s64 count) {
+    if (table->add_count + count > table->add_capacity) {
+        // a snapshot keeps reading the old block, so it is left where it is
+        if (table->add_shared) {
+            table->add = shared_bytes_take(table->add_shared, table->add_count);
+            table->add_shared = nullptr;
+        }
+        s64 capacity = table->add_capacity * 2;
+        if (capacity < table->add_count + count) capacity = table->add_count + count;
+        if (capacity < 4096) capacity = 4096;
+        table->add = (u8 *)realloc(table->add, capacity);
+        table->add_capacity = capacity;
+    }
+    s64 add_start = table->add_count;
+    memcpy(table->add + add_start, text, count);
+    table->add_count += count;
+    table->span = nullptr;
+
+    if (piece_extendable(table->root, pos, add_start)) {
+        piece_extend(&table->root, pos, count);
+    } else {
+        Piece *left, *right;
+        piece_split(table, table->root, pos, &left, &right);
+        Piece *piece = piece_new(table, true, add_start, count);
+        table->root = piece_merge(piece_merge(left, piece), right);
+    }
+}
+
+internal void piece_table_delete(PieceTable *table, s64 start, s64 end) {
+    Piece *left, *middle, *right;
+    piece_split(table, table->root, start, &left, &middle);
+    piece_split(table, middle, end - start, &middle, &right);
+    piece_release(middle);
+    table->root = piece_merge(left, right);
+    table->span = nullptr;
+}
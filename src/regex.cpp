@@ -0,0 +1,1137 @@
+// @note Regex
+// Patterns compile to a Thompson program that runs two ways. A lazily built DFA does the
+// scanning. Each of its states is the program's live threads in priority order, made the first
+// time a byte leads there and kept in a bounded cache. The forward DFA finds where the leftmost
+// match ends, then a DFA of the reversed program runs back from there to where it starts. A
+// pattern that keeps overflowing the cache is run on a Pike VM instead. Either way each byte is
+// looked at a bounded number of times per program instruction, so there is no backtracking to
+// blow up. Patterns that are plain strings skip all of this and go to the literal searcher.
+// Like the literal searcher it reads a snapshot and can be cancelled from another thread, but a
+// compiled regex keeps its state cache, so only one thread may search with it at a time.
+//
+// Supported: literals, '.', [classes], \d \w \s and their negations, groups, |, * + ? {m,n} and
+// their lazy forms, and ^ $ at line boundaries. Matching is on bytes and '.' never matches '\n'.
+
+#define REGEX_MAX_INSTS 20000
+#define REGEX_MAX_REPEAT 1000
+#define REGEX_MAX_DEPTH 200
+
+enum RegexNodeKind {
+    RegexEmpty,
+    RegexBytes,
+    RegexConcat,
+    RegexAlternate,
+    RegexRepeat,
+    RegexLineStart,
+    RegexLineEnd,
+};
+
+struct RegexNode {
+    RegexNodeKind kind;
+    s32 a; // first child, or the byte set of RegexBytes
+    s32 b; // second child
+    s32 min;
+    s32 max; // -1 when unbounded
+    b32 greedy;
+};
+
+struct ByteSet {
+    u32 bits[8];
+};
+
+enum RegexOp {
+    OpByte,  // x is the byte set
+    OpSplit, // x runs before y
+    OpJump,
+    OpLineStart,
+    OpLineEnd,
+    OpMatch,
+};
+
+struct RegexInst {
+    RegexOp op;
+    s32 x;
+    s32 y;
+};
+
+struct RegexParser {
+    u8 *at;
+    u8 *end;
+    Array<RegexNode> nodes;
+    Array<ByteSet> sets;
+    const char *error;
+    s32 depth;
+};
+
+inline internal bool byte_set_has(ByteSet *set, u8 c) {
+    return (set->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+internal void byte_set_add_range(ByteSet *set, s32 lo, s32 hi) {
+    for (s32 c = lo; c <= hi; c++) {
+        set->bits[c >> 5] |= 1u << (c & 31);
+    }
+}
+
+internal void byte_set_invert(ByteSet *set) {
+    for (s32 i = 0; i < 8; i++) {
+        set->bits[i] = ~set->bits[i];
+    }
+}
+
+internal s32 byte_set_single(ByteSet *set) {
+    s32 result = -1;
+    for (s32 c = 0; c < 256; c++) {
+        if (byte_set_has(set, (u8)c)) {
+            if (result >= 0) return -1;
+            result = c;
+        }
+    }
+    return result;
+}
+
+// adds the bytes of \d \w \s and their negations, false for any other escape
+internal bool regex_escape_set(u8 c, ByteSet *set) {
+    ByteSet bytes = {};
+    switch (c) {
+    case 'd': case 'D':
+        byte_set_add_range(&bytes, '0', '9');
+        break;
+    case 'w': case 'W':
+        byte_set_add_range(&bytes, '0', '9');
+        byte_set_add_range(&bytes, 'a', 'z');
+        byte_set_add_range(&bytes, 'A', 'Z');
+        byte_set_add_range(&bytes, '_', '_');
+        break;
+    case 's': case 'S':
+        byte_set_add_range(&bytes, '\t', '\r');
+        byte_set_add_range(&bytes, ' ', ' ');
+        break;
+    default:
+        return false;
+    }
+    if (c == 'D' || c == 'W' || c == 'S') byte_set_invert(&bytes);
+    for (s32 i = 0; i < 8; i++) {
+        set->bits[i] |= bytes.bits[i];
+    }
+    return true;
+}
+
+// the byte an escape stands for, -1 when it is not one
+internal s32 regex_escape_byte(u8 c) {
+    switch (c) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case '0': return 0;
+    }
+    if (isalnum(c)) return -1;
+    return c;
+}
+
+internal s32 regex_node(RegexParser *p, RegexNodeKind kind, s32 a, s32 b) {
+    RegexNode node = {};
+    node.kind = kind;
+    node.a = a;
+    node.b = b;
+    p->nodes.push(node);
+    return (s32)p->nodes.count - 1;
+}
+
+internal s32 regex_set_node(RegexParser *p, ByteSet set) {
+    p->sets.push(set);
+    return regex_node(p, RegexBytes, (s32)p->sets.count - 1, -1);
+}
+
+internal s32 regex_fail(RegexParser *p, const char *error) {
+    p->error = error;
+    return -1;
+}
+
+internal s32 regex_parse_class(RegexParser *p) {
+    ByteSet set = {};
+    bool negate = false;
+    if (p->at < p->end && *p->at == '^') {
+        negate = true;
+        p->at++;
+    }
+    for (bool first = true; ; first = false) {
+        if (p->at >= p->end) return regex_fail(p, "missing ]");
+        u8 c = *p->at++;
+        if (c == ']' && !first) break;
+        s32 lo = c;
+        if (c == '\\') {
+            if (p->at >= p->end) return regex_fail(p, "trailing \\");
+            u8 e = *p->at++;
+            if (regex_escape_set(e, &set)) continue;
+            lo = regex_escape_byte(e);
+            if (lo < 0) return regex_fail(p, "unknown escape");
+        }
+        s32 hi = lo;
+        if (p->end - p->at >= 2 && p->at[0] == '-' && p->at[1] != ']') {
+            p->at++;
+            hi = *p->at++;
+            if (hi == '\\') {
+                if (p->at >= p->end) return regex_fail(p, "trailing \\");
+                hi = regex_escape_byte(*p->at++);
+            }
+            if (hi < lo) return regex_fail(p, "bad class range");
+        }
+        byte_set_add_range(&set, lo, hi);
+    }
+    if (negate) byte_set_invert(&set);
+    return regex_set_node(p, set);
+}
+
+internal s32 regex_parse_alternate(RegexParser *p);
+
+internal s32 regex_parse_atom(RegexParser *p) {
+    u8 c = *p->at++;
+    ByteSet set = {};
+    switch (c) {
+    case '(': {
+        if (p->end - p->at >= 2 && p->at[0] == '?' && p->at[1] == ':') p->at += 2;
+        if (++p->depth > REGEX_MAX_DEPTH) return regex_fail(p, "groups nested too deep");
+        s32 node = regex_parse_alternate(p);
+        p->depth--;
+        if (node < 0) return -1;
+        if (p->at >= p->end || *p->at != ')') return regex_fail(p, "missing )");
+        p->at++;
+        return node;
+    }
+    case '[':
+        return regex_parse_class(p);
+    case '.':
+        byte_set_add_range(&set, '\n', '\n');
+        byte_set_invert(&set);
+        return regex_set_node(p, set);
+    case '^':
+        return regex_node(p, RegexLineStart, -1, -1);
+    case '$':
+        return regex_node(p, RegexLineEnd, -1, -1);
+    case '*': case '+': case '?':
+        return regex_fail(p, "nothing to repeat");
+    case '\\': {
+        if (p->at >= p->end) return regex_fail(p, "trailing \\");
+        u8 e = *p->at++;
+        if (!regex_escape_set(e, &set)) {
+            s32 b = regex_escape_byte(e);
+            if (b < 0) return regex_fail(p, "unknown escape");
+            byte_set_add_range(&set, b, b);
+        }
+        return regex_set_node(p, set);
+    }
+    default:
+        byte_set_add_range(&set, c, c);
+        return regex_set_node(p, set);
+    }
+}
+
+internal bool regex_parse_number(RegexParser *p, s32 *value) {
+    if (p->at >= p->end || !isdigit(*p->at)) return false;
+    *value = 0;
+    while (p->at < p->end && isdigit(*p->at)) {
+        if (*value <= REGEX_MAX_REPEAT) *value = *value * 10 + (*p->at - '0');
+        p->at++;
+    }
+    return true;
+}
+
+// {m}, {m,} or {m,n}; anything else leaves the brace to be read as a literal
+internal bool regex_parse_counts(RegexParser *p, s32 *min, s32 *max) {
+    u8 *start = p->at;
+    p->at++;
+    if (regex_parse_number(p, min)) {
+        *max = *min;
+        if (p->at < p->end && *p->at == ',') {
+            p->at++;
+            *max = -1;
+            regex_parse_number(p, max);
+        }
+        if (p->at < p->end && *p->at == '}') {
+            p->at++;
+            return true;
+        }
+    }
+    p->at = start;
+    return false;
+}
+
+internal s32 regex_parse_repeat(RegexParser *p) {
+    s32 node = regex_parse_atom(p);
+    while (node >= 0 && p->at < p->end) {
+        u8 c = *p->at;
+        s32 min, max;
+        if (c == '*') {
+            min = 0; max = -1;
+            p->at++;
+        } else if (c == '+') {
+            min = 1; max = -1;
+            p->at++;
+        } else if (c == '?') {
+            min = 0; max = 1;
+            p->at++;
+        } else if (c != '{' || !regex_parse_counts(p, &min, &max)) {
+            break;
+        }
+        if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT) return regex_fail(p, "repeat count too large");
+        if (max >= 0 && max < min) return regex_fail(p, "bad repeat range");
+        bool greedy = true;
+        if (p->at < p->end && *p->at == '?') {
+            greedy = false;
+            p->at++;
+        }
+        node = regex_node(p, RegexRepeat, node, -1);
+        p->nodes.data[node].min = min;
+        p->nodes.data[node].max = max;
+        p->nodes.data[node].greedy = greedy;
+    }
+    return node;
+}
+
+internal s32 regex_parse_concat(RegexParser *p) {
+    s32 node = -1;
+    while (p->at < p->end && *p->at != '|' && *p->at != ')') {
+        s32 next = regex_parse_repeat(p);
+        if (next < 0) return -1;
+        node = node < 0 ? next : regex_node(p, RegexConcat, node, next);
+    }
+    return node < 0 ? regex_node(p, RegexEmpty, -1, -1) : node;
+}
+
+internal s32 regex_parse_alternate(RegexParser *p) {
+    s32 node = regex_parse_concat(p);
+    while (node >= 0 && p->at < p->end && *p->at == '|') {
+        p->at++;
+        s32 next = regex_parse_concat(p);
+        if (next < 0) return -1;
+        node = regex_node(p, RegexAlternate, node, next);
+    }
+    return node;
+}
+
+inline internal s32 regex_push(Array<RegexInst> *insts, RegexOp op, s32 x, s32 y) {
+    RegexInst inst = { op, x, y };
+    insts->push(inst);
+    return (s32)insts->count - 1;
+}
+
+// The reversed program matches the reversed text: concatenations run back to front and line
+// starts and ends trade places.
+internal void regex_emit(Array<RegexNode> *nodes, s32 index, Array<RegexInst> *insts, bool reverse) {
+    if (insts->count > REGEX_MAX_INSTS) return;
+    RegexNode node = nodes->data[index];
+    switch (node.kind) {
+    case RegexEmpty:
+        break;
+    case RegexBytes:
+        regex_push(insts, OpByte, node.a, 0);
+        break;
+    case RegexLineStart:
+        regex_push(insts, reverse ? OpLineEnd : OpLineStart, 0, 0);
+        break;
+    case RegexLineEnd:
+        regex_push(insts, reverse ? OpLineStart : OpLineEnd, 0, 0);
+        break;
+    case RegexConcat:
+        regex_emit(nodes, reverse ? node.b : node.a, insts, reverse);
+        regex_emit(nodes, reverse ? node.a : node.b, insts, reverse);
+        break;
+    case RegexAlternate: {
+        s32 split = regex_push(insts, OpSplit, 0, 0);
+        insts->data[split].x = split + 1;
+        regex_emit(nodes, node.a, insts, reverse);
+        s32 jump = regex_push(insts, OpJump, 0, 0);
+        insts->data[split].y = (s32)insts->count;
+        regex_emit(nodes, node.b, insts, reverse);
+        insts->data[jump].x = (s32)insts->count;
+        break;
+    }
+    case RegexRepeat: {
+        for (s32 i = 0; i < node.min; i++) {
+            regex_emit(nodes, node.a, insts, reverse);
+        }
+        if (node.max < 0) {
+            s32 split = regex_push(insts, OpSplit, 0, 0);
+            regex_emit(nodes, node.a, insts, reverse);
+            regex_push(insts, OpJump, split, 0);
+            s32 out = (s32)insts->count;
+            insts->data[split].x = node.greedy ? split + 1 : out;
+            insts->data[split].y = node.greedy ? out : split + 1;
+        } else {
+            // each optional copy may skip to the end of all of them
+            Array<s32> splits{};
+            for (s32 i = node.min; i < node.max && insts->count <= REGEX_MAX_INSTS; i++) {
+                splits.push(regex_push(insts, OpSplit, 0, 0));
+                regex_emit(nodes, node.a, insts, reverse);
+            }
+            s32 out = (s32)insts->count;
+            for (s32 split : splits) {
+                insts->data[split].x = node.greedy ? split + 1 : out;
+                insts->data[split].y = node.greedy ? out : split + 1;
+            }
+            splits.clear();
+        }
+        break;
+    }
+    }
+}
+
+internal void regex_collect_concat(Array<RegexNode> *nodes, s32 index, Array<s32> *parts) {
+    if (nodes->data[index].kind == RegexConcat) {
+        regex_collect_concat(nodes, nodes->data[index].a, parts);
+        regex_collect_concat(nodes, nodes->data[index].b, parts);
+    } else {
+        parts->push(index);
+    }
+}
+
+// @note Lazy DFA
+// A state is the ordered list of program positions threads wait at, plus flags. Only byte reads,
+// matches and unresolved line ends are listed, everything else is followed when the list is
+// built. Line starts are decided then from the byte just read. Line ends wait in the list until
+// the next byte shows whether they hold, which is also why a match is reported one byte late.
+// Transitions go through byte classes, bytes no pattern set tells apart share a column. They
+// hold the target's row offset, tagged when the scan has to look at the target more closely, so
+// the common step is one load.
+
+#define DFA_MAX_STATES 2048
+// a cache that fills again in fewer bytes than this per state is not worth rebuilding
+#define DFA_MIN_BYTES_PER_STATE 8
+
+#define DFA_LINE_START 1 // the byte before is '\n' or nothing
+#define DFA_SEEN 2       // a match was found, no thread starts after it
+#define DFA_MATCH 4      // a match ends before the byte that led here
+#define DFA_DEAD 8       // no thread left that could match
+
+#define DFA_TAG (1 << 30) // on transitions to states with flags the scan acts on
+
+struct DfaState {
+    s32 first; // into Dfa.pcs
+    s32 count;
+    u32 flags;
+    u32 hash;
+    b32 start; // nothing is under way, the scan can skip ahead with the prefix
+};
+
+struct Dfa {
+    RegexInst *insts;
+    s32 inst_count;
+    ByteSet *sets;
+    u8 *classes;     // byte to column
+    u8 *class_bytes; // a byte of each column
+    s32 stride;
+    b32 anchored;    // threads only start at the first byte
+    b32 longest;     // keep threads below a match instead of dropping them
+    b32 accelerate;  // start states are tagged
+
+    Array<DfaState> states;
+    Array<s32> pcs;
+    Array<s32> next; // states.count * stride, -1 until followed
+    s32 *table;      // open addressing of state index + 1
+    s32 table_size;
+    s32 start[2];    // by line start, -1 until built
+    s32 clears;
+
+    // scratch for building states
+    s32 *before;
+    s32 *after;
+    s32 *stack;
+    u32 *marks;
+    u32 mark;
+};
+
+struct Regex {
+    Array<RegexInst> forward_insts;
+    Array<RegexInst> reverse_insts;
+    Array<ByteSet> sets;
+    u8 classes[256];
+    u8 class_bytes[256];
+    s32 class_count;
+    Dfa forward;
+    Dfa reverse;
+    Searcher *literal; // the whole pattern is this string
+    Searcher *prefix;  // every match starts with this
+    b32 skip;          // without a prefix, matches still only start at first_bytes
+    u8 first_bytes[256];
+    b32 dfa_failed;
+    volatile b32 *cancel; // set through regex_set_cancel
+    s64 max_length; // of a match, -1 when unbounded
+    b32 multiline;  // a match may hold a '\n'
+};
+
+internal void dfa_init(Dfa *dfa, Regex *regex, Array<RegexInst> *insts, bool anchored, bool longest, bool accelerate) {
+    block_zero(dfa, sizeof(Dfa));
+    dfa->insts = insts->data;
+    dfa->inst_count = (s32)insts->count;
+    dfa->sets = regex->sets.data;
+    dfa->classes = regex->classes;
+    dfa->class_bytes = regex->class_bytes;
+    dfa->stride = regex->class_count;
+    dfa->anchored = anchored;
+    dfa->longest = longest;
+    dfa->accelerate = accelerate;
+    dfa->table_size = 2 * DFA_MAX_STATES;
+    dfa->table = (s32 *)calloc(dfa->table_size, sizeof(s32));
+    dfa->start[0] = dfa->start[1] = -1;
+    dfa->before = (s32 *)malloc(dfa->inst_count * sizeof(s32));
+    dfa->after = (s32 *)malloc(dfa->inst_count * sizeof(s32));
+    dfa->stack = (s32 *)malloc(2 * dfa->inst_count * sizeof(s32));
+    dfa->marks = (u32 *)calloc(dfa->inst_count, sizeof(u32));
+}
+
+internal void dfa_free(Dfa *dfa) {
+    dfa->states.clear();
+    dfa->pcs.clear();
+    dfa->next.clear();
+    free(dfa->table);
+    free(dfa->before);
+    free(dfa->after);
+    free(dfa->stack);
+    free(dfa->marks);
+}
+
+internal void dfa_clear(Dfa *dfa) {
+    dfa->states.count = 0;
+    dfa->pcs.count = 0;
+    dfa->next.count = 0;
+    memset(dfa->table, 0, dfa->table_size * sizeof(s32));
+    dfa->start[0] = dfa->start[1] = -1;
+    dfa->clears++;
+}
+
+inline internal void dfa_new_mark(Dfa *dfa) {
+    if (++dfa->mark == 0) {
+        memset(dfa->marks, 0, dfa->inst_count * sizeof(u32));
+        dfa->mark = 1;
+    }
+}
+
+// Appends pc and whatever it reaches without reading a byte, in priority order. line_end is
+// whether a line ends here, or -1 to leave line ends waiting.
+internal void dfa_add(Dfa *dfa, s32 pc, bool line_start, s32 line_end, s32 *list, s32 *count) {
+    s32 top = 0;
+    dfa->stack[top++] = pc;
+    while (top > 0) {
+        pc = dfa->stack[--top];
+        if (dfa->marks[pc] == dfa->mark) continue;
+        dfa->marks[pc] = dfa->mark;
+        RegexInst inst = dfa->insts[pc];
+        switch (inst.op) {
+        case OpJump:
+            dfa->stack[top++] = inst.x;
+            break;
+        case OpSplit:
+            dfa->stack[top++] = inst.y;
+            dfa->stack[top++] = inst.x;
+            break;
+        case OpLineStart:
+            if (line_start) dfa->stack[top++] = pc + 1;
+            break;
+        case OpLineEnd:
+            if (line_end < 0) list[(*count)++] = pc;
+            else if (line_end) dfa->stack[top++] = pc + 1;
+            break;
+        default:
+            list[(*count)++] = pc;
+            break;
+        }
+    }
+}
+
+internal s32 dfa_intern(Dfa *dfa, s32 *list, s32 count, u32 flags) {
+    u32 hash = 2166136261u ^ flags;
+    for (s32 i = 0; i < count; i++) {
+        hash = (hash ^ (u32)list[i]) * 16777619u;
+    }
+    s32 mask = dfa->table_size - 1;
+    s32 slot = (s32)(hash & mask);
+    for (; dfa->table[slot]; slot = (slot + 1) & mask) {
+        DfaState *state = &dfa->states.data[dfa->table[slot] - 1];
+        if (state->hash == hash && state->flags == flags && state->count == count && (count == 0 || memcmp(dfa->pcs.data + state->first, list, count * sizeof(s32)) == 0)) {
+            return dfa->table[slot] - 1;
+        }
+    }
+    if (dfa->states.count >= DFA_MAX_STATES) return -1;
+    DfaState state;
+    state.first = (s32)dfa->pcs.count;
+    state.count = count;
+    state.flags = flags;
+    state.hash = hash;
+    state.start = false;
+    for (s32 i = 0; i < count; i++) {
+        dfa->pcs.push(list[i]);
+    }
+    for (s32 i = 0; i < dfa->stride; i++) {
+        dfa->next.push(-1);
+    }
+    dfa->states.push(state);
+    dfa->table[slot] = (s32)dfa->states.count;
+    return (s32)dfa->states.count - 1;
+}
+
+internal s32 dfa_add_state(Dfa *dfa, s32 *list, s32 count, u32 flags) {
+    if (count == 0 && (dfa->anchored || (flags & DFA_SEEN))) flags |= DFA_DEAD;
+    s32 index = dfa_intern(dfa, list, count, flags);
+    if (index < 0) {
+        dfa_clear(dfa);
+        index = dfa_intern(dfa, list, count, flags);
+    }
+    return index;
+}
+
+// the transition value for a state
+internal s32 dfa_id(Dfa *dfa, s32 index) {
+    DfaState *state = &dfa->states.data[index];
+    bool tagged = (state->flags & (DFA_MATCH | DFA_DEAD)) || state->start;
+    return index * dfa->stride | (tagged ? DFA_TAG : 0);
+}
+
+internal s32 dfa_start(Dfa *dfa, bool line_start) {
+    if (dfa->start[line_start] < 0) {
+        s32 count = 0;
+        dfa_new_mark(dfa);
+        dfa_add(dfa, 0, line_start, -1, dfa->after, &count);
+        s32 index = dfa_add_state(dfa, dfa->after, count, line_start ? DFA_LINE_START : 0);
+        dfa->start[line_start] = index;
+        if (dfa->accelerate && !dfa->states.data[index].start) {
+            // transitions into it may already be there untagged
+            dfa->states.data[index].start = true;
+            s32 id = index * dfa->stride;
+            for (s64 i = 0; i < (s64)dfa->next.count; i++) {
+                if (dfa->next.data[i] == id) dfa->next.data[i] = id | DFA_TAG;
+            }
+        }
+    }
+    return dfa_id(dfa, dfa->start[line_start]);
+}
+
+// the threads of a state once line ends are settled by the next byte, or by the end of the text
+internal s32 dfa_settle(Dfa *dfa, DfaState state, bool line_end) {
+    s32 count = 0;
+    dfa_new_mark(dfa);
+    bool line_start = (state.flags & DFA_LINE_START) != 0;
+    for (s32 i = 0; i < state.count; i++) {
+        s32 pc = dfa->pcs.data[state.first + i];
+        if (dfa->insts[pc].op == OpLineEnd) {
+            if (line_end) dfa_add(dfa, pc + 1, line_start, 1, dfa->before, &count);
+        } else {
+            dfa_add(dfa, pc, line_start, line_end, dfa->before, &count);
+        }
+    }
+    return count;
+}
+
+// the transition for a byte of column cls, building the state it leads to when it is new
+internal s32 dfa_compute(Dfa *dfa, s32 index, s32 cls) {
+    DfaState state = dfa->states.data[index];
+    u8 c = dfa->class_bytes[cls];
+    bool newline = c == '\n';
+    s32 before = dfa_settle(dfa, state, newline);
+
+    u32 flags = (newline ? DFA_LINE_START : 0) | (state.flags & DFA_SEEN);
+    s32 count = 0;
+    dfa_new_mark(dfa);
+    for (s32 i = 0; i < before; i++) {
+        RegexInst inst = dfa->insts[dfa->before[i]];
+        if (inst.op == OpMatch) {
+            flags |= DFA_MATCH | DFA_SEEN;
+            // threads below the match could only end in a later, lower priority one
+            if (!dfa->longest) break;
+        } else if (byte_set_has(&dfa->sets[inst.x], c)) {
+            dfa_add(dfa, dfa->before[i] + 1, newline, -1, dfa->after, &count);
+        }
+    }
+    if (!dfa->anchored && !(flags & DFA_SEEN)) {
+        dfa_add(dfa, 0, newline, -1, dfa->after, &count);
+    }
+    s32 clears = dfa->clears;
+    s32 next = dfa_id(dfa, dfa_add_state(dfa, dfa->after, count, flags));
+    // a cleared cache no longer has the state it came from
+    if (dfa->clears == clears) dfa->next.data[index * dfa->stride + cls] = next;
+    return next;
+}
+
+internal bool dfa_matches_at_end(Dfa *dfa, s32 index, bool line_end) {
+    s32 count = dfa_settle(dfa, dfa->states.data[index], line_end);
+    for (s32 i = 0; i < count; i++) {
+        if (dfa->insts[dfa->before[i]].op == OpMatch) return true;
+    }
+    return false;
+}
+
+// Where the leftmost match in [start, end) ends, -1 when there is none. Fails when the state
+// cache fills too quickly to be worth it.
+internal s64 dfa_find_end(Regex *regex, TextSnapshot *snapshot, s64 start, s64 end, bool *failed) {
+    Dfa *dfa = &regex->forward;
+    s64 length = snapshot->length;
+    s32 current = dfa_start(dfa, start == 0 || text_snapshot_char(snapshot, start - 1) == '\n') & ~DFA_TAG;
+    s32 clears = dfa->clears;
+    s64 cleared_at = start;
+    s64 last = -1;
+    // skipping ahead stops once it keeps landing about where it started
+    bool skipping = dfa->accelerate != 0;
+    bool at_start = skipping;
+    s64 skips = 0;
+    s64 skipped = 0;
+    for (s64 pos = start; pos < end; ) {
+        if (search_cancelled(regex->cancel)) return -1;
+        s64 count;
+        u8 *span = text_snapshot_span(snapshot, pos, &count);
+        if (count > end - pos) count = end - pos;
+        if (count > SEARCH_SLICE) count = SEARCH_SLICE;
+        s64 i = 0;
+        while (i < count) {
+            if (at_start) {
+                // nothing is under way, so skip to where a match could begin
+                s64 from = i;
+                if (regex->prefix) {
+                    s64 found = text_find(snapshot, regex->prefix, pos + i, end);
+                    if (found < 0) return last;
+                    i = found - pos;
+                } else {
+                    while (i < count && !regex->first_bytes[span[i]]) i++;
+                }
+                skips++;
+                skipped += i - from;
+                if (skips >= 256 && skipped < 4 * skips) skipping = false;
+                if (i > from) {
+                    u8 before = i <= count ? span[i - 1] : text_snapshot_char(snapshot, pos + i - 1);
+                    current = dfa_start(dfa, before == '\n') & ~DFA_TAG;
+                }
+                at_start = i >= count && !regex->prefix;
+                if (i >= count) break;
+            }
+            s32 to = dfa->next.data[current + dfa->classes[span[i]]];
+            if ((u32)to >= DFA_TAG) {
+                if (to < 0) {
+                    to = dfa_compute(dfa, current / dfa->stride, dfa->classes[span[i]]);
+                    if (dfa->clears != clears) {
+                        clears = dfa->clears;
+                        if (pos + i - cleared_at < DFA_MIN_BYTES_PER_STATE * DFA_MAX_STATES) {
+                            *failed = true;
+                            return -1;
+                        }
+                        cleared_at = pos + i;
+                    }
+                }
+                DfaState *state = &dfa->states.data[(to & ~DFA_TAG) / dfa->stride];
+                if (state->flags & DFA_MATCH) last = pos + i;
+                if (state->flags & DFA_DEAD) return last;
+                at_start = skipping && state->start;
+            }
+            current = to & ~DFA_TAG;
+            i++;
+        }
+        pos += i;
+    }
+    if (dfa_matches_at_end(dfa, current / dfa->stride, end == length || text_snapshot_char(snapshot, end) == '\n')) last = end;
+    return last;
+}
+
+// where the leftmost match ending at match_end starts, found by running the reversed program
+// backwards from there
+internal s64 dfa_find_start(Regex *regex, TextSnapshot *snapshot, s64 start, s64 match_end, bool *failed) {
+    Dfa *dfa = &regex->reverse;
+    s32 current = dfa_start(dfa, match_end == snapshot->length || text_snapshot_char(snapshot, match_end) == '\n') & ~DFA_TAG;
+    if (dfa->states.data[current / dfa->stride].flags & DFA_DEAD) return -1;
+    s32 clears = dfa->clears;
+    s64 cleared_at = match_end;
+    s64 first = -1;
+    u8 chunk[4096];
+    // most matches are short, so the first reads are too
+    s64 chunk_size = 64;
+    for (s64 pos = match_end; pos > start; chunk_size = chunk_size * 2 < (s64)sizeof(chunk) ? chunk_size * 2 : (s64)sizeof(chunk)) {
+        if (search_cancelled(regex->cancel)) return -1;
+        s64 from = pos - chunk_size > start ? pos - chunk_size : start;
+        text_snapshot_read(snapshot, from, pos, chunk);
+        for (s64 i = pos - from - 1; i >= 0; i--) {
+            s32 to = dfa->next.data[current + dfa->classes[chunk[i]]];
+            if ((u32)to >= DFA_TAG) {
+                if (to < 0) {
+                    to = dfa_compute(dfa, current / dfa->stride, dfa->classes[chunk[i]]);
+                    if (dfa->clears != clears) {
+                        clears = dfa->clears;
+                        if (cleared_at - (from + i) < DFA_MIN_BYTES_PER_STATE * DFA_MAX_STATES) {
+                            *failed = true;
+                            return -1;
+                        }
+                        cleared_at = from + i;
+                    }
+                }
+                u32 flags = dfa->states.data[(to & ~DFA_TAG) / dfa->stride].flags;
+                if (flags & DFA_MATCH) first = from + i + 1;
+                if (flags & DFA_DEAD) return first;
+            }
+            current = to & ~DFA_TAG;
+        }
+        pos = from;
+    }
+    if (dfa_matches_at_end(dfa, current / dfa->stride, start == 0 || text_snapshot_char(snapshot, start - 1) == '\n')) first = start;
+    return first;
+}
+
+// @note Pike VM
+// Runs every thread in lockstep and carries the position each one started at, so it finds the
+// leftmost match in one pass however many states the pattern would take. Line ends are settled
+// the same way as in the DFA.
+
+struct PikeThread {
+    s32 pc;
+    s64 start;
+};
+
+struct PikeVM {
+    RegexInst *insts;
+    ByteSet *sets;
+    PikeThread *current;
+    PikeThread *settled;
+    PikeThread *next;
+    s32 current_count;
+    s32 inst_count;
+    s32 *stack;
+    u32 *marks;
+    u32 mark;
+    StringMatch match;
+};
+
+internal void pike_add(PikeVM *vm, s32 pc, s64 start, bool line_start, s32 line_end, PikeThread *list, s32 *count) {
+    s32 top = 0;
+    vm->stack[top++] = pc;
+    while (top > 0) {
+        pc = vm->stack[--top];
+        if (vm->marks[pc] == vm->mark) continue;
+        vm->marks[pc] = vm->mark;
+        RegexInst inst = vm->insts[pc];
+        switch (inst.op) {
+        case OpJump:
+            vm->stack[top++] = inst.x;
+            break;
+        case OpSplit:
+            vm->stack[top++] = inst.y;
+            vm->stack[top++] = inst.x;
+            break;
+        case OpLineStart:
+            if (line_start) vm->stack[top++] = pc + 1;
+            break;
+        case OpLineEnd:
+            if (line_end < 0) list[(*count)++] = { pc, start };
+            else if (line_end) vm->stack[top++] = pc + 1;
+            break;
+        default:
+            list[(*count)++] = { pc, start };
+            break;
+        }
+    }
+}
+
+inline internal void pike_new_mark(PikeVM *vm, s32 inst_count) {
+    if (++vm->mark == 0) {
+        memset(vm->marks, 0, inst_count * sizeof(u32));
+        vm->mark = 1;
+    }
+}
+
+// c is -1 at the end of the text
+internal void pike_step(PikeVM *vm, s64 pos, s32 c, bool line_start, bool line_end) {
+    s32 settled = 0;
+    pike_new_mark(vm, vm->inst_count);
+    for (s32 i = 0; i < vm->current_count; i++) {
+        PikeThread thread = vm->current[i];
+        if (vm->insts[thread.pc].op == OpLineEnd) {
+            if (line_end) pike_add(vm, thread.pc + 1, thread.start, line_start, 1, vm->settled, &settled);
+        } else {
+            pike_add(vm, thread.pc, thread.start, line_start, line_end, vm->settled, &settled);
+        }
+    }
+    if (vm->match.pos < 0) {
+        pike_add(vm, 0, pos, line_start, line_end, vm->settled, &settled);
+    }
+
+    s32 count = 0;
+    pike_new_mark(vm, vm->inst_count);
+    for (s32 i = 0; i < settled; i++) {
+        PikeThread thread = vm->settled[i];
+        RegexInst inst = vm->insts[thread.pc];
+        if (inst.op == OpMatch) {
+            vm->match.pos = thread.start;
+            vm->match.count = pos - thread.start;
+            break;
+        }
+        if (c >= 0 && byte_set_has(&vm->sets[inst.x], (u8)c)) {
+            pike_add(vm, thread.pc + 1, thread.start, c == '\n', -1, vm->next, &count);
+        }
+    }
+    PikeThread *swap = vm->current;
+    vm->current = vm->next;
+    vm->next = swap;
+    vm->current_count = count;
+}
+
+internal StringMatch pike_find(Regex *regex, TextSnapshot *snapshot, s64 start, s64 end) {
+    s32 inst_count = (s32)regex->forward_insts.count;
+    PikeVM vm = {};
+    vm.insts = regex->forward_insts.data;
+    vm.inst_count = inst_count;
+    vm.sets = regex->sets.data;
+    vm.current = (PikeThread *)malloc(inst_count * sizeof(PikeThread));
+    vm.settled = (PikeThread *)malloc(inst_count * sizeof(PikeThread));
+    vm.next = (PikeThread *)malloc(inst_count * sizeof(PikeThread));
+    vm.stack = (s32 *)malloc(2 * inst_count * sizeof(s32));
+    vm.marks = (u32 *)calloc(inst_count, sizeof(u32));
+    vm.match.pos = -1;
+
+    bool line_start = start == 0 || text_snapshot_char(snapshot, start - 1) == '\n';
+    s64 pos = start;
+    while (pos < end) {
+        if (search_cancelled(regex->cancel)) break;
+        s64 count;
+        u8 *span = text_snapshot_span(snapshot, pos, &count);
+        if (count > end - pos) count = end - pos;
+        if (count > SEARCH_SLICE) count = SEARCH_SLICE;
+        s64 i = 0;
+        for (; i < count; i++) {
+            u8 c = span[i];
+            pike_step(&vm, pos + i, c, line_start, c == '\n');
+            line_start = c == '\n';
+            if (vm.match.pos >= 0 && vm.current_count == 0) break;
+        }
+        if (i < count) break;
+        pos += count;
+    }
+    if (pos >= end) {
+        pike_step(&vm, end, -1, line_start, end == snapshot->length || text_snapshot_char(snapshot, end) == '\n');
+    } else if (search_cancelled(regex->cancel)) {
+        vm.match.pos = -1;
+    }
+
+    free(vm.current);
+    free(vm.settled);
+    free(vm.next);
+    free(vm.stack);
+    free(vm.marks);
+    return vm.match;
+}
+
+// @note Compiling and searching
+
+internal void regex_byte_classes(Regex *regex) {
+    memset(regex->classes, 0, sizeof(regex->classes));
+    s32 count = 1;
+    s32 remap[512];
+    ByteSet newline = {};
+    byte_set_add_range(&newline, '\n', '\n');
+    for (s64 i = -1; i < (s64)regex->sets.count; i++) {
+        ByteSet *set = i < 0 ? &newline : &regex->sets.data[i];
+        for (s32 k = 0; k < 2 * count; k++) {
+            remap[k] = -1;
+        }
+        s32 next_count = 0;
+        for (s32 c = 0; c < 256; c++) {
+            s32 key = regex->classes[c] * 2 + byte_set_has(set, (u8)c);
+            if (remap[key] < 0) remap[key] = next_count++;
+            regex->classes[c] = (u8)remap[key];
+        }
+        count = next_count;
+    }
+    for (s32 c = 255; c >= 0; c--) {
+        regex->class_bytes[regex->classes[c]] = (u8)c;
+    }
+    regex->class_count = count;
+}
+
+internal void regex_free(Regex *regex) {
+    if (regex->literal) searcher_free(regex->literal);
+    if (regex->prefix) searcher_free(regex->prefix);
+    if (regex->forward.table) {
+        dfa_free(&regex->forward);
+        dfa_free(&regex->reverse);
+    }
+    regex->forward_insts.clear();
+    regex->reverse_insts.clear();
+    regex->sets.clear();
+    free(regex);
+}
+
+// The bytes a match can begin with, taken from the threads the program starts with at a line
+// start and elsewhere. Not worth it when most bytes qualify, or when a match may be empty.
+internal void regex_first_bytes(Regex *regex) {
+    s32 inst_count = (s32)regex->forward_insts.count;
+    s32 *stack = (s32 *)malloc(2 * inst_count * sizeof(s32));
+    u8 *seen = (u8 *)malloc(inst_count);
+    ByteSet first = {};
+    bool empty = false;
+    for (s32 line_start = 0; line_start < 2; line_start++) {
+        memset(seen, 0, inst_count);
+        s32 top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            s32 pc = stack[--top];
+            if (seen[pc]) continue;
+            seen[pc] = 1;
+            RegexInst inst = regex->forward_insts.data[pc];
+            switch (inst.op) {
+            case OpJump:
+                stack[top++] = inst.x;
+                break;
+            case OpSplit:
+                stack[top++] = inst.y;
+                stack[top++] = inst.x;
+                break;
+            case OpLineStart:
+                if (line_start) stack[top++] = pc + 1;
+                break;
+            case OpByte:
+                for (s32 i = 0; i < 8; i++) {
+                    first.bits[i] |= regex->sets.data[inst.x].bits[i];
+                }
+                break;
+            default:
+                empty = true;
+                break;
+            }
+        }
+    }
+    free(stack);
+    free(seen);
+    s32 count = 0;
+    for (s32 c = 0; c < 256; c++) {
+        regex->first_bytes[c] = byte_set_has(&first, (u8)c);
+        count += regex->first_bytes[c];
+    }
+    regex->skip = !empty && count <= 128;
+}
+
+// What a search split into chunks needs to know to give each one enough text. Only unbounded
+// repeats jump backwards in the program, everything else leads to a later instruction.
+internal void regex_measure(Regex *regex) {
+    if (regex->literal) {
+        regex->max_length = regex->literal->count;
+        regex->multiline = memchr(regex->literal->needle, '\n', regex->literal->count) != nullptr;
+        return;
+    }
+    Array<RegexInst> *insts = &regex->forward_insts;
+    s64 *longest = (s64 *)malloc(insts->count * sizeof(s64));
+    bool bounded = true;
+    for (s64 pc = (s64)insts->count - 1; pc >= 0; pc--) {
+        RegexInst inst = insts->data[pc];
+        switch (inst.op) {
+        case OpByte:
+            if (byte_set_has(&regex->sets.data[inst.x], '\n')) regex->multiline = true;
+            longest[pc] = 1 + longest[pc + 1];
+            break;
+        case OpSplit:
+            longest[pc] = longest[inst.x] > longest[inst.y] ? longest[inst.x] : longest[inst.y];
+            break;
+        case OpJump:
+            if (inst.x <= pc) bounded = false;
+            longest[pc] = inst.x > pc ? longest[inst.x] : 0;
+            break;
+        case OpMatch:
+            longest[pc] = 0;
+            break;
+        default:
+            longest[pc] = longest[pc + 1];
+            break;
+        }
+    }
+    regex->max_length = bounded ? longest[0] : -1;
+    free(longest);
+}
+
+// returns nullptr and sets error for a pattern it cannot take
+internal Regex *regex_compile(u8 *pattern, s64 count, const char **error) {
+    RegexParser parser = {};
+    parser.at = pattern;
+    parser.end = pattern + count;
+    s32 root = regex_parse_alternate(&parser);
+    if (root >= 0 && parser.at < parser.end) root = regex_fail(&parser, "unmatched )");
+    if (root < 0) {
+        *error = parser.error;
+        parser.nodes.clear();
+        parser.sets.clear();
+        return nullptr;
+    }
+
+    Regex *regex = (Regex *)malloc(sizeof(Regex));
+    block_zero(regex, sizeof(Regex));
+    regex->sets = parser.sets;
+
+    // a leading run of single bytes is searched for as a string
+    Array<s32> parts{};
+    regex_collect_concat(&parser.nodes, root, &parts);
+    Array<u8> prefix{};
+    for (s32 part : parts) {
+        RegexNode node = parser.nodes.data[part];
+        s32 c = node.kind == RegexBytes ? byte_set_single(&regex->sets.data[node.a]) : -1;
+        if (c < 0) break;
+        prefix.push((u8)c);
+    }
+    if (prefix.count > 0 && prefix.count == parts.count) {
+        regex->literal = searcher_init(prefix.data, prefix.count);
+        regex_measure(regex);
+        prefix.clear();
+        parts.clear();
+        parser.nodes.clear();
+        return regex;
+    }
+    if (prefix.count > 0) regex->prefix = searcher_init(prefix.data, prefix.count);
+    prefix.clear();
+    parts.clear();
+
+    regex_emit(&parser.nodes, root, &regex->forward_insts, false);
+    regex_push(&regex->forward_insts, OpMatch, 0, 0);
+    regex_emit(&parser.nodes, root, &regex->reverse_insts, true);
+    regex_push(&regex->reverse_insts, OpMatch, 0, 0);
+    parser.nodes.clear();
+    if (regex->forward_insts.count > REGEX_MAX_INSTS) {
+        *error = "pattern too large";
+        regex_free(regex);
+        return nullptr;
+    }
+
+    regex_byte_classes(regex);
+    regex_first_bytes(regex);
+    regex_measure(regex);
+    dfa_init(&regex->forward, regex, &regex->forward_insts, false, false, regex->prefix || regex->skip);
+    dfa_init(&regex->reverse, regex, &regex->reverse_insts, true, true, false);
+    return regex;
+}
+
+// Lets another thread stop searches with the regex by setting flag, nullptr stops that.
+internal void regex_set_cancel(Regex *regex, volatile b32 *flag) {
+    regex->cancel = flag;
+    if (regex->literal) regex->literal->cancel = flag;
+    if (regex->prefix) regex->prefix->cancel = flag;
+}
+
+// The leftmost match lying wholly in [start, end), its pos is -1 when there is none or the search
+// was cancelled. Matches may be empty.
+internal StringMatch regex_find(Regex *regex, TextSnapshot *snapshot, s64 start, s64 end) {
+    StringMatch match{};
+    match.pos = -1;
+    if (end > snapshot->length) end = snapshot->length;
+    if (start > end) return match;
+    if (regex->literal) {
+        match.pos = text_find(snapshot, regex->literal, start, end);
+        match.count = regex->literal->count;
+        return match;
+    }
+    if (!regex->dfa_failed) {
+        bool failed = false;
+        s64 match_end = dfa_find_end(regex, snapshot, start, end, &failed);
+        if (!failed && match_end < 0) return match;
+        s64 match_start = failed ? -1 : dfa_find_start(regex, snapshot, start, match_end, &failed);
+        if (!failed) {
+            if (search_cancelled(regex->cancel)) return match;
+            assert(match_start >= 0);
+            match.pos = match_start;
+            match.count = match_end - match_start;
+            return match;
+        }
+        regex->dfa_failed = true;
+    }
+    return pike_find(regex, snapshot, start, end);
+}
@@ -0,0 +1,355 @@
+// @note Rope backend
+// Inserts that fit in their leaf are done in place along a single root-to-leaf path. Anything
+// larger rebuilds the touched leaf into fresh leaves and splices them upwards, splitting
+// internal nodes that overflow. Deletes drop covered subtrees whole and merge small siblings.
+// Edits first copy any node on their path that a snapshot still holds, subtrees off the path stay
+// shared.
+
+internal RopeNode *rope_node_new(b32 leaf) {
+    RopeNode *node = (RopeNode *)malloc(sizeof(RopeNode));
+    node->refs = 1;
+    node->bytes = 0;
+    node->newlines = 0;
+    node->leaf = leaf;
+    node->count = 0;
+    return node;
+}
+
+inline internal void rope_node_ref(RopeNode *node) {
+    os_atomic_increment(&node->refs);
+}
+
+internal void rope_node_release(RopeNode *node) {
+    if (os_atomic_decrement(&node->refs) > 0) return;
+    if (!node->leaf) {
+        for (s32 i = 0; i < node->count; i++) {
+            rope_node_release(node->children[i]);
+        }
+    }
+    free(node);
+}
+
+// a node that can be changed in place, copied when something else still holds it
+internal RopeNode *rope_node_unique(RopeNode *node) {
+    if (node->refs == 1) return node;
+    RopeNode *copy = (RopeNode *)malloc(sizeof(RopeNode));
+    if (node->leaf) {
+        memcpy(copy, node, offsetof(RopeNode, text) + node->bytes);
+    } else {
+        memcpy(copy, node, sizeof(RopeNode));
+        for (s32 i = 0; i < copy->count; i++) {
+            rope_node_ref(copy->children[i]);
+        }
+    }
+    copy->refs = 1;
+    rope_node_release(node);
+    return copy;
+}
+
+internal void rope_node_update(RopeNode *node) {
+    if (node->leaf) return;
+    node->bytes = 0;
+    node->newlines = 0;
+    for (s32 i = 0; i < node->count; i++) {
+        node->bytes += node->children[i]->bytes;
+        node->newlines += node->children[i]->newlines;
+    }
+}
+
+internal void rope_push_leaves(Array<RopeNode *> *out, u8 *text, s64 count) {
+    do {
+        s64 n = count < ROPE_LEAF_FILL ? count : ROPE_LEAF_FILL;
+        // avoid leaving a sliver for the last leaf
+        if (count > ROPE_LEAF_FILL && count - n < ROPE_LEAF_FILL / 4) n = count / 2;
+        RopeNode *leaf = rope_node_new(true);
+        memcpy(leaf->text, text, n);
+        leaf->bytes = n;
+        leaf->newlines = newline_count(text, n);
+        out->push(leaf);
+        text += n;
+        count -= n;
+    } while (count > 0);
+}
+
+// groups sibling nodes under new parents until a single root is left
+internal RopeNode *rope_build_levels(Array<RopeNode *> *nodes) {
+    while (nodes->count > 1) {
+        size_t level = 0;
+        for (size_t i = 0; i < nodes->count; ) {
+            size_t n = nodes->count - i;
+            if (n > ROPE_FANOUT) n = ROPE_FANOUT_FILL;
+            RopeNode *parent = rope_node_new(false);
+            for (size_t j = 0; j < n; j++) {
+                parent->children[parent->count++] = nodes->data[i + j];
+            }
+            rope_node_update(parent);
+            nodes->data[level++] = parent;
+            i += n;
+        }
+        nodes->count = level;
+    }
+    RopeNode *root = nodes->data[0];
+    nodes->clear();
+    return root;
+}
+
+internal void rope_init(Rope *rope, u8 *text, s64 count) {
+    block_zero(rope, sizeof(Rope));
+    Array<RopeNode *> leaves{};
+    rope_push_leaves(&leaves, text, count);
+    rope->root = rope_build_levels(&leaves);
+}
+
+internal void rope_clear(Rope *rope) {
+    rope_node_release(rope->root);
+    rope->root = rope_node_new(true);
+    rope->span = nullptr;
+}
+
+inline internal s64 rope_length(Rope *rope) {
+    return rope->root->bytes;
+}
+
+// returns the contiguous bytes from pos to the end of its leaf
+internal u8 *rope_span(Rope *rope, s64 pos, s64 *count) {
+    if (rope->span && pos >= rope->span_start && pos < rope->span_end) {
+        *count = rope->span_end - pos;
+        return rope->span + (pos - rope->span_start);
+    }
+    if (pos < 0 || pos >= rope->root->bytes) {
+        *count = 0;
+        return nullptr;
+    }
+
+    RopeNode *node = rope->root;
+    s64 base = 0;
+    while (!node->leaf) {
+        s32 i = 0;
+        while (i < node->count - 1 && pos >= base + node->children[i]->bytes) {
+            base += node->children[i]->bytes;
+            i++;
+        }
+        node = node->children[i];
+    }
+
+    rope->span = node->text;
+    rope->span_start = base;
+    rope->span_end = base + node->bytes;
+    *count = rope->span_end - pos;
+    return rope->span + (pos - base);
+}
+
+// number of newlines before pos
+internal s64 rope_line_of(Rope *rope, s64 pos) {
+    RopeNode *node = rope->root;
+    s64 lines = 0;
+    while (!node->leaf) {
+        s32 i = 0;
+        while (i < node->count - 1 && pos >= node->children[i]->bytes) {
+            pos -= node->children[i]->bytes;
+            lines += node->children[i]->newlines;
+            i++;
+        }
+        node = node->children[i];
+    }
+    if (pos > node->bytes) pos = node->bytes;
+    return lines + newline_count(node->text, pos);
+}
+
+// position just past the newline ending line - 1, or 0 for the first line
+internal s64 rope_line_start(Rope *rope, s64 line) {
+    if (line <= 0) return 0;
+    if (line > rope->root->newlines) return rope->root->bytes + 1;
+
+    s64 k = line - 1;
+    s64 base = 0;
+    RopeNode *node = rope->root;
+    while (!node->leaf) {
+        s32 i = 0;
+        while (i < node->count - 1 && k >= node->children[i]->newlines) {
+            k -= node->children[i]->newlines;
+            base += node->children[i]->bytes;
+            i++;
+        }
+        node = node->children[i];
+    }
+    for (s64 p = 0; p < node->bytes; p++) {
+        if (node->text[p] == '\n' && k-- == 0) {
+            return base + p + 1;
+        }
+    }
+    assert(0);
+    return base + node->bytes;
+}
+
+// the path to pos is made unique on the way down, which rope_insert_node relies on when the leaf
+// is too full
+internal bool rope_insert_in_place(Rope *rope, s64 pos, u8 *text, s64 count) {
+    RopeNode *path[64];
+    s32 depth = 0;
+    RopeNode **slot = &rope->root;
+    RopeNode *node = *slot = rope_node_unique(*slot);
+    while (!node->leaf) {
+        s32 i = 0;
+        while (i < node->count - 1 && pos > node->children[i]->bytes) {
+            pos -= node->children[i]->bytes;
+            i++;
+        }
+        path[depth++] = node;
+        slot = &node->children[i];
+        node = *slot = rope_node_unique(*slot);
+    }
+    if (node->bytes + count > ROPE_LEAF_SIZE) {
+        return false;
+    }
+
+    s64 newlines = newline_count(text, count);
+    memmove(node->text + pos + count, node->text + pos, node->bytes - pos);
+    memcpy(node->text + pos, text, count);
+    node->bytes += count;
+    node->newlines += newlines;
+    for (s32 d = 0; d < depth; d++) {
+        path[d]->bytes += count;
+        path[d]->newlines += newlines;
+    }
+    return true;
+}
+
+// inserts into the subtree and pushes the node(s) that replace it onto out
+internal void rope_insert_node(RopeNode *node, s64 pos, u8 *text, s64 count, Array<RopeNode *> *out) {
+    if (node->leaf) {
+        s64 total = node->bytes + count;
+        u8 *temp = (u8 *)malloc(total);
+        memcpy(temp, node->text, pos);
+        memcpy(temp + pos, text, count);
+        memcpy(temp + pos + count, node->text + pos, node->bytes - pos);
+        rope_push_leaves(out, temp, total);
+        free(temp);
+        free(node);
+        return;
+    }
+
+    s32 index = 0;
+    while (index < node->count - 1 && pos > node->children[index]->bytes) {
+        pos -= node->children[index]->bytes;
+        index++;
+    }
+
+    Array<RopeNode *> replaced{};
+    rope_insert_node(node->children[index], pos, text, count, &replaced);
+
+    if (node->count - 1 + (s32)replaced.count <= ROPE_FANOUT) {
+        s32 tail = node->count - index - 1;
+        memmove(&node->children[index + replaced.count], &node->children[index + 1], tail * sizeof(RopeNode *));
+        memcpy(&node->children[index], replaced.data, replaced.count * sizeof(RopeNode *));
+        node->count += (s32)replaced.count - 1;
+        rope_node_update(node);
+        out->push(node);
+    } else {
+        // overflow: regroup every child into as many parents as needed
+        Array<RopeNode *> children{};
+        for (s32 i = 0; i < index; i++) children.push(node->children[i]);
+        for (RopeNode *child : replaced) children.push(child);
+        for (s32 i = index + 1; i < node->count; i++) children.push(node->children[i]);
+        free(node);
+
+        for (size_t i = 0; i < children.count; ) {
+            size_t n = children.count - i;
+            if (n > ROPE_FANOUT) n = ROPE_FANOUT_FILL;
+            RopeNode *parent = rope_node_new(false);
+            for (size_t j = 0; j < n; j++) {
+                parent->children[parent->count++] = children.data[i + j];
+            }
+            rope_node_update(parent);
+            out->push(parent);
+            i += n;
+        }
+        children.clear();
+    }
+    replaced.clear();
+}
+
+internal void rope_insert(Rope *rope, s64 pos, u8 *text, s64 count) {
+    rope->span = nullptr;
+    if (rope_insert_in_place(rope, pos, text, count)) {
+        return;
+    }
+    Array<RopeNode *> out{};
+    rope_insert_node(rope->root, pos, text, count, &out);
+    rope->root = rope_build_levels(&out);
+}
+
+internal void rope_delete_node(RopeNode *node, s64 start, s64 end) {
+    if (node->leaf) {
+        node->newlines -= newline_count(node->text + start, end - start);
+        memmove(node->text + start, node->text + end, node->bytes - end);
+        node->bytes -= end - start;
+        return;
+    }
+
+    s64 base = 0;
+    for (s32 i = 0; i < node->count; i++) {
+        RopeNode *child = node->children[i];
+        s64 child_start = base;
+        s64 child_end = base + child->bytes;
+        base = child_end;
+        if (child_end <= start || child_start >= end) continue;
+
+        s64 from = start > child_start ? start - child_start : 0;
+        s64 to = end < child_end ? end - child_start : child->bytes;
+        if (from == 0 && to == child->bytes) {
+            rope_node_release(child);
+            node->children[i] = nullptr;
+        } else {
+            child = node->children[i] = rope_node_unique(child);
+            rope_delete_node(child, from, to);
+        }
+    }
+
+    // drop emptied children and merge neighbours that fit into one node
+    s32 live = 0;
+    for (s32 i = 0; i < node->count; i++) {
+        RopeNode *child = node->children[i];
+        if (child == nullptr) continue;
+        if (child->bytes == 0) {
+            rope_node_release(child);
+            continue;
+        }
+        RopeNode *prev = live > 0 ? node->children[live - 1] : nullptr;
+        if (prev && prev->leaf && child->leaf && prev->bytes + child->bytes <= ROPE_LEAF_SIZE) {
+            prev = node->children[live - 1] = rope_node_unique(prev);
+            memcpy(prev->text + prev->bytes, child->text, child->bytes);
+            prev->bytes += child->bytes;
+            prev->newlines += child->newlines;
+            rope_node_release(child);
+        } else if (prev && !prev->leaf && !child->leaf && prev->count + child->count <= ROPE_FANOUT) {
+            prev = node->children[live - 1] = rope_node_unique(prev);
+            for (s32 j = 0; j < child->count; j++) {
+                rope_node_ref(child->children[j]);
+                prev->children[prev->count++] = child->children[j];
+            }
+            rope_node_update(prev);
+            rope_node_release(child);
+        } else {
+            node->children[live++] = child;
+        }
+    }
+    node->count = live;
+    rope_node_update(node);
+}
+
+internal void rope_delete(Rope *rope, s64 start, s64 end) {
+    rope->span = nullptr;
+    rope->root = rope_node_unique(rope->root);
+    rope_delete_node(rope->root, start, end);
+    while (!rope->root->leaf && rope->root->count == 1) {
+        RopeNode *child = rope->root->children[0];
+        rope_node_ref(child);
+        rope_node_release(rope->root);
+        rope->root = child;
+    }
+    if (!rope->root->leaf && rope->root->count == 0) {
+        rope_node_release(rope->root);
+        rope->root = rope_node_new(true);
+    }
+}
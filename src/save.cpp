@@ -0,0 +1,163 @@
+// @note Background save
+// Saves never touch the live text. The worker streams a snapshot into "<name>.save" while the
+// editor keeps running and renames it over the target. A target the buffer has mapped is swapped
+// by the main thread instead, which has to drop the mapping first.
+
+#define WRITE_STAGING_SIZE (256 * 1024)
+
+// WriteFile takes a 32-bit count
+internal bool write_file_data(HANDLE file_handle, u8 *data, s64 count) {
+    s64 written = 0;
+    while (written < count) {
+        s64 chunk = count - written;
+        if (chunk > (1 << 30)) chunk = 1 << 30;
+        DWORD bytes_written = 0;
+        if (!WriteFile(file_handle, data + written, (DWORD)chunk, &bytes_written, NULL) || bytes_written == 0) {
+            return false;
+        }
+        written += bytes_written;
+    }
+    return true;
+}
+
+inline internal void save_progress(SaveJob *job, s64 read, s64 written) {
+    os_mutex_lock(&job->mutex);
+    job->read = read;
+    job->written = written;
+    os_mutex_unlock(&job->mutex);
+}
+
+// Spans at least the size of the staging buffer are written straight from the snapshot, smaller
+// ones are gathered so a fragmented piece table still goes out in large writes. CRLF output is
+// expanded through the staging buffer instead.
+internal bool save_write_spans(SaveJob *job, HANDLE file_handle) {
+    u8 *staging = (u8 *)malloc(WRITE_STAGING_SIZE);
+    s64 staged = 0;
+    s64 read = 0;
+    s64 written = 0;
+    bool ok = true;
+    TextSnapshot *snapshot = job->snapshot;
+    for (s64 pos = 0; pos < snapshot->length && ok; ) {
+        s64 count;
+        u8 *data = text_snapshot_span(snapshot, pos, &count);
+        pos += count;
+        if (!job->convert && count >= WRITE_STAGING_SIZE) {
+            if (staged > 0) {
+                ok = write_file_data(file_handle, staging, staged);
+                written += staged;
+                staged = 0;
+            }
+            ok = ok && write_file_data(file_handle, data, count);
+            written += count;
+            read += count;
+        } else {
+            for (s64 done = 0; done < count && ok; ) {
+                s64 consumed;
+                if (job->convert) {
+                    staged += lf_to_crlf(staging + staged, WRITE_STAGING_SIZE - staged, data + done, count - done, &consumed);
+                } else {
+                    consumed = count - done < WRITE_STAGING_SIZE - staged ? count - done : WRITE_STAGING_SIZE - staged;
+                    memcpy(staging + staged, data + done, consumed);
+                    staged += consumed;
+                }
+                done += consumed;
+                read += consumed;
+                // the staging buffer is full
+                if (done < count) {
+                    ok = write_file_data(file_handle, staging, staged);
+                    written += staged;
+                    staged = 0;
+                    save_progress(job, read, written);
+                }
+            }
+        }
+        save_progress(job, read, written);
+    }
+    if (ok && staged > 0) {
+        ok = write_file_data(file_handle, staging, staged);
+        written += staged;
+    }
+    free(staging);
+    save_progress(job, read, written);
+    return ok;
+}
+
+internal void save_run(void *data) {
+    SaveJob *job = (SaveJob *)data;
+    bool ok = false;
+    bool replaced = false;
+    HANDLE file_handle = CreateFileA((char *)job->temp_name.data, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle != INVALID_HANDLE_VALUE) {
+        ok = save_write_spans(job, file_handle);
+        CloseHandle(file_handle);
+        // replacing a file frees the old one, which takes a while when it is large
+        if (ok && !job->replaces_map) {
+            replaced = MoveFileExA(job->temp_name.data, job->file_name.data, MOVEFILE_REPLACE_EXISTING) != 0;
+        }
+        if (!ok || (!job->replaces_map && !replaced)) {
+            DeleteFileA(job->temp_name.data);
+        }
+    }
+
+    os_mutex_lock(&job->mutex);
+    job->ok = ok;
+    job->replaced = replaced;
+    job->done = true;
+    os_mutex_unlock(&job->mutex);
+}
+
+internal void save_remove_old_run(void *data) {
+    SaveJob *job = (SaveJob *)data;
+    DeleteFileA(job->old_name.data);
+    os_mutex_lock(&job->mutex);
+    job->done = true;
+    os_mutex_unlock(&job->mutex);
+}
+
+// takes ownership of the snapshot and both names
+internal SaveJob *save_start(TextSnapshot *snapshot, string file_name, string temp_name, bool convert, bool replaces_map) {
+    SaveJob *job = (SaveJob *)malloc(sizeof(SaveJob));
+    block_zero(job, sizeof(SaveJob));
+    job->snapshot = snapshot;
+    job->file_name = file_name;
+    job->temp_name = temp_name;
+    job->convert = convert;
+    job->replaces_map = replaces_map;
+    job->start = os_seconds();
+    os_mutex_init(&job->mutex);
+    job->thread = os_thread_start(save_run, job);
+    return job;
+}
+
+// the job comes back done once the file moved aside by the main thread is gone
+internal void save_remove_old(SaveJob *job) {
+    job->removing_old = true;
+    job->done = false;
+    job->thread = os_thread_start(save_remove_old_run, job);
+}
+
+internal bool save_done(SaveJob *job) {
+    os_mutex_lock(&job->mutex);
+    bool done = job->done;
+    os_mutex_unlock(&job->mutex);
+    return done;
+}
+
+internal s64 save_percent(SaveJob *job) {
+    os_mutex_lock(&job->mutex);
+    s64 read = job->read;
+    os_mutex_unlock(&job->mutex);
+    s64 length = job->snapshot->length;
+    return length > 0 ? 100 * read / length : 100;
+}
+
+// the worker must have been joined
+internal void save_free(SaveJob *job) {
+    os_mutex_free(&job->mutex);
+    text_snapshot_free(job->snapshot);
+    free(job->file_name.data);
+    free(job->temp_name.data);
+    free(job->next_file_name.data);
+    free(job->old_name.data);
+    free(job);
+}
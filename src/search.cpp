@@ -0,0 +1,221 @@
+// @note Literal search
+// Runs straight over the text's spans, never over a copy of the text. Candidates come from a
+// filter on the needle's two rarest bytes: a register of start positions is checked by comparing
+// the bytes at both offsets at once, and only starts that pass are compared in full. A needle
+// whose rare bytes turn out to be common in the text falls back to Horspool for the rest of the
+// span, so a bad pick costs no more than a plain skip search. Matches that cross from one span
+// into the next are looked for in a small window read across the boundary. Searches read a
+// snapshot, so they can run on any thread, and look at their cancel flag between slices.
+
+// bytes searched between looks at the cancel flag
+#define SEARCH_SLICE (256 * 1024)
+
+struct Searcher {
+    u8 *needle;
+    s64 count;
+    // offsets of the two bytes filtered on, rare1 < rare2 unless the needle is one byte
+    s64 rare1;
+    s64 rare2;
+    s64 shift[256]; // Horspool skip by the byte under the last needle position
+    u8 *window;     // 2 * (count - 1) bytes for matches across a span boundary
+    volatile b32 *cancel; // the search gives up once this is set, from any thread
+};
+
+// rough commonness of each byte in source code and prose, higher is more common
+internal s32 byte_rank(u8 c) {
+    if (c == ' ' || c == 'e') return 255;
+    if (c == '\n' || c == 't' || c == 'a' || c == 'o' || c == 'i' || c == 'n' || c == 's' || c == 'r') return 240;
+    if (c >= 'a' && c <= 'z') return 200;
+    if (c == '\t' || c == '(' || c == ')' || c == ';' || c == ',' || c == '.' || c == '_' || c == '=') return 180;
+    if (c >= 'A' && c <= 'Z') return 150;
+    if (c >= '0' && c <= '9') return 140;
+    if (c > ' ' && c < 127) return 100;
+    return 20;
+}
+
+// copies the needle, which must not be empty
+internal Searcher *searcher_init(u8 *needle, s64 count) {
+    assert(count > 0);
+    Searcher *searcher = (Searcher *)malloc(sizeof(Searcher));
+    block_zero(searcher, sizeof(Searcher));
+    searcher->needle = (u8 *)malloc(count);
+    memcpy(searcher->needle, needle, count);
+    searcher->count = count;
+    searcher->window = count > 1 ? (u8 *)malloc(2 * (count - 1)) : nullptr;
+
+    s64 rare1 = 0;
+    for (s64 i = 1; i < count; i++) {
+        if (byte_rank(needle[i]) < byte_rank(needle[rare1])) rare1 = i;
+    }
+    s64 rare2 = rare1;
+    for (s64 i = 0; i < count; i++) {
+        if (i == rare1) continue;
+        if (rare2 == rare1 || byte_rank(needle[i]) < byte_rank(needle[rare2])) rare2 = i;
+    }
+    searcher->rare1 = rare1 < rare2 ? rare1 : rare2;
+    searcher->rare2 = rare1 < rare2 ? rare2 : rare1;
+
+    for (s32 c = 0; c < 256; c++) {
+        searcher->shift[c] = count;
+    }
+    for (s64 i = 0; i < count - 1; i++) {
+        searcher->shift[needle[i]] = count - 1 - i;
+    }
+    return searcher;
+}
+
+internal void searcher_free(Searcher *searcher) {
+    free(searcher->needle);
+    free(searcher->window);
+    free(searcher);
+}
+
+// start of the first match in text that lies wholly inside it, starting at or after from
+internal s64 search_horspool(Searcher *searcher, u8 *text, s64 count, s64 from) {
+    s64 m = searcher->count;
+    u8 *needle = searcher->needle;
+    u8 last = needle[m - 1];
+    for (s64 i = from; i + m <= count; ) {
+        u8 c = text[i + m - 1];
+        if (c == last && memcmp(text + i, needle, m - 1) == 0) return i;
+        i += searcher->shift[c];
+    }
+    return -1;
+}
+
+// Candidates checked in full beyond this share of the positions scanned mean the filter is not
+// paying for itself.
+#define SEARCH_VERIFY_LIMIT(scanned) (64 + (scanned) / 8)
+
+internal s64 search_span_scalar(Searcher *searcher, u8 *text, s64 count) {
+    s64 m = searcher->count;
+    u8 *needle = searcher->needle;
+    u8 c1 = needle[searcher->rare1];
+    u8 c2 = needle[searcher->rare2];
+    s64 verified = 0;
+    for (s64 i = 0; i + m <= count; i++) {
+        if (text[i + searcher->rare1] == c1 && text[i + searcher->rare2] == c2) {
+            if (memcmp(text + i, needle, m) == 0) return i;
+            if (++verified > SEARCH_VERIFY_LIMIT(i)) return search_horspool(searcher, text, count, i + 1);
+        }
+    }
+    return -1;
+}
+
+#if NEWLINE_SIMD
+internal s64 search_span_sse2(Searcher *searcher, u8 *text, s64 count) {
+    s64 m = searcher->count;
+    u8 *needle = searcher->needle;
+    u8 *first = text + searcher->rare1;
+    u8 *second = text + searcher->rare2;
+    __m128i c1 = _mm_set1_epi8((char)needle[searcher->rare1]);
+    __m128i c2 = _mm_set1_epi8((char)needle[searcher->rare2]);
+    s64 starts = count - m + 1;
+    s64 verified = 0;
+    s64 i = 0;
+    for (; i + 16 <= starts; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(first + i)), c1);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(second + i)), c2);
+        u32 mask = (u32)_mm_movemask_epi8(_mm_and_si128(a, b));
+        while (mask) {
+            s64 start = i + bit_scan_forward(mask);
+            if (memcmp(text + start, needle, m) == 0) return start;
+            if (++verified > SEARCH_VERIFY_LIMIT(i)) return search_horspool(searcher, text, count, start + 1);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < starts; i++) {
+        if (first[i] == needle[searcher->rare1] && second[i] == needle[searcher->rare2] && memcmp(text + i, needle, m) == 0) return i;
+    }
+    return -1;
+}
+
+TARGET_AVX2 internal s64 search_span_avx2(Searcher *searcher, u8 *text, s64 count) {
+    s64 m = searcher->count;
+    u8 *needle = searcher->needle;
+    u8 *first = text + searcher->rare1;
+    u8 *second = text + searcher->rare2;
+    __m256i c1 = _mm256_set1_epi8((char)needle[searcher->rare1]);
+    __m256i c2 = _mm256_set1_epi8((char)needle[searcher->rare2]);
+    s64 starts = count - m + 1;
+    s64 verified = 0;
+    s64 i = 0;
+    for (; i + 32 <= starts; i += 32) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(first + i)), c1);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(second + i)), c2);
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+        while (mask) {
+            s64 start = i + bit_scan_forward(mask);
+            if (memcmp(text + start, needle, m) == 0) return start;
+            if (++verified > SEARCH_VERIFY_LIMIT(i)) return search_horspool(searcher, text, count, start + 1);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < starts; i++) {
+        if (first[i] == needle[searcher->rare1] && second[i] == needle[searcher->rare2] && memcmp(text + i, needle, m) == 0) return i;
+    }
+    return -1;
+}
+#endif // NEWLINE_SIMD
+
+typedef s64 (*SearchSpanProc)(Searcher *searcher, u8 *text, s64 count);
+
+global SearchSpanProc search_span_kernels[] = {
+    search_span_scalar,
+#if NEWLINE_SIMD
+    search_span_sse2,
+    search_span_avx2,
+#endif
+};
+
+// same cpu check as the newline kernels
+global SearchSpanProc search_span_kernel = search_span_kernels[newline_kernels_supported() - 1];
+
+// start of the first match in text, which has to hold it whole
+inline internal s64 search_span(Searcher *searcher, u8 *text, s64 count) {
+    if (count < searcher->count) return -1;
+    return search_span_kernel(searcher, text, count);
+}
+
+inline internal bool search_cancelled(volatile b32 *cancel) {
+    return cancel && os_atomic_load(cancel);
+}
+
+// Start of the first match lying wholly in [start, end), or -1, which is also what a cancelled
+// search returns. Finding every match is a loop over this that restarts past the last one, so a
+// caller can stop whenever it likes.
+internal s64 text_find(TextSnapshot *snapshot, Searcher *searcher, s64 start, s64 end) {
+    s64 m = searcher->count;
+    if (end > snapshot->length) end = snapshot->length;
+    for (s64 pos = start; pos + m <= end; ) {
+        if (search_cancelled(searcher->cancel)) return -1;
+        s64 count;
+        u8 *span = text_snapshot_span(snapshot, pos, &count);
+        if (count > end - pos) count = end - pos;
+        if (count > SEARCH_SLICE) count = SEARCH_SLICE;
+        s64 found = search_span(searcher, span, count);
+        if (found >= 0) return pos + found;
+        s64 span_end = pos + count;
+        if (span_end >= end) break;
+        if (m > 1) {
+            // matches starting in the last m - 1 bytes of the span end in a later one
+            s64 from = span_end - (m - 1) > pos ? span_end - (m - 1) : pos;
+            s64 to = span_end + (m - 1) < end ? span_end + (m - 1) : end;
+            text_snapshot_read(snapshot, from, to, searcher->window);
+            found = search_span(searcher, searcher->window, to - from);
+            if (found >= 0) return from + found;
+        }
+        pos = span_end;
+    }
+    return -1;
+}
+
+typedef bool (*MatchProc)(void *data, s64 pos);
+
+// Hands proc each match in [start, end) that does not overlap the one before, in order, until it
+// returns false
+internal void text_find_all(TextSnapshot *snapshot, Searcher *searcher, s64 start, s64 end, MatchProc proc, void *data) {
+    for (s64 pos = start; (pos = text_find(snapshot, searcher, pos, end)) >= 0; pos += searcher->count) {
+        if (!proc(data, pos)) return;
+    }
+}
@@ -0,0 +1,62 @@
+// @note Background search
+// Hits are looked for from a position to the end of the text and then from the start, so the
+// first one found is the nearest after it. The worker lets go of the snapshot as soon as it is
+// through, so edits made while the main thread has not collected the job yet copy nothing.
+
+internal void search_job_run(void *data) {
+    SearchJob *job = (SearchJob *)data;
+    TextSnapshot *snapshot = job->snapshot;
+    bool wraps = job->from >= job->origin;
+    StringMatch match = regex_find(job->regex, snapshot, job->from, wraps ? snapshot->length : job->origin);
+    if (match.pos < 0 && wraps) {
+        match = regex_find(job->regex, snapshot, 0, job->origin);
+    }
+    text_snapshot_release(snapshot);
+
+    os_mutex_lock(&job->mutex);
+    job->match = match;
+    job->done = true;
+    os_mutex_unlock(&job->mutex);
+}
+
+// takes ownership of the snapshot and the regex
+internal SearchJob *search_job_start(TextSnapshot *snapshot, Regex *regex, s64 from, s64 origin) {
+    SearchJob *job = (SearchJob *)malloc(sizeof(SearchJob));
+    block_zero(job, sizeof(SearchJob));
+    job->snapshot = snapshot;
+    job->regex = regex;
+    job->from = from;
+    job->origin = origin;
+    regex_set_cancel(regex, &job->cancel);
+    os_mutex_init(&job->mutex);
+    job->thread = os_thread_start(search_job_run, job);
+    return job;
+}
+
+inline internal void search_job_cancel(SearchJob *job) {
+    os_atomic_store(&job->cancel, true);
+}
+
+internal bool search_job_done(SearchJob *job) {
+    os_mutex_lock(&job->mutex);
+    bool done = job->done;
+    os_mutex_unlock(&job->mutex);
+    return done;
+}
+
+// a cancelled job's match is not worth anything
+internal StringMatch search_job_match(SearchJob *job) {
+    os_mutex_lock(&job->mutex);
+    StringMatch match = job->match;
+    os_mutex_unlock(&job->mutex);
+    return match;
+}
+
+// waits for the worker if it is still running
+internal void search_job_free(SearchJob *job) {
+    os_thread_join(job->thread);
+    os_mutex_free(&job->mutex);
+    text_snapshot_free(job->snapshot);
+    regex_free(job->regex);
+    free(job);
+}
@@ -0,0 +1,51 @@
+// @note Shared bytes
+// Only the main thread adds holders, so a count of one seen there means nothing else can be
+// reading and the bytes may be written in place. Holders let go from any thread.
+
+internal SharedBytes *shared_bytes_new(u8 *data) {
+    SharedBytes *shared = (SharedBytes *)malloc(sizeof(SharedBytes));
+    block_zero(shared, sizeof(SharedBytes));
+    shared->refs = 1;
+    shared->data = data;
+    return shared;
+}
+
+internal SharedBytes *shared_bytes_map(FileMap map) {
+    SharedBytes *shared = shared_bytes_new(map.data);
+    shared->map = map;
+    return shared;
+}
+
+inline internal void shared_bytes_ref(SharedBytes *shared) {
+    os_atomic_increment(&shared->refs);
+}
+
+internal void shared_bytes_release(SharedBytes *shared) {
+    if (shared == nullptr) return;
+    if (os_atomic_decrement(&shared->refs) == 0) {
+        if (shared->map.data) {
+            os_unmap_file(&shared->map);
+        } else {
+            free(shared->data);
+        }
+        if (shared->remove_name) {
+            DeleteFileA(shared->remove_name);
+            free(shared->remove_name);
+        }
+        free(shared);
+    }
+}
+
+// Gives the caller heap bytes of its own again: the same block when no one else holds it, a copy
+// of its first size bytes otherwise.
+internal u8 *shared_bytes_take(SharedBytes *shared, s64 size) {
+    if (shared->refs == 1) {
+        u8 *data = shared->data;
+        free(shared);
+        return data;
+    }
+    u8 *copy = (u8 *)malloc(size);
+    if (size) memcpy(copy, shared->data, size);
+    shared_bytes_release(shared);
+    return copy;
+}
@@ -0,0 +1,744 @@
+// @note Text storage
+// Every backend sits behind the same narrow API: text_span/text_read for reading, text_insert/
+// text_delete for edits and text_locate_line/text_locate_pos for line lookup. Editor code never
+// touches a backend's layout. Backends that do not count newlines themselves get the shared
+// line index maintained here. Adding a backend means adding a case to each function below.
+
+#define GAP_SIZE 1024
+// files at least this large skip the gap buffer so the original is never copied
+#define LARGE_FILE_SIZE (16 * 1024 * 1024)
+
+global TextBackend large_file_backend = PieceBackend;
+
+internal void match_index_insert(MatchIndex *index, s64 pos, s64 count);
+internal void match_index_delete(MatchIndex *index, s64 start, s64 end);
+internal void match_index_clear(MatchIndex *index);
+internal void match_index_reset(MatchIndex *index, u64 pattern, s64 reach, s64 length);
+internal void match_count_insert(MatchCount *counts, u64 version, s64 pos, s64 count);
+internal void match_count_delete(MatchCount *counts, u64 version, s64 start, s64 end);
+internal void match_count_reset(MatchCount *counts, u64 pattern, s64 reach, s64 length);
+
+// @note Gap buffer
+// Gap growth is proportional to the text so a long run of inserts reallocates O(log n)
+// times, and the gap is handed back once deletions leave it larger than the text itself.
+inline internal s64 gap_delta(TextBuffer *text) {
+    return text->gap_end - text->gap_start;
+}
+
+inline internal s64 gap_length(TextBuffer *text) {
+    return text->end - gap_delta(text);
+}
+
+internal void gap_resize(TextBuffer *text, s64 gap) {
+    s64 tail = text->end - text->gap_end;
+    s64 new_end = text->gap_start + gap + tail;
+    if (new_end > text->end) {
+        text->contents = (u8 *)realloc(text->contents, new_end + 1);
+        memmove(text->contents + new_end - tail, text->contents + text->gap_end, tail);
+    } else {
+        memmove(text->contents + new_end - tail, text->contents + text->gap_end, tail);
+        text->contents = (u8 *)realloc(text->contents, new_end + 1);
+    }
+    text->contents[new_end] = '\0';
+    text->gap_end = text->gap_start + gap;
+    text->end = new_end;
+}
+
+internal void gap_grow(TextBuffer *text, s64 count) {
+    s64 gap = gap_length(text) / 2;
+    if (gap < GAP_SIZE) gap = GAP_SIZE;
+    if (gap < count) gap = count + GAP_SIZE;
+    gap_resize(text, gap);
+}
+
+internal void gap_shrink(TextBuffer *text) {
+    s64 length = gap_length(text);
+    if (gap_delta(text) > 4 * GAP_SIZE && gap_delta(text) > length) {
+        s64 gap = length / 2;
+        if (gap < GAP_SIZE) gap = GAP_SIZE;
+        gap_resize(text, gap);
+    }
+}
+
+// moves only the bytes between the old and the new gap position
+internal void gap_shift(TextBuffer *text, s64 new_gap) {
+    s64 delta = gap_delta(text);
+    if (new_gap < text->gap_start) {
+        s64 n = text->gap_start - new_gap;
+        memmove(text->contents + text->gap_end - n, text->contents + new_gap, n);
+    } else if (new_gap > text->gap_start) {
+        s64 n = new_gap - text->gap_start;
+        memmove(text->contents + text->gap_start, text->contents + text->gap_end, n);
+    }
+    text->gap_start = new_gap;
+    text->gap_end = new_gap + delta;
+}
+
+internal u8 *gap_span(TextBuffer *text, s64 pos, s64 *count) {
+    if (pos < text->gap_start) {
+        *count = text->gap_start - pos;
+        return text->contents + pos;
+    }
+    s64 raw = pos + gap_delta(text);
+    *count = text->end - raw;
+    return text->contents + raw;
+}
+
+// edits move text around inside the block, so one a snapshot holds is swapped for a copy first
+inline internal void gap_unshare(TextBuffer *text) {
+    if (text->contents_shared) {
+        text->contents = shared_bytes_take(text->contents_shared, text->end + 1);
+        text->contents_shared = nullptr;
+    }
+}
+
+internal void gap_insert(TextBuffer *text, s64 pos, u8 *data, s64 count) {
+    gap_unshare(text);
+    if (gap_delta(text) < count) {
+        gap_grow(text, count);
+    }
+    if (pos != text->gap_start) {
+        gap_shift(text, pos);
+    }
+    memcpy(text->contents + pos, data, count);
+    text->gap_start += count;
+}
+
+internal void gap_delete(TextBuffer *text, s64 start, s64 end) {
+    gap_unshare(text);
+    if (text->gap_start != end) {
+        gap_shift(text, end);
+    }
+    text->gap_start = start;
+    gap_shrink(text);
+}
+
+// @note Storage API
+inline internal s64 text_length(TextBuffer *text) {
+    switch (text->backend) {
+    case PieceBackend: return piece_table_length(&text->pieces);
+    case RopeBackend:  return rope_length(&text->rope);
+    default:           return gap_length(text);
+    }
+}
+
+// contiguous bytes from pos up to the end of the backend's chunk holding it
+inline internal u8 *text_span(TextBuffer *text, s64 pos, s64 *count) {
+    if (pos < 0 || pos >= text_length(text)) {
+        *count = 0;
+        return nullptr;
+    }
+    switch (text->backend) {
+    case PieceBackend: return piece_table_span(&text->pieces, pos, count);
+    case RopeBackend:  return rope_span(&text->rope, pos, count);
+    default:           return gap_span(text, pos, count);
+    }
+}
+
+internal void text_read(TextBuffer *text, s64 start, s64 end, u8 *dest) {
+    for (s64 pos = start; pos < end; ) {
+        s64 count;
+        u8 *span = text_span(text, pos, &count);
+        if (count > end - pos) count = end - pos;
+        memcpy(dest, span, count);
+        dest += count;
+        pos += count;
+    }
+}
+
+inline internal u8 text_char(TextBuffer *text, s64 pos) {
+    s64 count;
+    u8 *span = text_span(text, pos, &count);
+    return span ? *span : 0;
+}
+
+// @note Background indexing
+// Returns true if lines were merged, so cursors past the old frontier have to be recomputed.
+internal bool text_poll_indexing(TextBuffer *text) {
+    if (text->indexer == nullptr) return false;
+    bool done;
+    bool merged = line_indexer_merge(text->indexer, &text->lines, text, &done);
+    if (done) {
+        os_thread_join(text->indexer->thread);
+        line_indexer_free(text->indexer);
+        text->indexer = nullptr;
+    }
+    return merged;
+}
+
+// waits for the worker and merges everything it found
+internal void text_finish_indexing(TextBuffer *text) {
+    if (text->indexer == nullptr) return;
+    os_thread_join(text->indexer->thread);
+    bool done;
+    line_indexer_merge(text->indexer, &text->lines, text, &done);
+    line_indexer_free(text->indexer);
+    text->indexer = nullptr;
+}
+
+// drops the partial index, the caller rebuilds it
+internal void text_stop_indexing(TextBuffer *text) {
+    if (text->indexer == nullptr) return;
+    os_mutex_lock(&text->indexer->mutex);
+    text->indexer->cancel = true;
+    os_mutex_unlock(&text->indexer->mutex);
+    os_thread_join(text->indexer->thread);
+    line_indexer_free(text->indexer);
+    text->indexer = nullptr;
+}
+
+internal void text_rebuild_lines(TextBuffer *text) {
+    text_stop_indexing(text);
+    LineIndex *index = &text->lines;
+    line_index_clear(index);
+    if (text->backend == RopeBackend) {
+        return;
+    }
+
+    s64 length = text_length(text);
+    s64 line_start = 0;
+    for (s64 pos = 0; pos < length; ) {
+        s64 count;
+        u8 *span = text_span(text, pos, &count);
+        line_block_push_text(&index->blocks, span, count, pos, &line_start);
+        pos += count;
+    }
+    line_block_push(&index->blocks, length + 1 - line_start);
+    line_index_rebuild_tree(index);
+}
+
+// Text between windows is untouched apart from shifting, so replacing [a, b) with count bytes
+// widens the window it falls in. Edits made in ascending or in descending order each get a window
+// of their own, an edit out of that order folds all of them into one. In a descending run only the
+// last window's start and end are current, the ones before it are off by the shift of those after.
+inline internal bool text_batch_descending(TextBuffer *text) {
+    Array<BatchWindow> *windows = &text->batch_windows;
+    return windows->count > 1 && windows->data[1].old_start < windows->data[0].old_start;
+}
+
+internal void text_batch_touch(TextBuffer *text, s64 a, s64 b, s64 count) {
+    Array<BatchWindow> *windows = &text->batch_windows;
+    BatchWindow *last = windows->count > 0 ? &windows->data[windows->count - 1] : nullptr;
+    if (windows->count > 1) {
+        bool descending = text_batch_descending(text);
+        bool out_of_order = a < last->start;
+        if (descending) {
+            BatchWindow *next = last - 1;
+            s64 next_start = next->start + (last->end - last->start) - (last->old_end - last->old_start);
+            out_of_order = a > last->end || b >= next_start;
+        }
+        if (out_of_order) {
+            BatchWindow first = windows->data[0];
+            BatchWindow merged;
+            if (descending) {
+                merged = *last;
+                merged.old_end = first.old_end;
+                merged.end = first.old_end + text->batch_shift;
+            } else {
+                merged = first;
+                merged.old_end = last->old_end;
+                merged.end = last->end;
+            }
+            windows->count = 1;
+            windows->data[0] = merged;
+            last = &windows->data[0];
+        }
+    }
+    if (last == nullptr || a > last->end) {
+        BatchWindow window;
+        window.start = window.end = a;
+        window.old_start = window.old_end = a - text->batch_shift;
+        windows->push(window);
+        last = &windows->data[windows->count - 1];
+    } else if (b < last->start && (windows->count == 1 || text_batch_descending(text))) {
+        // nothing before a has changed yet
+        BatchWindow window;
+        window.start = window.end = a;
+        window.old_start = window.old_end = a;
+        windows->push(window);
+        last = &windows->data[windows->count - 1];
+    }
+    if (a < last->start) {
+        last->old_start -= last->start - a;
+        last->start = a;
+    }
+    if (b > last->end) {
+        last->old_end += b - last->end;
+        last->end = b;
+    }
+    last->end += count - (b - a);
+    text->batch_shift += count - (b - a);
+}
+
+// Batches defer the line index, so lines must not be looked up until the batch ends. Edits still
+// update the index right away while a background indexer runs, as those check its frontier.
+internal void text_begin_batch(TextBuffer *text) {
+    text->batch_depth++;
+}
+
+// Past this many windows one splice over the index beats a lookup per window
+#define BATCH_SPLICE_WINDOWS 16
+
+// the last window first, so the old positions of the ones before it stay valid
+internal void text_end_batch(TextBuffer *text) {
+    if (--text->batch_depth > 0 || text->batch_windows.empty()) return;
+    // put a descending run in order and bring its positions up to date
+    if (text_batch_descending(text)) {
+        std::reverse(text->batch_windows.begin(), text->batch_windows.end());
+        s64 shift = 0;
+        for (BatchWindow &w : text->batch_windows) {
+            s64 count = w.end - w.start;
+            w.start = w.old_start + shift;
+            w.end = w.start + count;
+            shift += count - (w.old_end - w.old_start);
+        }
+    }
+    if (text->batch_windows.count >= BATCH_SPLICE_WINDOWS) {
+        s64 total = 0;
+        for (BatchWindow w : text->batch_windows) {
+            total += w.end - w.start;
+        }
+        u8 *window_text = (u8 *)malloc(total + 1);
+        s64 at = 0;
+        for (BatchWindow w : text->batch_windows) {
+            text_read(text, w.start, w.end, window_text + at);
+            at += w.end - w.start;
+        }
+        line_index_splice(&text->lines, text->batch_windows.data, (s64)text->batch_windows.count, window_text);
+        free(window_text);
+        text->batch_windows.count = 0;
+        text->batch_shift = 0;
+        return;
+    }
+    Array<u8> window{};
+    for (s64 i = (s64)text->batch_windows.count - 1; i >= 0; i--) {
+        BatchWindow w = text->batch_windows.data[i];
+        if (w.old_end > w.old_start) {
+            line_index_delete(&text->lines, w.old_start, w.old_end);
+        }
+        s64 count = w.end - w.start;
+        if (count > 0) {
+            if ((s64)window.capacity < count) {
+                window.clear();
+                window.reserve(count);
+            }
+            text_read(text, w.start, w.end, window.data);
+            line_index_insert(&text->lines, w.old_start, window.data, count);
+        }
+    }
+    window.clear();
+    text->batch_windows.count = 0;
+    text->batch_shift = 0;
+}
+
+inline internal bool text_batching(TextBuffer *text) {
+    return text->batch_depth > 0 && text->indexer == nullptr;
+}
+
+// Whether a sorted run of edits spanning [first, last] is cheaper to apply from its end. The gap
+// buffer moves every byte between the gap and the first edit, so the end nearer the gap wins.
+internal bool text_prefers_descending(TextBuffer *text, s64 first, s64 last) {
+    if (text->backend != GapBackend) return false;
+    s64 to_first = text->gap_start > first ? text->gap_start - first : first - text->gap_start;
+    s64 to_last = text->gap_start > last ? text->gap_start - last : last - text->gap_start;
+    return to_last < to_first;
+}
+
+// Edits past the frontier of a background index only change the length of the pending line, the
+// indexer redoes the lines they touched when it merges. Returns false for edits before the frontier.
+internal bool text_index_past_frontier(TextBuffer *text, s64 start, s64 end, s64 count) {
+    if (text->indexer == nullptr) return false;
+    LineIndex *index = &text->lines;
+    LineLocation pending = line_index_locate_line(index, index->line_count - 1);
+    if (end < pending.start) return false;
+    if (start >= pending.start) {
+        line_indexer_edit(text->indexer, pending.start, start, end, count);
+        line_index_set_length(index, pending, pending.length + count - (end - start));
+        return true;
+    }
+    // a delete across the frontier: its part past the frontier as above, then the lines before
+    // it join the pending line, whose new start is followed by what is left of its old line
+    if (end > pending.start) {
+        line_indexer_edit(text->indexer, pending.start, pending.start, end, 0);
+        line_index_set_length(index, pending, pending.length - (end - pending.start));
+    }
+    line_index_delete(index, start, pending.start);
+    s64 frontier = line_indexer_frontier(index);
+    if (start > frontier) {
+        line_indexer_edit(text->indexer, frontier, frontier, frontier, start - frontier);
+    }
+    return true;
+}
+
+internal void text_insert(TextBuffer *text, s64 pos, u8 *data, s64 count) {
+    text->version++;
+    match_index_insert(&text->matches, pos, count);
+    match_count_insert(&text->counts, text->version, pos, count);
+    switch (text->backend) {
+    case PieceBackend: piece_table_insert(&text->pieces, pos, data, count); break;
+    case RopeBackend:  rope_insert(&text->rope, pos, data, count); return;
+    default:           gap_insert(text, pos, data, count); break;
+    }
+    if (text_index_past_frontier(text, pos, pos, count)) {
+        return;
+    }
+    if (text_batching(text)) {
+        text_batch_touch(text, pos, pos, count);
+    } else {
+        line_index_insert(&text->lines, pos, data, count);
+    }
+}
+
+internal void text_delete(TextBuffer *text, s64 start, s64 end) {
+    text->version++;
+    match_index_delete(&text->matches, start, end);
+    match_count_delete(&text->counts, text->version, start, end);
+    switch (text->backend) {
+    case PieceBackend: piece_table_delete(&text->pieces, start, end); break;
+    case RopeBackend:  rope_delete(&text->rope, start, end); return;
+    default:           gap_delete(text, start, end); break;
+    }
+    if (text_index_past_frontier(text, start, end, 0)) {
+        return;
+    }
+    if (text_batching(text)) {
+        text_batch_touch(text, start, end, 0);
+    } else {
+        line_index_delete(&text->lines, start, end);
+    }
+}
+
+internal void text_clear(TextBuffer *text) {
+    text->version++;
+    text->batch_windows.count = 0;
+    text->batch_shift = 0;
+    text_stop_indexing(text);
+    match_index_clear(&text->matches);
+    match_count_reset(&text->counts, text->counts.pattern, text->counts.reach, 0);
+    switch (text->backend) {
+    case PieceBackend:
+        piece_table_clear(&text->pieces);
+        break;
+    case RopeBackend:
+        rope_clear(&text->rope);
+        break;
+    default:
+        gap_unshare(text);
+        text->gap_start = 0;
+        text->gap_end = text->end;
+        gap_shrink(text);
+        break;
+    }
+    text_rebuild_lines(text);
+}
+
+// Applies edits sorted by start and apart from each other, positions in the text before any of
+// them, by writing the new text out in one pass and loading it in place of the old one. Costs a
+// copy of the whole text however many edits there are, where making them one at a time costs a
+// backend edit each and leaves a piece table with a piece per edit. The backend stays the same
+// and snapshots keep reading the old storage.
+internal void text_rebuild(TextBuffer *text, CursorEdit *edits, s64 count) {
+    s64 length = text_length(text);
+    s64 new_length = length;
+    for (s64 i = 0; i < count; i++) {
+        new_length += edits[i].count - (edits[i].end - edits[i].start);
+    }
+    // the gap buffer gets its gap at the end
+    s64 gap = text->backend == GapBackend ? GAP_SIZE : 0;
+    u8 *contents = (u8 *)malloc(new_length + gap + 1);
+    u8 *at = contents;
+    s64 pos = 0;
+    for (s64 i = 0; i < count; i++) {
+        text_read(text, pos, edits[i].start, at);
+        at += edits[i].start - pos;
+        memcpy(at, edits[i].data, edits[i].count);
+        at += edits[i].count;
+        pos = edits[i].end;
+    }
+    text_read(text, pos, length, at);
+    contents[new_length + gap] = '\0';
+
+    text->version++;
+    text->batch_windows.count = 0;
+    text->batch_shift = 0;
+    // the indexer reads the old storage without holding it
+    text_stop_indexing(text);
+    MatchIndex *matches = &text->matches;
+    match_index_reset(matches, matches->pattern, matches->reach, new_length);
+    match_count_reset(&text->counts, text->counts.pattern, text->counts.reach, new_length);
+    switch (text->backend) {
+    case PieceBackend:
+        piece_table_free(&text->pieces);
+        piece_table_init(&text->pieces, shared_bytes_new(contents), new_length);
+        break;
+    case RopeBackend:
+        rope_node_release(text->rope.root);
+        rope_init(&text->rope, contents, new_length);
+        free(contents);
+        break;
+    default:
+        if (text->contents_shared) {
+            shared_bytes_release(text->contents_shared);
+            text->contents_shared = nullptr;
+        } else {
+            free(text->contents);
+        }
+        text->contents = contents;
+        text->gap_start = new_length;
+        text->gap_end = text->end = new_length + gap;
+        break;
+    }
+    text_rebuild_lines(text);
+}
+
+inline internal s64 text_line_count(TextBuffer *text) {
+    if (text->backend == RopeBackend) {
+        return text->rope.root->newlines + 1;
+    }
+    return text->lines.line_count;
+}
+
+internal LineLocation text_locate_line(TextBuffer *text, s64 line) {
+    if (text->backend == RopeBackend) {
+        Rope *rope = &text->rope;
+        LineLocation result{};
+        result.line = clamp(line, 0, rope->root->newlines);
+        result.start = rope_line_start(rope, result.line);
+        result.length = rope_line_start(rope, result.line + 1) - result.start;
+        return result;
+    }
+    assert(text->batch_windows.empty());
+    return line_index_locate_line(&text->lines, line);
+}
+
+internal LineLocation text_locate_pos(TextBuffer *text, s64 pos) {
+    if (text->backend == RopeBackend) {
+        return text_locate_line(text, rope_line_of(&text->rope, pos));
+    }
+    assert(text->batch_windows.empty());
+    return line_index_locate_pos(&text->lines, pos);
+}
+
+// takes ownership of contents
+internal TextBuffer *text_buffer_init(string contents) {
+    TextBuffer *text = (TextBuffer *)malloc(sizeof(TextBuffer));
+    block_zero(text, sizeof(TextBuffer));
+    if (contents.count >= LARGE_FILE_SIZE && large_file_backend == RopeBackend) {
+        text->backend = RopeBackend;
+        rope_init(&text->rope, (u8 *)contents.data, contents.count);
+        free(contents.data);
+    } else if (contents.count >= LARGE_FILE_SIZE) {
+        text->backend = PieceBackend;
+        piece_table_init(&text->pieces, shared_bytes_new((u8 *)contents.data), contents.count);
+    } else {
+        text->backend = GapBackend;
+        text->contents = (u8 *)contents.data;
+        text->gap_start = 0;
+        text->gap_end = 0;
+        text->end = contents.count;
+    }
+    text_rebuild_lines(text);
+    return text;
+}
+
+// reads are served from the mapping, edits only ever touch the add buffer and lines are indexed
+// in the background
+internal TextBuffer *text_buffer_init(FileMap map) {
+    TextBuffer *text = (TextBuffer *)malloc(sizeof(TextBuffer));
+    block_zero(text, sizeof(TextBuffer));
+    if (large_file_backend == RopeBackend) {
+        // the rope keeps its text in its leaves, so the mapping is only needed to build it
+        text->backend = RopeBackend;
+        rope_init(&text->rope, map.data, map.size);
+        os_unmap_file(&map);
+    } else {
+        text->backend = PieceBackend;
+        piece_table_init(&text->pieces, shared_bytes_map(map), map.size);
+        text->indexer = line_indexer_start(&text->lines, map.data, map.size);
+        return text;
+    }
+    text_rebuild_lines(text);
+    return text;
+}
+
+inline internal bool text_mapped(TextBuffer *text) {
+    return text->backend == PieceBackend && text->pieces.original && text->pieces.original->map.data;
+}
+
+// Lets go of the mapping so its file can be replaced, text_remap has to follow before the text is
+// read again. Snapshots still holding the mapping keep it alive until they are freed.
+internal void text_unmap(TextBuffer *text) {
+    assert(text_mapped(text));
+    text_finish_indexing(text);
+    shared_bytes_release(text->pieces.original);
+    text->pieces.original = nullptr;
+    text->pieces.span = nullptr;
+}
+
+// Moves a mapped piece table onto a new mapping of its file. After a save the file holds exactly
+// the text, so the pieces collapse into one over the new mapping. Otherwise the file is unchanged
+// and the pieces only need the new address.
+internal void text_remap(TextBuffer *text, FileMap map, bool saved) {
+    assert(text->backend == PieceBackend && text->indexer == nullptr);
+    if (saved) {
+        assert(map.size == text_length(text));
+        piece_table_free(&text->pieces);
+        piece_table_init(&text->pieces, shared_bytes_map(map), map.size);
+    } else {
+        shared_bytes_release(text->pieces.original);
+        text->pieces.original = shared_bytes_map(map);
+        text->pieces.span = nullptr;
+    }
+}
+
+// For when the mapped file was moved aside to file_name and replaced by something other than the
+// text. The pieces go on reading the moved file, which is deleted once nothing holds its mapping.
+// Takes ownership of file_name.
+internal void text_map_moved(TextBuffer *text, string file_name) {
+    assert(text_mapped(text));
+    SharedBytes *original = text->pieces.original;
+    free(original->remove_name);
+    original->remove_name = file_name.data;
+}
+
+// @note Snapshots
+// Taking one only adds references. The piece table and the rope copy nodes on their edit paths
+// while a snapshot holds them, the gap buffer copies its whole block on the first edit after one.
+internal TextSnapshot *text_snapshot(TextBuffer *text) {
+    TextSnapshot *snapshot = (TextSnapshot *)malloc(sizeof(TextSnapshot));
+    block_zero(snapshot, sizeof(TextSnapshot));
+    snapshot->backend = text->backend;
+    snapshot->length = text_length(text);
+    snapshot->version = text->version;
+    switch (text->backend) {
+    case PieceBackend: {
+        PieceTable *table = &text->pieces;
+        if (table->add_shared == nullptr) {
+            table->add_shared = shared_bytes_new(table->add);
+        }
+        piece_ref(table->root);
+        shared_bytes_ref(table->original);
+        shared_bytes_ref(table->add_shared);
+        snapshot->pieces = table->root;
+        snapshot->original = table->original;
+        snapshot->add = table->add_shared;
+        break;
+    }
+    case RopeBackend:
+        rope_node_ref(text->rope.root);
+        snapshot->rope = text->rope.root;
+        break;
+    default:
+        if (text->contents_shared == nullptr) {
+            text->contents_shared = shared_bytes_new(text->contents);
+        }
+        shared_bytes_ref(text->contents_shared);
+        snapshot->contents = text->contents_shared;
+        snapshot->gap_start = text->gap_start;
+        snapshot->gap_end = text->gap_end;
+        break;
+    }
+    return snapshot;
+}
+
+// Same as text_span but safe from any thread. There is no span cache, each call is a descent.
+internal u8 *text_snapshot_span(TextSnapshot *snapshot, s64 pos, s64 *count) {
+    if (pos < 0 || pos >= snapshot->length) {
+        *count = 0;
+        return nullptr;
+    }
+    switch (snapshot->backend) {
+    case PieceBackend: {
+        s64 base;
+        Piece *piece = piece_find(snapshot->pieces, pos, &base);
+        u8 *source = piece->add ? snapshot->add->data : snapshot->original->data;
+        *count = base + piece->length - pos;
+        return source + piece->start + (pos - base);
+    }
+    case RopeBackend: {
+        RopeNode *node = snapshot->rope;
+        s64 base = 0;
+        while (!node->leaf) {
+            s32 i = 0;
+            while (i < node->count - 1 && pos >= base + node->children[i]->bytes) {
+                base += node->children[i]->bytes;
+                i++;
+            }
+            node = node->children[i];
+        }
+        *count = base + node->bytes - pos;
+        return node->text + (pos - base);
+    }
+    default: {
+        u8 *contents = snapshot->contents->data;
+        if (pos < snapshot->gap_start) {
+            *count = snapshot->gap_start - pos;
+            return contents + pos;
+        }
+        *count = snapshot->length - pos;
+        return contents + pos + (snapshot->gap_end - snapshot->gap_start);
+    }
+    }
+}
+
+// Reads bytes that belong to no text, like a file being searched, the way a snapshot of a text
+// is read. Nothing is held, the bytes have to outlive the snapshot.
+internal void text_snapshot_bytes(TextSnapshot *snapshot, SharedBytes *shared, u8 *data, s64 count) {
+    block_zero(snapshot, sizeof(TextSnapshot));
+    block_zero(shared, sizeof(SharedBytes));
+    shared->refs = 1;
+    shared->data = data;
+    snapshot->backend = GapBackend;
+    snapshot->length = count;
+    snapshot->contents = shared;
+    snapshot->gap_start = count;
+    snapshot->gap_end = count;
+}
+
+internal void text_snapshot_read(TextSnapshot *snapshot, s64 start, s64 end, u8 *dest) {
+    for (s64 pos = start; pos < end; ) {
+        s64 count;
+        u8 *span = text_snapshot_span(snapshot, pos, &count);
+        if (count > end - pos) count = end - pos;
+        memcpy(dest, span, count);
+        dest += count;
+        pos += count;
+    }
+}
+
+inline internal u8 text_snapshot_char(TextSnapshot *snapshot, s64 pos) {
+    s64 count;
+    u8 *span = text_snapshot_span(snapshot, pos, &count);
+    return span ? *span : 0;
+}
+
+// Lets go of the text but keeps the length and version, for when only those are still needed.
+// Can run on any thread, like text_snapshot_free.
+internal void text_snapshot_release(TextSnapshot *snapshot) {
+    piece_release(snapshot->pieces);
+    shared_bytes_release(snapshot->original);
+    shared_bytes_release(snapshot->add);
+    if (snapshot->rope) rope_node_release(snapshot->rope);
+    shared_bytes_release(snapshot->contents);
+    snapshot->pieces = nullptr;
+    snapshot->original = nullptr;
+    snapshot->add = nullptr;
+    snapshot->rope = nullptr;
+    snapshot->contents = nullptr;
+}
+
+internal void text_snapshot_free(TextSnapshot *snapshot) {
+    text_snapshot_release(snapshot);
+    free(snapshot);
+}
+
+internal TextBuffer *text_buffer_init() {
+    TextBuffer *text = (TextBuffer *)malloc(sizeof(TextBuffer));
+    block_zero(text, sizeof(TextBuffer));
+    text->backend = GapBackend;
+    text->contents = (u8 *)malloc(GAP_SIZE + 1);
+    text->gap_start = 0;
+    text->end = text->gap_end = GAP_SIZE;
+    text_rebuild_lines(text);
+    return text;
+}
@@ -45,6 +45,7 @@ internal void block_zero(void *mem, size_t size) {
 
 #include "xpath.h"
 #include "array.cpp"
+#include "os.cpp"
 #include "codex.cpp"
 
 #include "draw.cpp"
@@ -293,11 +294,17 @@ int main(int argc, char **argv) {
     normal_keymap.bind('x', extend_line_below);
     normal_keymap.bind('I', insert_at_line_start);
     normal_keymap.bind('A', insert_at_line_end);
+    normal_keymap.bind('u', undo);
+    normal_keymap.bind('U', redo);
+    normal_keymap.bind('C', add_cursor_below);
+    normal_keymap.bind(',', keep_primary_cursor);
     normal_keymap.bind(CTRL | 'b', page_up);
     normal_keymap.bind(CTRL | 'f', page_down);
     normal_keymap.bind(CTRL | 's', write_buffer);
     normal_keymap.bind('{', move_paragraph_up);
     normal_keymap.bind('}', move_paragraph_down);
+    normal_keymap.bind('\n', goto_result);
+    normal_keymap.bind('\r', goto_result);
 
     // insert
     for (u32 i = 0; i < max_key_count; i++) {
@@ -434,7 +441,6 @@ int main(int argc, char **argv) {
     render_target.height = HEIGHT;
 
 
-    string file_text{};
     string file_name{};
     if (arg.data) {
         xp_path file_path = xp_path_new(arg.data);
@@ -442,8 +448,6 @@ int main(int argc, char **argv) {
             file_path = xp_fullpath(file_path);
         }
         file_name = string_make((char *)file_path.data, file_path.count);
-        string f = read_file(file_name);
-        file_text = crlf_to_lf(f);
     } else {
         file_name = CONSTZ("[scratch]");
     }
@@ -452,7 +456,7 @@ int main(int argc, char **argv) {
         View *view = view_init();
         application->active_view = view;
         view->rect = {0, 0, WIDTH, HEIGHT - atlas.glyph_height};
-        view->buffer = buffer_init(file_name, file_text);
+        view->buffer = arg.data ? buffer_open(file_name) : buffer_init(file_name, string{});
         view->lines = (int)(HEIGHT / atlas.glyph_height) - 1;
         view->atlas = &atlas;
         
@@ -496,6 +500,12 @@ int main(int argc, char **argv) {
             render_target.height = h;
         }
 
+        update_line_indexing(application);
+        update_saves(application, false);
+        update_incremental_search(application);
+        update_match_count(application);
+        update_grep(application);
+
         for (View *view = application->view_list; view; view = view->next) {
             if (view->is_commandbuf && application->command_mode) {
                 draw_view(&render_target, view, &atlas);
@@ -525,5 +535,10 @@ int main(int argc, char **argv) {
         last_counter = end_counter;
     }
 
+    // saves still running would leave their temp file behind
+    update_saves(application, true);
+    if (application->grep) grep_free(application->grep);
+    if (application->match_count) match_count_free(application->match_count);
+
     return 0;
 }
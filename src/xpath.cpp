@@ -5,6 +5,7 @@
 #endif
 
 #ifdef __linux__
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -70,6 +71,9 @@ void xp_path_free(xp_path *path) {
 
 void xp_directory_free(xp_directory *directory) {
     xp_path_free(&directory->path);
+    for (int i = 0; i < directory->file_count; i++) {
+        free(directory->files[i].name);
+    }
     if (directory->files) {
         free(directory->files);
     }
@@ -109,7 +113,7 @@ xp_path xp_get_home_path() {
     if ((home_path = getenv("HOME")) == NULL) {
         // home_path = getpwuid(getuid())->pw_dir;
     }
-    xp_path home = {home_path, strlen(home_path)};
+    xp_path home = {(unsigned char *)home_path, (int)strlen(home_path)};
     return home;
 }
 #endif
@@ -161,7 +165,7 @@ xp_path xp_current_path() {
 #elif defined(__linux__)
 xp_path xp_current_path() {
     char *str = getcwd(NULL, 0);
-    xp_path path = {str, strlen(str)};
+    xp_path path = {(unsigned char *)str, (int)strlen(str)};
     return path;
 }
 #endif
@@ -208,9 +212,9 @@ xp_path xp_fullpath(xp_path path) {
 xp_path xp_fullpath(xp_path path) {
     assert(path.count > 0);
     xp_path full_path = path;
-    char *ptr = realpath(path.data, NULL);
+    char *ptr = realpath((char *)path.data, NULL);
     if (ptr) {
-        full_path.data = ptr;
+        full_path.data = (unsigned char *)ptr;
         full_path.count = strlen(ptr);
     } else {
         // TODO: realpath error
@@ -288,7 +292,7 @@ bool xp_directory_new(xp_path path, xp_directory *directory) {
     memset(directory, 0, sizeof(xp_directory));
     directory->path = xp_fullpath(path);
 
-    DIR *d = opendir(path.data);
+    DIR *d = opendir((char *)path.data);
     if (d == NULL) {
         return false;
     }
@@ -307,7 +311,7 @@ bool xp_directory_new(xp_path path, xp_directory *directory) {
             int stat_res = fstatat(dir_fd, dir->d_name, &f_stat, 0);
 
             xp_file file = {0};
-            file.name = malloc(strlen(dir->d_name) + 1);
+            file.name = (char *)malloc(strlen(dir->d_name) + 1);
             strcpy(file.name, dir->d_name);
             file.bytes = (uint64_t)f_stat.st_size;
             file.time = f_stat.st_mtime; 